@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __AXIS_MAPPER_H
+#define __AXIS_MAPPER_H
+
+#include <linux/input.h>
+
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Percent of the way from rest to the end of an axis at which its key is
+// pressed, and released again, unless set otherwise.
+const int kDefaultAxisPressPercent = 50;
+const int kDefaultAxisReleasePercent = 30;
+
+// Keys pressed by moving an axis, e.g. ABS_X to A and D for a stick.
+struct AxisMapping {
+  // ABS_* code.
+  int axis = 0;
+  // Key for either side of the rest position, or -1 for none.
+  int negative_key = -1;
+  int positive_key = -1;
+  // Press past press_percent of the way from rest to the end, and release
+  // back within release_percent. The gap keeps a key from flickering while
+  // the axis hovers around the threshold.
+  int press_percent = kDefaultAxisPressPercent;
+  int release_percent = kDefaultAxisReleasePercent;
+  // The axis rests at its minimum, e.g. a trigger, rather than the center.
+  bool from_minimum = false;
+};
+
+// ABS_X for 0 etc., for the axes of gamepads and joysticks.
+inline const std::array<std::pair<int, const char*>, 19> kAxisNames = {{
+    {ABS_X, "ABS_X"},
+    {ABS_Y, "ABS_Y"},
+    {ABS_Z, "ABS_Z"},
+    {ABS_RX, "ABS_RX"},
+    {ABS_RY, "ABS_RY"},
+    {ABS_RZ, "ABS_RZ"},
+    {ABS_THROTTLE, "ABS_THROTTLE"},
+    {ABS_RUDDER, "ABS_RUDDER"},
+    {ABS_WHEEL, "ABS_WHEEL"},
+    {ABS_GAS, "ABS_GAS"},
+    {ABS_BRAKE, "ABS_BRAKE"},
+    {ABS_HAT0X, "ABS_HAT0X"},
+    {ABS_HAT0Y, "ABS_HAT0Y"},
+    {ABS_HAT1X, "ABS_HAT1X"},
+    {ABS_HAT1Y, "ABS_HAT1Y"},
+    {ABS_HAT2X, "ABS_HAT2X"},
+    {ABS_HAT2Y, "ABS_HAT2Y"},
+    {ABS_HAT3X, "ABS_HAT3X"},
+    {ABS_HAT3Y, "ABS_HAT3Y"},
+}};
+
+inline std::optional<int> AxisNameToCode(const std::string& name) {
+  for (const auto& [code, axis_name] : kAxisNames) {
+    if (name == axis_name) return code;
+  }
+  return std::nullopt;
+}
+
+inline std::string AxisCodeToName(int code) {
+  for (const auto& [axis_code, axis_name] : kAxisNames) {
+    if (code == axis_code) return axis_name;
+  }
+  return "ABS_" + std::to_string(code);
+}
+
+// Turns samples of axes into key presses and releases. Samples come at up to
+// 1kHz per axis, and almost all of them cross no threshold. So each axis has
+// the range of values which change nothing in its current position, and a
+// sample within it costs two comparisons. Axes are in a flat array indexed
+// by ABS_* code.
+class AxisMapper {
+ public:
+  // Forgets all mappings, without releasing anything.
+  void Clear() {
+    axes_ = {};
+    mapped_ = 0;
+  }
+
+  // Maps an axis, whose range is given by info. Returns false if the range
+  // is empty, e.g. as the device does not have the axis.
+  bool Map(const AxisMapping& mapping, const struct input_absinfo& info) {
+    if (mapping.axis < 0 || mapping.axis >= ABS_CNT ||
+        info.maximum <= info.minimum) {
+      return false;
+    }
+    Axis& axis = axes_[mapping.axis];
+    const double rest = mapping.from_minimum
+                            ? info.minimum
+                            : (double(info.minimum) + info.maximum) / 2;
+    const double span =
+        mapping.from_minimum ? double(info.maximum) - info.minimum
+                             : (double(info.maximum) - info.minimum) / 2;
+    const double press = span * mapping.press_percent / 100;
+    const double release = span * mapping.release_percent / 100;
+    axis.negative_press = std::floor(rest - press);
+    axis.negative_release = std::floor(rest - release);
+    axis.positive_press = std::ceil(rest + press);
+    axis.positive_release = std::ceil(rest + release);
+    axis.negative_key = mapping.from_minimum ? -1 : mapping.negative_key;
+    axis.positive_key = mapping.positive_key;
+    if (!axis.mapped) ++mapped_;
+    axis.mapped = true;
+    axis.direction = 0;
+    UpdateQuietRange(axis);
+    return true;
+  }
+
+  bool empty() const { return mapped_ == 0; }
+
+  bool Maps(int code) const {
+    return code >= 0 && code < ABS_CNT && axes_[code].mapped;
+  }
+
+  // To be called on every sample of an axis. Returns false if the axis is
+  // not mapped, in which case the sample is to be passed on as is. Calls
+  // emit(key_code, value) as thresholds are crossed.
+  template <typename Emit>
+  bool Process(int code, int value, Emit&& emit) {
+    if (code < 0 || code >= ABS_CNT) return false;
+    Axis& axis = axes_[code];
+    if (value >= axis.quiet_low && value <= axis.quiet_high) [[likely]] {
+      return axis.mapped;
+    }
+    if (!axis.mapped) return false;
+    const int direction = Direction(axis, value);
+    if (direction != axis.direction) {
+      if (const int key = KeyOf(axis, axis.direction); key >= 0) emit(key, 0);
+      if (const int key = KeyOf(axis, direction); key >= 0) emit(key, 1);
+      axis.direction = direction;
+      UpdateQuietRange(axis);
+    }
+    return true;
+  }
+
+  // Takes the position of each mapped axis from get_value(code), e.g. after
+  // events were dropped, without emitting anything. See KeysDown().
+  void Resync(const std::function<std::optional<int>(int)>& get_value) {
+    for (int code = 0; code < ABS_CNT; ++code) {
+      Axis& axis = axes_[code];
+      if (!axis.mapped) continue;
+      const auto value = get_value(code);
+      axis.direction = value.has_value() ? Direction(axis, *value) : 0;
+      UpdateQuietRange(axis);
+    }
+  }
+
+  // Keys pressed by the axes in their current positions.
+  std::vector<int> KeysDown() const {
+    std::vector<int> keys_down;
+    for (const Axis& axis : axes_) {
+      if (const int key = KeyOf(axis, axis.direction); key >= 0) {
+        keys_down.push_back(key);
+      }
+    }
+    return keys_down;
+  }
+
+ private:
+  struct Axis {
+    // Values which change nothing in the current direction, first as they
+    // are read on every sample. Empty while not mapped.
+    int quiet_low = INT_MAX;
+    int quiet_high = INT_MIN;
+    // Pressed at or beyond, released within.
+    int negative_press = 0;
+    int negative_release = 0;
+    int positive_press = 0;
+    int positive_release = 0;
+    int negative_key = -1;
+    int positive_key = -1;
+    // -1, 0 or 1 for the side whose key is pressed, if any.
+    int direction = 0;
+    bool mapped = false;
+  };
+
+  static int KeyOf(const Axis& axis, int direction) {
+    return direction < 0   ? axis.negative_key
+           : direction > 0 ? axis.positive_key
+                           : -1;
+  }
+
+  // Where the axis is at value, coming from its current direction.
+  static int Direction(const Axis& axis, int value) {
+    if (axis.negative_key >= 0 &&
+        (value <= axis.negative_press ||
+         (axis.direction < 0 && value <= axis.negative_release))) {
+      return -1;
+    }
+    if (axis.positive_key >= 0 &&
+        (value >= axis.positive_press ||
+         (axis.direction > 0 && value >= axis.positive_release))) {
+      return 1;
+    }
+    return 0;
+  }
+
+  static void UpdateQuietRange(Axis& axis) {
+    if (axis.direction < 0) {
+      axis.quiet_low = INT_MIN;
+      axis.quiet_high = axis.negative_release;
+    } else if (axis.direction > 0) {
+      axis.quiet_low = axis.positive_release;
+      axis.quiet_high = INT_MAX;
+    } else {
+      axis.quiet_low =
+          axis.negative_key >= 0 ? axis.negative_press + 1 : INT_MIN;
+      axis.quiet_high =
+          axis.positive_key >= 0 ? axis.positive_press - 1 : INT_MAX;
+    }
+  }
+
+  std::array<Axis, ABS_CNT> axes_;
+  int mapped_ = 0;
+};
+
+#endif  // __AXIS_MAPPER_H
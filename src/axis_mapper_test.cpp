@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "axis_mapper.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+SCENARIO("Axis mapping") {
+  AxisMapper mapper;
+  std::vector<std::string> keys;
+  const auto feed = [&](int code, std::vector<int> values) {
+    keys.clear();
+    for (const int value : values) {
+      mapper.Process(code, value, [&keys](int key_code, int key_value) {
+        keys.push_back((key_value == 1 ? "P " : "R ") +
+                       std::to_string(key_code));
+      });
+    }
+    return keys;
+  };
+  // Stick from -100 to 100, trigger from 0 to 255 and hat from -1 to 1.
+  struct input_absinfo stick = {}, trigger = {}, hat = {};
+  stick.minimum = -100;
+  stick.maximum = 100;
+  trigger.maximum = 255;
+  hat.minimum = -1;
+  hat.maximum = 1;
+  CHECK(mapper.empty());
+  REQUIRE(mapper.Map({ABS_X, KEY_A, KEY_D, 50, 30, false}, stick));
+  REQUIRE(mapper.Map({ABS_Z, -1, KEY_SPACE, 50, 30, true}, trigger));
+  REQUIRE(mapper.Map({ABS_HAT0Y, KEY_W, KEY_S, 50, 30, false}, hat));
+  CHECK(!mapper.Map({ABS_Y, KEY_W, KEY_S, 50, 30, false}, {}));
+  CHECK(!mapper.empty());
+
+  THEN("Keys press past the press threshold and release within release") {
+    CHECK(feed(ABS_X, {0, 20, 49}).empty());
+    CHECK(feed(ABS_X, {50}) == std::vector<std::string>{"P 32"});
+    // Hovering around the press threshold does not flicker.
+    CHECK(feed(ABS_X, {49, 51, 31, 30}).empty());
+    CHECK(feed(ABS_X, {29}) == std::vector<std::string>{"R 32"});
+    CHECK(feed(ABS_X, {-60, -10}) ==
+          std::vector<std::string>{"P 30", "R 30"});
+  }
+  THEN("A flick to the other side releases and presses") {
+    CHECK(feed(ABS_X, {-100, 100}) ==
+          std::vector<std::string>{"P 30", "R 30", "P 32"});
+  }
+  THEN("Triggers press away from their minimum") {
+    CHECK(feed(ABS_Z, {0, 127}).empty());
+    CHECK(feed(ABS_Z, {128, 255, 77}) == std::vector<std::string>{"P 57"});
+    CHECK(feed(ABS_Z, {76}) == std::vector<std::string>{"R 57"});
+  }
+  THEN("Hats press at either end") {
+    CHECK(feed(ABS_HAT0Y, {-1, 0, 1, 0}) ==
+          std::vector<std::string>{"P 17", "R 17", "P 31", "R 31"});
+  }
+  THEN("Axes not mapped are passed on") {
+    CHECK(!mapper.Process(ABS_RX, 5, [](int, int) {}));
+    CHECK(!mapper.Process(ABS_CNT, 5, [](int, int) {}));
+    CHECK(mapper.Process(ABS_X, 5, [](int, int) {}));
+  }
+  THEN("A resync takes the axes where they are") {
+    mapper.Resync([](int code) -> std::optional<int> {
+      return code == ABS_X ? -80 : 0;
+    });
+    CHECK(mapper.KeysDown() == std::vector<int>{KEY_A});
+    CHECK(feed(ABS_X, {0}) == std::vector<std::string>{"R 30"});
+    CHECK(mapper.KeysDown().empty());
+  }
+}
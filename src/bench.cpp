@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of Remapper features against what they replace, with checks
+// that they behave as expected -
+// - A SOCD group against the snap tap recipe of mappings, on random strafing
+//   with A and D.
+// - Stacks of 1 to 4 held layer keys, e.g. RIGHTCTRL + LEFTSHIFT + 1, with
+//   layer stacks walked and compiled.
+// - LShift-ESC against the recipe of a layer on LEFTSHIFT, on typing with
+//   shift held half the time.
+// - A stick mapped to WASD, on samples of both axes as a gamepad streams
+//   them, against thresholds checked in full on every sample.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "axis_mapper.h"
+#include "config_parser.h"
+#include "remap_operator.h"
+#include "utility/argparse.h"
+
+using Trace = std::vector<std::pair<int, int>>;
+
+struct Result {
+  double ns_per_event = 0;
+  // Of the first run through the trace.
+  Trace output;
+  RemapperCounters counters;
+};
+
+Result Run(const std::vector<std::string>& lines, const Trace& trace,
+           int repetitions, bool compile) {
+  Remapper remapper;
+  if (!ConfigParser(&remapper).Parse(lines)) {
+    throw std::runtime_error("Could not parse the config!");
+  }
+  remapper.Optimize();
+  if (compile) remapper.CompileLayerStacks();
+
+  Result result;
+  remapper.SetCallback([&result](int key_code, int value) {
+    result.output.push_back({key_code, value});
+  });
+  for (const auto& [key_code, value] : trace) {
+    remapper.Process(key_code, value);
+  }
+  result.counters = remapper.counters();
+
+  remapper.SetCallback([](int, int) {});
+  const auto start_time = std::chrono::steady_clock::now();
+  for (int repetition = 0; repetition < repetitions; ++repetition) {
+    for (const auto& [key_code, value] : trace) {
+      remapper.Process(key_code, value);
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start_time;
+  result.ns_per_event =
+      std::chrono::duration<double, std::nano>(elapsed).count() /
+      (double(trace.size()) * repetitions);
+  return result;
+}
+
+Trace StrafeTrace(std::size_t size) {
+  std::mt19937 random(42);
+  std::set<int> held;
+  Trace trace;
+  while (trace.size() < size) {
+    const int key_code = random() % 2 == 0 ? KEY_A : KEY_D;
+    if (!held.contains(key_code)) {
+      held.insert(key_code);
+      trace.push_back({key_code, 1});
+    } else if (random() % 4 == 0) {
+      trace.push_back({key_code, 2});
+    } else {
+      held.erase(key_code);
+      trace.push_back({key_code, 0});
+    }
+  }
+  return trace;
+}
+
+// Output events after which both A and D were held.
+std::size_t BothHeld(const Trace& output) {
+  std::set<int> held;
+  std::size_t both_held = 0;
+  for (const auto& [key_code, value] : output) {
+    if (value == 1) held.insert(key_code);
+    if (value == 0) held.erase(key_code);
+    if (held.size() == 2) ++both_held;
+  }
+  return both_held;
+}
+
+bool BenchSocd(int repetitions) {
+  const Trace trace = StrafeTrace(10000);
+  const std::vector<std::pair<std::string, std::vector<std::string>>> configs =
+      {{"Recipe ^A = ~D ^A, ^D = ~A ^D", {"^A = ~D ^A", "^D = ~A ^D"}},
+       {"socd A D = last", {"socd A D = last"}},
+       {"socd A D = neutral", {"socd A D = neutral"}},
+       {"socd A D = first", {"socd A D = first"}}};
+  bool success = true;
+  for (const auto& [name, lines] : configs) {
+    const Result result = Run(lines, trace, repetitions, true);
+    const std::size_t both_held = BothHeld(result.output);
+    std::cout << name << ": " << result.ns_per_event << " ns/event, "
+              << result.output.size() << " events out, both held after "
+              << both_held << std::endl;
+    if (name.starts_with("socd") && both_held != 0) success = false;
+  }
+  if (!success) {
+    std::cerr << "ERROR: A SOCD group held both keys." << std::endl;
+  }
+  return success;
+}
+
+const std::vector<std::string> kLayerKeys = {"RIGHTCTRL", "LEFTSHIFT",
+                                             "LEFTALT", "LEFTMETA"};
+
+// Holds `depth` layer keys, types within them and releases them in random
+// order.
+Trace LayerTrace(std::size_t depth, std::size_t size) {
+  std::vector<int> layer_keys;
+  for (std::size_t i = 0; i < depth; ++i) {
+    layer_keys.push_back(NameToKeyCode("KEY_" + kLayerKeys[i]).value());
+  }
+  std::mt19937 random(42);
+  Trace trace;
+  while (trace.size() < size) {
+    for (const int key_code : layer_keys) trace.push_back({key_code, 1});
+    for (int tap = 0; tap < 8; ++tap) {
+      const int key_code = KEY_1 + random() % 4;
+      trace.push_back({key_code, 1});
+      trace.push_back({key_code, 0});
+    }
+    std::shuffle(layer_keys.begin(), layer_keys.end(), random);
+    for (const int key_code : layer_keys) trace.push_back({key_code, 0});
+  }
+  return trace;
+}
+
+bool BenchLayers(int repetitions) {
+  // Each combination maps 1 and 2, and passes the rest on to the one below.
+  std::vector<std::string> lines;
+  for (std::size_t depth = 1; depth <= kLayerKeys.size(); ++depth) {
+    std::string layer;
+    for (std::size_t i = 0; i < depth; ++i) layer += kLayerKeys[i] + " + ";
+    lines.push_back(layer + "1 = F" + std::to_string(depth));
+    lines.push_back(layer + "2 = F" + std::to_string(depth + 4));
+    lines.push_back(layer + "* = *");
+  }
+  bool success = true;
+  for (std::size_t depth = 1; depth <= kLayerKeys.size(); ++depth) {
+    const Trace trace = LayerTrace(depth, 10000);
+    const Result walked = Run(lines, trace, repetitions, false);
+    const Result compiled = Run(lines, trace, repetitions, true);
+    std::cout << depth << " layer keys: walked " << walked.ns_per_event
+              << " ns/event, compiled " << compiled.ns_per_event
+              << " ns/event" << std::endl;
+    if (walked.output != compiled.output) success = false;
+  }
+  if (!success) {
+    std::cerr << "ERROR: Compiled layers differ from walked ones." << std::endl;
+  }
+  return success;
+}
+
+// Words of 8 keys, every other one with shift held, with an ESC now and then.
+Trace ShiftTrace(std::size_t size) {
+  std::mt19937 random(42);
+  Trace trace;
+  bool shift = false;
+  while (trace.size() < size) {
+    if (shift) trace.push_back({KEY_LEFTSHIFT, 1});
+    for (int tap = 0; tap < 8; ++tap) {
+      const int key_code = random() % 8 == 0 ? KEY_ESC : KEY_Q + random() % 10;
+      trace.push_back({key_code, 1});
+      trace.push_back({key_code, 0});
+    }
+    if (shift) trace.push_back({KEY_LEFTSHIFT, 0});
+    shift = !shift;
+  }
+  return trace;
+}
+
+bool BenchModifiers(int repetitions) {
+  const Trace trace = ShiftTrace(10000);
+  const Result layer = Run({"^LEFTSHIFT = ^LEFTSHIFT",
+                            "LEFTSHIFT + ESC = GRAVE", "LEFTSHIFT + * = *"},
+                           trace, repetitions, true);
+  const Result modifier =
+      Run({"LShift-ESC = GRAVE"}, trace, repetitions, true);
+  std::cout << "Recipe LEFTSHIFT + ESC = GRAVE: " << layer.ns_per_event
+            << " ns/event, " << layer.counters.layer_activations
+            << " layer activations" << std::endl
+            << "LShift-ESC = GRAVE: " << modifier.ns_per_event
+            << " ns/event, " << modifier.counters.layer_activations
+            << " layer activations" << std::endl;
+  if (layer.output != modifier.output) {
+    std::cerr << "ERROR: LShift-ESC differs from the layer recipe."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The stick circling now and then, with noise, at 1kHz per axis.
+Trace StickTrace(std::size_t size) {
+  std::mt19937 random(42);
+  std::normal_distribution<double> noise(0, 300);
+  Trace trace;
+  double angle = 0;
+  double radius = 0;
+  while (trace.size() < size) {
+    // Each stroke takes about half a second.
+    angle += 0.0125;
+    radius = std::abs(std::sin(angle / 4)) * 32000;
+    for (const int axis : {ABS_X, ABS_Y}) {
+      const double position =
+          (axis == ABS_X ? std::cos(angle) : std::sin(angle)) * radius;
+      trace.push_back(
+          {axis, int(std::clamp(position + noise(random), -32768.0, 32767.0))});
+    }
+  }
+  return trace;
+}
+
+bool BenchAxes(int repetitions) {
+  const Trace trace = StickTrace(100000);
+  Remapper remapper;
+  if (!ConfigParser(&remapper).Parse({"axis X = A D", "axis Y = W S"})) {
+    throw std::runtime_error("Could not parse the config!");
+  }
+  remapper.Optimize();
+  struct input_absinfo info = {};
+  info.minimum = -32768;
+  info.maximum = 32767;
+  AxisMapper mapper;
+  for (const auto& mapping : remapper.axis_mappings()) {
+    mapper.Map(mapping, info);
+  }
+  Trace output;
+  remapper.SetCallback([&output](int key_code, int value) {
+    output.push_back({key_code, value});
+  });
+  const auto process = [&remapper](int key_code, int value) {
+    remapper.Process(key_code, value);
+  };
+  for (const auto& [axis, value] : trace) mapper.Process(axis, value, process);
+
+  // Thresholds as AxisMapper::Map() sets them for 50% and 30%.
+  Trace expected;
+  int direction[ABS_CNT] = {};
+  for (const auto& [axis, value] : trace) {
+    const int negative_key = axis == ABS_X ? KEY_A : KEY_W;
+    const int positive_key = axis == ABS_X ? KEY_D : KEY_S;
+    int& current = direction[axis];
+    int next = 0;
+    if (value <= -16385 || (current < 0 && value <= -9831)) {
+      next = -1;
+    } else if (value >= 16384 || (current > 0 && value >= 9830)) {
+      next = 1;
+    }
+    if (next == current) continue;
+    if (current != 0) {
+      expected.push_back({current < 0 ? negative_key : positive_key, 0});
+    }
+    if (next != 0) {
+      expected.push_back({next < 0 ? negative_key : positive_key, 1});
+    }
+    current = next;
+  }
+
+  remapper.SetCallback([](int, int) {});
+  const auto start_time = std::chrono::steady_clock::now();
+  for (int repetition = 0; repetition < repetitions; ++repetition) {
+    for (const auto& [axis, value] : trace) {
+      mapper.Process(axis, value, process);
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start_time;
+  std::cout << "Axes to WASD: "
+            << std::chrono::duration<double, std::nano>(elapsed).count() /
+                   (double(trace.size()) * repetitions)
+            << " ns/sample, " << output.size() << " key events from "
+            << trace.size() << " samples" << std::endl;
+  if (output != expected) {
+    std::cerr << "ERROR: Axis mapping differs from the thresholds."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(const int argc, const char** argv) {
+  ArgumentParser parser;
+  parser.AddBool("help", "Show a short help.");
+  parser.AddString("repetitions", "Times to process each trace, default 100.");
+  parser.Parse(argc, argv);
+  if (parser.GetBool("help")) {
+    parser.ShowHelp();
+    return EXIT_SUCCESS;
+  }
+  const int repetitions =
+      std::stoi(parser.GetString("repetitions").value_or("100"));
+
+  const bool socd = BenchSocd(repetitions);
+  const bool layers = BenchLayers(repetitions);
+  const bool modifiers = BenchModifiers(repetitions);
+  const bool axes = BenchAxes(repetitions);
+  return socd && layers && modifiers && axes ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -39,6 +39,46 @@ const int kMaxWaitMs = 1000;
 // When on right, blocks a key e.g. "DELETE = nothing".
 const string kNothingToken = "nothing";
 
+// Begins a section for a profile, e.g. "profile game". Optionally with keys
+// to switch to it, e.g. "profile game = RIGHTCTRL G".
+const string kProfileToken = "profile";
+
+// Makes keys exclusive within the profile, e.g. "socd A D = last". Modes are
+// last (the default), neutral and first.
+const string kSocdToken = "socd";
+
+// Keys typed in order do something, e.g. "sequence RIGHTALT W = W O R D". The
+// right side can also be "profile NAME" to switch profiles, or "kill".
+const string kSequenceToken = "sequence";
+const string kKillToken = "kill";
+
+// Keys pressed together act as one, e.g. "J & K = ESC". How close together is
+// set with e.g. "chord_window = 30ms".
+const char kChordSeparator = '&';
+const string kChordWindowToken = "chord_window";
+
+// Keys mapped while modifiers are held, e.g. "Shift-ESC = GRAVE". Modifiers
+// are Shift, Ctrl, Alt and Meta for either side, or e.g. LShift for one.
+const char kModifierSeparator = '-';
+
+// Keys repeat in software, e.g. "repeat = 250ms 30ms" for delay and interval,
+// "repeat = off", or "rapid_fire = 50ms" to tap every 50ms while held. With
+// keys, e.g. "repeat A D = off", for those keys only. Also per layer, e.g.
+// "CAPSLOCK + repeat = 150ms 20ms".
+const string kRepeatToken = "repeat";
+const string kRapidFireToken = "rapid_fire";
+const string kOffToken = "off";
+
+// Suppresses chatter of worn switches, e.g. "debounce = 8ms" for all keys, or
+// "debounce SPACE ENTER = 15ms" for some. Applies to all profiles.
+const string kDebounceToken = "debounce";
+
+// Moving an axis of a gamepad or joystick presses keys, e.g. "axis X = A D"
+// for either side of a stick, or "axis Z = SPACE" for a trigger, which rests
+// at its minimum. Optionally with the press and release thresholds, e.g.
+// "axis X 60% 40% = A D". Applies to all profiles.
+const string kAxisToken = "axis";
+
 // Utility functions.
 
 std::vector<string> SplitString(const string& str, char delimiter) {
@@ -81,16 +121,85 @@ std::pair<char, std::optional<int>> SplitKeyPrefix(string name) {
     prefix = name[0];
     name = name.substr(1);
   }
-  const auto& keycode = StartsWith(name, "KEY_") ? NameToKeyCode(name)
-                                                 : NameToKeyCode("KEY_" + name);
+  const auto& keycode = StartsWith(name, "KEY_") || StartsWith(name, "BTN_")
+                            ? NameToKeyCode(name)
+                            : NameToKeyCode("KEY_" + name);
   if (!keycode.has_value()) {
     std::cerr << "ERROR: Unknown key code " << name << std::endl;
   }
   return {prefix, keycode};
 }
 
+const string kLayerSuffix = "_layer";
+
 std::string LayerNameFromKey(int keycode) {
-  return KeyCodeToName(keycode) + "_layer";
+  return KeyCodeToName(keycode) + kLayerSuffix;
+}
+
+// Layers of the default profile are not prefixed, so that single profile
+// configs have the same state names as before profiles existed.
+string StatePrefix(const string& profile_name) {
+  return profile_name == kDefaultProfileName ? "" : profile_name + "/";
+}
+
+// E.g. 30 for "30ms". Nullopt if not of that form.
+std::optional<int> ParseMilliSeconds(const string& str) {
+  if (!str.ends_with("ms")) return std::nullopt;
+  try {
+    std::size_t end = 0;
+    const int ms = std::stoi(str.substr(0, str.size() - 2), &end);
+    if (end != str.size() - 2) return std::nullopt;
+    return ms;
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+// E.g. 50 for "50%". Nullopt if not of that form.
+std::optional<int> ParsePercent(const string& str) {
+  if (!str.ends_with("%")) return std::nullopt;
+  try {
+    std::size_t end = 0;
+    const int percent = std::stoi(str.substr(0, str.size() - 1), &end);
+    if (end != str.size() - 1) return std::nullopt;
+    return percent;
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+// Right side of "repeat = 250ms 30ms", "repeat = off" or "rapid_fire = 50ms".
+std::optional<RepeatSettings> ParseRepeatSettings(const string& str,
+                                                  bool rapid_fire) {
+  std::vector<string> tokens;
+  for (const string& token : SplitString(str, ' ')) {
+    if (!token.empty()) tokens.push_back(token);
+  }
+  RepeatSettings settings;
+  if (rapid_fire) {
+    const auto interval = tokens.size() == 1 ? ParseMilliSeconds(tokens[0])
+                                             : std::nullopt;
+    if (!interval.has_value()) return std::nullopt;
+    settings.mode = RepeatSettings::Mode::kRapidFire;
+    settings.interval = std::chrono::milliseconds(*interval);
+    return settings;
+  }
+  if (tokens.size() == 1 && tokens[0] == kOffToken) {
+    settings.mode = RepeatSettings::Mode::kOff;
+    return settings;
+  }
+  if (tokens.size() != 2) return std::nullopt;
+  const auto delay = ParseMilliSeconds(tokens[0]);
+  const auto interval = ParseMilliSeconds(tokens[1]);
+  if (!delay.has_value() || !interval.has_value()) return std::nullopt;
+  settings.delay = std::chrono::milliseconds(*delay);
+  settings.interval = std::chrono::milliseconds(*interval);
+  return settings;
+}
+
+bool IsValidProfileName(const string& profile_name) {
+  return !profile_name.empty() &&
+         profile_name.find_first_of(" \t/") == string::npos;
 }
 
 // Class methods.
@@ -156,6 +265,19 @@ std::vector<Action> ConfigParser::AssignmentToActions(
   return actions;
 }
 
+void ConfigParser::AddAssignedMapping(const string& layer_name,
+                                      KeyEvent key_event,
+                                      const std::vector<Action>& actions) {
+  if (!assigned_.insert({layer_name, key_event.key_code, int(key_event.value)})
+           .second) {
+    std::cerr << "WARNING: Duplicate assignment for " << key_event
+              << (layer_name.empty() ? "" : " in " + layer_name)
+              << ", keeping the first one." << std::endl;
+    return;
+  }
+  remapper_->AddMapping(layer_name, key_event, actions);
+}
+
 // Given a key and string representing what it should do, adds relevant mappings
 // to remapper_.
 bool ConfigParser::ParseAssignment(const string& layer_name,
@@ -163,8 +285,7 @@ bool ConfigParser::ParseAssignment(const string& layer_name,
                                    const string& assignment) {
   const auto [left_prefix, left_key] = SplitKeyPrefix(key_str);
   if (!left_key.has_value()) return false;
-  if (layer_name == kDefaultLayerName &&
-      known_layers_.contains(LayerNameFromKey(left_key.value()))) {
+  if (known_layers_.contains(ChildLayerName(layer_name, left_key.value()))) {
     std::cerr << "ERROR: Key assignments like KEY = ... must precede layer "
                  "assignments KEY + OTHER_KEY = ..."
               << std::endl;
@@ -189,17 +310,17 @@ bool ConfigParser::ParseAssignment(const string& layer_name,
       }
       // On activation, do everything, but only activate the final key.
       tokens[n_tokens - 1] = "^" + last_token;
-      remapper_->AddMapping(layer_name, KeyPressEvent(*left_key),
-                            AssignmentToActions(tokens));
+      AddAssignedMapping(layer_name, KeyPressEvent(*left_key),
+                         AssignmentToActions(tokens));
       // On release, do nothing, and only release the final key.
-      remapper_->AddMapping(layer_name, KeyReleaseEvent(*left_key),
-                            AssignmentToActions({"~" + last_token}));
+      AddAssignedMapping(layer_name, KeyReleaseEvent(*left_key),
+                         AssignmentToActions({"~" + last_token}));
       return true;
     } else {
-      remapper_->AddMapping(layer_name,
-                            left_prefix == '~' ? KeyReleaseEvent(*left_key)
-                                               : KeyPressEvent(*left_key),
-                            AssignmentToActions(tokens));
+      AddAssignedMapping(layer_name,
+                         left_prefix == '~' ? KeyReleaseEvent(*left_key)
+                                            : KeyPressEvent(*left_key),
+                         AssignmentToActions(tokens));
       return true;
     }
   } catch (const std::invalid_argument&) {
@@ -207,33 +328,39 @@ bool ConfigParser::ParseAssignment(const string& layer_name,
   }
 }
 
-bool ConfigParser::ParseLayerAssignment(const string& layer_key_str,
-                                        const string& key_str,
-                                        const string& assignment) {
-  const auto [layer_prefix, layer_key] = SplitKeyPrefix(layer_key_str);
-  if (layer_prefix != 0) {
-    std::cerr << "ERROR: Prefix (^ or ~) for layer keys is not supported yet."
-              << std::endl;
-    return false;
-  }
-  if (!layer_key.has_value()) {
-    std::cerr << "ERROR: Could not parse layer key " << layer_key_str
-              << std::endl;
-    return false;
-  }
-  string layer_name = LayerNameFromKey(layer_key.value());
-
-  // Add default to layer mapping.
-  if (known_layers_.find(layer_name) == known_layers_.end()) {
-    try {
-      remapper_->AddMapping(kDefaultLayerName, KeyPressEvent(*layer_key),
-                            {remapper_->ActionActivateState(layer_name)});
-    } catch (std::invalid_argument&) {
-      std::cerr << "ParseLayerAssignment: Failed" << std::endl;
+bool ConfigParser::ParseLayerAssignment(
+    const std::vector<string>& layer_key_strs, const string& key_str,
+    const string& assignment) {
+  // Each layer key activates a layer within the previous one, e.g. for
+  // A + B + C, A activates KEY_A_layer and B then KEY_A_KEY_B_layer.
+  string layer_name = StateName(kDefaultLayerName);
+  for (const string& layer_key_str : layer_key_strs) {
+    const auto [layer_prefix, layer_key] = SplitKeyPrefix(layer_key_str);
+    if (layer_prefix != 0) {
+      std::cerr << "ERROR: Prefix (^ or ~) for layer keys is not supported yet."
+                << std::endl;
+      return false;
+    }
+    if (!layer_key.has_value()) {
+      std::cerr << "ERROR: Could not parse layer key " << layer_key_str
+                << std::endl;
       return false;
     }
-    remapper_->SetAllowOtherKeys(layer_name, false);
-    known_layers_.insert(layer_name);
+    const string parent_name = layer_name;
+    layer_name = ChildLayerName(parent_name, layer_key.value());
+
+    // Add parent to layer mapping.
+    if (known_layers_.find(layer_name) == known_layers_.end()) {
+      try {
+        remapper_->AddMapping(parent_name, KeyPressEvent(*layer_key),
+                              {remapper_->ActionActivateState(layer_name)});
+      } catch (std::invalid_argument&) {
+        std::cerr << "ParseLayerAssignment: Failed" << std::endl;
+        return false;
+      }
+      remapper_->SetAllowOtherKeys(layer_name, false);
+      known_layers_.insert(layer_name);
+    }
   }
 
   // Handle SHIFT + * = *.
@@ -247,6 +374,24 @@ bool ConfigParser::ParseLayerAssignment(const string& layer_key_str,
     return true;
   }
 
+  // Handle CAPSLOCK + repeat = 150ms 20ms.
+  if (key_str == kRepeatToken || key_str == kRapidFireToken) {
+    const auto settings =
+        ParseRepeatSettings(assignment, key_str == kRapidFireToken);
+    if (!settings.has_value()) {
+      std::cerr << "ERROR: Invalid " << key_str << " " << assignment
+                << std::endl;
+      return false;
+    }
+    try {
+      remapper_->SetRepeat(layer_name, *settings);
+    } catch (const std::invalid_argument& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
   // Handle DELETE + nothing = DELETE.
   if (key_str == kNothingToken) {
     try {
@@ -261,6 +406,347 @@ bool ConfigParser::ParseLayerAssignment(const string& layer_key_str,
   return ParseAssignment(layer_name, key_str, assignment);
 }
 
+bool ConfigParser::ParseProfile(const string& profile_str) {
+  const auto parts = SplitString(profile_str, '=');
+  if (parts.size() > 2) {
+    std::cerr << "ERROR: Not of the form profile NAME = KEYS" << std::endl;
+    return false;
+  }
+  const string profile_name = StringTrim(parts[0]);
+  if (!IsValidProfileName(profile_name)) {
+    std::cerr << "ERROR: Invalid profile name " << profile_name << std::endl;
+    return false;
+  }
+  profile_name_ = profile_name;
+  state_prefix_ = StatePrefix(profile_name);
+  remapper_->AddProfile(profile_name, StateName(kDefaultLayerName));
+
+  if (parts.size() == 2) {
+    std::vector<int> switch_keys;
+    for (const string& token : SplitString(StringTrim(parts[1]), ' ')) {
+      if (token.empty()) continue;
+      const auto [prefix, key] = SplitKeyPrefix(token);
+      if (prefix != 0 || !key.has_value()) {
+        std::cerr << "ERROR: Invalid key to switch profile: " << token
+                  << std::endl;
+        return false;
+      }
+      switch_keys.push_back(key.value());
+    }
+    if (switch_keys.empty()) {
+      std::cerr << "ERROR: No keys to switch profile." << std::endl;
+      return false;
+    }
+    remapper_->SetProfileSwitchKeys(profile_name, switch_keys);
+  }
+  return true;
+}
+
+bool ConfigParser::ParseSocd(const string& socd_str) {
+  const auto parts = SplitString(socd_str, '=');
+  if (parts.size() > 2) {
+    std::cerr << "ERROR: Not of the form socd KEYS = MODE" << std::endl;
+    return false;
+  }
+  SocdMode mode = SocdMode::kLastPriority;
+  if (parts.size() == 2) {
+    const string mode_str = StringTrim(parts[1]);
+    if (mode_str == "neutral") {
+      mode = SocdMode::kNeutral;
+    } else if (mode_str == "first") {
+      mode = SocdMode::kFirstPriority;
+    } else if (mode_str != "last") {
+      std::cerr << "ERROR: Unknown SOCD mode " << mode_str
+                << ", expected last, neutral or first." << std::endl;
+      return false;
+    }
+  }
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(StringTrim(parts[0]), ' ')) {
+    if (token.empty()) continue;
+    const auto [prefix, key] = SplitKeyPrefix(token);
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid SOCD key: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  try {
+    remapper_->AddSocdGroup(profile_name_, key_codes, mode);
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseRepeat(const string& keys_str,
+                               const string& settings_str, bool rapid_fire) {
+  const auto settings = ParseRepeatSettings(settings_str, rapid_fire);
+  if (!settings.has_value()) {
+    std::cerr << (rapid_fire ? "ERROR: Rapid fire must be like 50ms."
+                             : "ERROR: Repeat must be like 250ms 30ms, or off.")
+              << std::endl;
+    return false;
+  }
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(keys_str, ' ')) {
+    if (token.empty()) continue;
+    const auto [prefix, key] = SplitKeyPrefix(token);
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid repeat key: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  try {
+    if (key_codes.empty()) {
+      remapper_->SetRepeat(StateName(kDefaultLayerName), *settings);
+    }
+    for (const int key_code : key_codes) {
+      remapper_->SetKeyRepeat(profile_name_, key_code, *settings);
+    }
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseDebounce(const string& keys_str,
+                                 const string& window_str) {
+  const auto ms = ParseMilliSeconds(window_str);
+  if (!ms.has_value()) {
+    std::cerr << "ERROR: Debounce must be like 8ms." << std::endl;
+    return false;
+  }
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(keys_str, ' ')) {
+    if (token.empty()) continue;
+    const auto [prefix, key] = SplitKeyPrefix(token);
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid debounce key: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  try {
+    if (key_codes.empty()) remapper_->SetDebounce(std::nullopt, *ms);
+    for (const int key_code : key_codes) {
+      remapper_->SetDebounce(key_code, *ms);
+    }
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseAxis(const string& axis_str, const string& keys_str) {
+  std::vector<string> tokens;
+  for (const string& token : SplitString(axis_str, ' ')) {
+    if (!token.empty()) tokens.push_back(token);
+  }
+  if (tokens.size() != 1 && tokens.size() != 3) {
+    std::cerr << "ERROR: Not of the form axis NAME [PRESS% RELEASE%] = KEYS"
+              << std::endl;
+    return false;
+  }
+  AxisMapping mapping;
+  const auto axis = StartsWith(tokens[0], "ABS_")
+                        ? AxisNameToCode(tokens[0])
+                        : AxisNameToCode("ABS_" + tokens[0]);
+  if (!axis.has_value()) {
+    std::cerr << "ERROR: Unknown axis " << tokens[0] << std::endl;
+    return false;
+  }
+  mapping.axis = *axis;
+  if (tokens.size() == 3) {
+    const auto press = ParsePercent(tokens[1]);
+    const auto release = ParsePercent(tokens[2]);
+    if (!press.has_value() || !release.has_value()) {
+      std::cerr << "ERROR: Axis thresholds must be like 50% 30%." << std::endl;
+      return false;
+    }
+    mapping.press_percent = *press;
+    mapping.release_percent = *release;
+  }
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(keys_str, ' ')) {
+    if (token.empty()) continue;
+    if (token == kNothingToken) {
+      key_codes.push_back(-1);
+      continue;
+    }
+    const auto [prefix, key] = SplitKeyPrefix(token);
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid axis key: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  if (key_codes.size() == 1) {
+    mapping.positive_key = key_codes[0];
+    mapping.from_minimum = true;
+  } else if (key_codes.size() == 2) {
+    mapping.negative_key = key_codes[0];
+    mapping.positive_key = key_codes[1];
+  } else {
+    std::cerr << "ERROR: An axis maps to one key, or one per side."
+              << std::endl;
+    return false;
+  }
+  try {
+    remapper_->AddAxisMapping(mapping);
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseSequence(const string& sequence_str) {
+  const auto parts = SplitString(sequence_str, '=');
+  if (parts.size() != 2) {
+    std::cerr << "ERROR: Not of the form sequence KEYS = ACTIONS" << std::endl;
+    return false;
+  }
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(StringTrim(parts[0]), ' ')) {
+    if (token.empty()) continue;
+    const auto [prefix, key] = SplitKeyPrefix(token);
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid key in sequence: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  if (key_codes.empty()) {
+    std::cerr << "ERROR: No keys in sequence." << std::endl;
+    return false;
+  }
+
+  const string assignment = StringTrim(parts[1]);
+  try {
+    if (assignment == kKillToken) {
+      remapper_->AddSequenceKill(profile_name_, key_codes);
+    } else if (StartsWith(assignment, kProfileToken + " ")) {
+      const string switch_to =
+          StringTrim(assignment.substr(kProfileToken.size()));
+      if (!IsValidProfileName(switch_to)) {
+        std::cerr << "ERROR: Invalid profile name " << switch_to << std::endl;
+        return false;
+      }
+      // The profile may only be defined further down.
+      remapper_->AddProfile(switch_to,
+                            StatePrefix(switch_to) + kDefaultLayerName);
+      remapper_->AddSequenceProfileSwitch(profile_name_, key_codes, switch_to);
+    } else {
+      remapper_->AddSequence(profile_name_, key_codes,
+                             AssignmentToActions(assignment));
+    }
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseChord(const string& keys_str,
+                              const string& assignment) {
+  std::vector<int> key_codes;
+  for (const string& token : SplitString(keys_str, kChordSeparator)) {
+    const auto [prefix, key] = SplitKeyPrefix(StringTrim(token));
+    if (prefix != 0 || !key.has_value()) {
+      std::cerr << "ERROR: Invalid chord key: " << token << std::endl;
+      return false;
+    }
+    key_codes.push_back(key.value());
+  }
+  auto tokens = SplitString(assignment, ' ');
+  if (tokens.empty() || tokens.back().empty() || tokens.back()[0] == '^' ||
+      tokens.back()[0] == '~') {
+    std::cerr << "ERROR: The last token of a chord must not have a prefix."
+              << std::endl;
+    return false;
+  }
+  // Same as A = B C, i.e. do everything but only release the final key.
+  const string last_token = tokens.back();
+  tokens.back() = "^" + last_token;
+  try {
+    remapper_->AddChord(profile_name_, key_codes, AssignmentToActions(tokens),
+                        AssignmentToActions({"~" + last_token}));
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseModifierAssignment(const string& key_str,
+                                           const string& assignment) {
+  auto parts = SplitString(key_str, kModifierSeparator);
+  const auto [prefix, key] = SplitKeyPrefix(StringTrim(parts.back()));
+  if (prefix != 0 || !key.has_value()) {
+    std::cerr << "ERROR: Invalid key: " << parts.back() << std::endl;
+    return false;
+  }
+  parts.pop_back();
+  ModifierMask modifiers = 0;
+  for (const string& part : parts) {
+    const auto modifier = ModifierNameToMask(StringTrim(part));
+    if (!modifier.has_value()) {
+      std::cerr << "ERROR: Invalid modifier: " << part << std::endl;
+      return false;
+    }
+    modifiers |= modifier.value();
+  }
+  auto tokens = SplitString(assignment, ' ');
+  if (tokens.empty() || tokens.back().empty() || tokens.back()[0] == '^' ||
+      tokens.back()[0] == '~') {
+    std::cerr << "ERROR: The last token of a modifier mapping must not have a "
+                 "prefix."
+              << std::endl;
+    return false;
+  }
+  // Same as A = B C, i.e. do everything but only release the final key.
+  const string last_token = tokens.back();
+  tokens.back() = "^" + last_token;
+  try {
+    remapper_->AddModifierMapping(profile_name_, key.value(), modifiers,
+                                  AssignmentToActions(tokens),
+                                  AssignmentToActions({"~" + last_token}));
+  } catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ConfigParser::ParseChordWindow(const string& window_str) {
+  const int ms = ParseMilliSeconds(window_str).value_or(0);
+  if (ms <= 0 || ms > kMaxWaitMs) {
+    std::cerr << "ERROR: Chord window must be like 30ms, up to " << kMaxWaitMs
+              << "ms." << std::endl;
+    return false;
+  }
+  remapper_->SetChordWindow(ms);
+  return true;
+}
+
+string ConfigParser::StateName(const string& layer_name) const {
+  return state_prefix_ + layer_name;
+}
+
+string ConfigParser::ChildLayerName(const string& state_name,
+                                    int key_code) const {
+  if (state_name == StateName(kDefaultLayerName)) {
+    return StateName(LayerNameFromKey(key_code));
+  }
+  return state_name.substr(0, state_name.size() - kLayerSuffix.size()) + "_" +
+         LayerNameFromKey(key_code);
+}
+
 [[nodiscard]] bool ConfigParser::ParseLine(const string& original_line) {
   // Ignore comments and empty lines.
   string line = StringTrim(RemoveComment(original_line));
@@ -268,6 +754,21 @@ bool ConfigParser::ParseLayerAssignment(const string& layer_key_str,
     return true;
   }
 
+  // Handle "profile NAME". Lines that follow belong to that profile.
+  if (StartsWith(line, kProfileToken + " ")) {
+    return ParseProfile(StringTrim(line.substr(kProfileToken.size())));
+  }
+
+  // Handle "sequence KEYS = ACTIONS".
+  if (StartsWith(line, kSequenceToken + " ")) {
+    return ParseSequence(StringTrim(line.substr(kSequenceToken.size())));
+  }
+
+  // Handle "socd KEYS [= MODE]".
+  if (StartsWith(line, kSocdToken + " ")) {
+    return ParseSocd(StringTrim(line.substr(kSocdToken.size())));
+  }
+
   // Split the config line into the key combination and the action.
   auto parts = SplitString(line, '=');
   if (parts.size() != 2) {
@@ -278,17 +779,36 @@ bool ConfigParser::ParseLayerAssignment(const string& layer_key_str,
   string key_combo = StringTrim(parts[0]);
   string action = StringTrim(parts[1]);
 
+  if (key_combo == kChordWindowToken) return ParseChordWindow(action);
+  for (const string& token : {kRepeatToken, kRapidFireToken}) {
+    if (key_combo == token || StartsWith(key_combo, token + " ")) {
+      return ParseRepeat(StringTrim(key_combo.substr(token.size())), action,
+                         token == kRapidFireToken);
+    }
+  }
+  if (StartsWith(key_combo, kAxisToken + " ")) {
+    return ParseAxis(StringTrim(key_combo.substr(kAxisToken.size())), action);
+  }
+  if (key_combo == kDebounceToken ||
+      StartsWith(key_combo, kDebounceToken + " ")) {
+    return ParseDebounce(StringTrim(key_combo.substr(kDebounceToken.size())),
+                         action);
+  }
+  if (key_combo.find(kChordSeparator) != string::npos) {
+    return ParseChord(key_combo, action);
+  }
+
   // Split key combination by '+', e.g., "DEL + END"
   auto keys = SplitString(key_combo, '+');
+  for (auto& key : keys) key = StringTrim(key);
+  if (keys.size() == 1 &&
+      keys[0].find(kModifierSeparator) != string::npos) {
+    return ParseModifierAssignment(keys[0], action);
+  }
   if (keys.size() == 1) {
-    return ParseAssignment(kDefaultLayerName, StringTrim(keys[0]), action);
-  } else if (keys.size() == 2) {
-    return ParseLayerAssignment(StringTrim(keys[0]), StringTrim(keys[1]),
-                                action);
-  } else {
-    std::cerr << "ERROR Cannot have more than 1 '+' in line:" << original_line
-              << std::endl;
-    return false;
+    return ParseAssignment(StateName(kDefaultLayerName), keys[0], action);
   }
-  return true;
+  const string key = keys.back();
+  keys.pop_back();
+  return ParseLayerAssignment(keys, key, action);
 }
@@ -19,6 +19,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "keycode_lookup.h"
@@ -41,16 +42,63 @@ class ConfigParser {
 
   std::vector<Action> AssignmentToActions(const std::vector<string>& tokens);
 
+  // Adds a mapping unless one was already assigned for the key event, in
+  // which case the first one is kept.
+  void AddAssignedMapping(const string& layer_name, KeyEvent key_event,
+                          const std::vector<Action>& actions);
+
   bool ParseAssignment(const string& layer_name, const string& key_str,
                        const string& assignment);
 
-  bool ParseLayerAssignment(const string& layer_key_str, const string& key_str,
-                            const string& assignment);
+  // Handles A + B = ..., and A + B + C = ... for layers within layers.
+  bool ParseLayerAssignment(const std::vector<string>& layer_key_strs,
+                            const string& key_str, const string& assignment);
+
+  // Handles "profile NAME [= KEYS]", after which lines apply to that profile.
+  bool ParseProfile(const string& profile_str);
+
+  // Handles "sequence KEYS = ACTIONS", e.g. "sequence RIGHTALT W = W O R D".
+  bool ParseSequence(const string& sequence_str);
+
+  // Handles "KEY1 & KEY2 ... = ACTIONS", e.g. "J & K = ESC".
+  bool ParseChord(const string& keys_str, const string& assignment);
+
+  // Handles "MODIFIERS-KEY = ACTIONS", e.g. "Shift-ESC = GRAVE".
+  bool ParseModifierAssignment(const string& key_str, const string& assignment);
+
+  // Handles the right side of "chord_window = 30ms".
+  bool ParseChordWindow(const string& window_str);
+
+  // Handles "repeat [KEYS] = DELAY INTERVAL", "repeat [KEYS] = off" and
+  // "rapid_fire [KEYS] = INTERVAL".
+  bool ParseRepeat(const string& keys_str, const string& settings_str,
+                   bool rapid_fire);
+
+  // Handles "debounce [KEYS] = WINDOW", e.g. "debounce SPACE = 15ms".
+  bool ParseDebounce(const string& keys_str, const string& window_str);
+
+  // Handles "axis NAME [PRESS% RELEASE%] = KEYS", e.g. "axis X = A D".
+  bool ParseAxis(const string& axis_str, const string& keys_str);
+
+  // Handles "socd KEYS [= MODE]", e.g. "socd A D = neutral".
+  bool ParseSocd(const string& socd_str);
+
+  // Name of the state for a layer within the current profile.
+  string StateName(const string& layer_name) const;
+
+  // Name of the layer which a key activates within a state.
+  string ChildLayerName(const string& state_name, int key_code) const;
 
   [[nodiscard]] bool ParseLine(const string& original_line);
 
   Remapper* remapper_;
+  // Profile being parsed.
+  string profile_name_ = kDefaultProfileName;
+  // Prefixed to state names of the profile being parsed.
+  string state_prefix_;
   // To keep track of which layers have been seen. Used to do one time actions,
   // such as disallow other keys.
   std::set<string> known_layers_;
+  // State name, key code and value of mappings added by assignments.
+  std::set<std::tuple<string, int, int>> assigned_;
 };
@@ -16,7 +16,10 @@
 
 #include "config_parser.h"
 
+#include <algorithm>
 #include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <set>
 
 #include "remap_operator.h"
 #include "test_utils.h"
@@ -250,6 +253,127 @@ State #1
     }
   }
 
+  GIVEN("Layers within layers") {
+    REQUIRE(config_parser.Parse({"RIGHTCTRL + 1 = F1",
+                                 "RIGHTCTRL + LEFTSHIFT + 1 = F2",
+                                 "RIGHTCTRL + LEFTSHIFT + LEFTALT + 1 = F3"}));
+    REQUIRE(!config_parser.Parse({"RIGHTCTRL + LEFTSHIFT = X"}));
+    THEN("Each combination of held keys is its own layer") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTCTRL, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_LEFTSHIFT, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_LEFTALT, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0}}) ==
+            vector<string>{"Out: P KEY_F1", "Out: R KEY_F1", "Out: P KEY_F2",
+                           "Out: R KEY_F2", "Out: P KEY_F3", "Out: R KEY_F3"});
+      CHECK(remapper.DeactivateState("KEY_RIGHTCTRL_KEY_LEFTSHIFT_layer"));
+    }
+    THEN("Releasing a key of the combination releases the layers from it") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTCTRL, 1},
+                         {KEY_LEFTSHIFT, 1},
+                         {KEY_LEFTALT, 1},
+                         {KEY_1, 1},
+                         {KEY_LEFTSHIFT, 0},
+                         {KEY_1, 2},
+                         {KEY_LEFTALT, 2},
+                         {KEY_LEFTALT, 0},
+                         {KEY_1, 0},
+                         {KEY_1, 1},
+                         {KEY_1, 0}}) ==
+            vector<string>{"Out: P KEY_F3", "Out: R KEY_F3", "Out: P KEY_F1",
+                           "Out: R KEY_F1"});
+    }
+    THEN("Out of order, the first key releases all") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTCTRL, 1},
+                         {KEY_LEFTSHIFT, 1},
+                         {KEY_1, 1},
+                         {KEY_RIGHTCTRL, 0},
+                         {KEY_1, 0},
+                         {KEY_LEFTSHIFT, 0},
+                         {KEY_1, 1},
+                         {KEY_1, 0}}) ==
+            vector<string>{"Out: P KEY_F2", "Out: R KEY_F2", "Out: P KEY_1",
+                           "Out: R KEY_1"});
+    }
+  }
+
+  GIVEN("Modifier mappings") {
+    REQUIRE(config_parser.Parse({"Shift-ESC = GRAVE",
+                                 "RCtrl-Shift-ESC = LEFTCTRL F1",
+                                 "LAlt-1 = F2", "ESC = TAB"}));
+    REQUIRE(!config_parser.Parse({"Hyper-ESC = X"}));
+    REQUIRE(!config_parser.Parse({"Shift-ESC = X"}));
+    THEN("Either shift maps, and the modifier stays a plain key") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_ESC, 1},
+                         {KEY_ESC, 0},
+                         {KEY_RIGHTSHIFT, 1},
+                         {KEY_ESC, 1},
+                         {KEY_ESC, 0},
+                         {KEY_RIGHTSHIFT, 0},
+                         {KEY_LEFTSHIFT, 1},
+                         {KEY_ESC, 1},
+                         {KEY_ESC, 0},
+                         {KEY_LEFTSHIFT, 0}}) ==
+            vector<string>{"Out: P KEY_TAB", "Out: R KEY_TAB",
+                           "Out: P KEY_RIGHTSHIFT", "Out: P KEY_GRAVE",
+                           "Out: R KEY_GRAVE", "Out: R KEY_RIGHTSHIFT",
+                           "Out: P KEY_LEFTSHIFT", "Out: P KEY_GRAVE",
+                           "Out: R KEY_GRAVE", "Out: R KEY_LEFTSHIFT"});
+    }
+    THEN("A side only matches that side, and the most modifiers win") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTALT, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_RIGHTALT, 0},
+                         {KEY_LEFTALT, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_LEFTALT, 0},
+                         {KEY_LEFTCTRL, 1},
+                         {KEY_LEFTSHIFT, 1},
+                         {KEY_ESC, 1},
+                         {KEY_ESC, 0},
+                         {KEY_LEFTCTRL, 0},
+                         {KEY_RIGHTCTRL, 1},
+                         {KEY_ESC, 1},
+                         {KEY_ESC, 0}}) ==
+            vector<string>{
+                "Out: P KEY_RIGHTALT", "Out: P KEY_1",
+                "Out: R KEY_1",        "Out: R KEY_RIGHTALT",
+                "Out: P KEY_LEFTALT",  "Out: P KEY_F2",
+                "Out: R KEY_F2",       "Out: R KEY_LEFTALT",
+                "Out: P KEY_LEFTCTRL", "Out: P KEY_LEFTSHIFT",
+                "Out: P KEY_GRAVE",    "Out: R KEY_GRAVE",
+                "Out: R KEY_LEFTCTRL", "Out: P KEY_RIGHTCTRL",
+                "Out: P KEY_LEFTCTRL", "Out: R KEY_LEFTCTRL",
+                "Out: P KEY_F1",       "Out: R KEY_F1"});
+    }
+    THEN("Release and repeat follow the press, not the modifiers") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_LEFTSHIFT, 1},
+                         {KEY_ESC, 1},
+                         {KEY_LEFTSHIFT, 0},
+                         {KEY_ESC, 2},
+                         {KEY_ESC, 0},
+                         {KEY_ESC, 1},
+                         {KEY_ESC, 2},
+                         {KEY_ESC, 0}}) ==
+            vector<string>{"Out: P KEY_LEFTSHIFT", "Out: P KEY_GRAVE",
+                           "Out: R KEY_LEFTSHIFT", "Out: T KEY_GRAVE",
+                           "Out: R KEY_GRAVE", "Out: P KEY_TAB",
+                           "Out: T KEY_TAB", "Out: R KEY_TAB"});
+    }
+  }
+
   GIVEN("'nothing' on right") {
     REQUIRE(config_parser.Parse({"A = nothing"}));
     THEN("'nothing' should be blocked") {
@@ -330,6 +454,429 @@ State #1
     Key: (KEY_C Press)
 )");
   }
+
+  GIVEN("Profiles") {
+    REQUIRE(config_parser.Parse({"CAPSLOCK + 1 = F1", "profile game",
+                                 "CAPSLOCK + 1 = F2", "A = B"}));
+    REQUIRE(!config_parser.Parse({"profile bad/name"}));
+    THEN("Each profile has its own layers") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_CAPSLOCK, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_CAPSLOCK, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_F1", "Out: R KEY_F1", "Out: P KEY_A",
+                           "Out: R KEY_A"});
+      REQUIRE(remapper.SelectProfile("game"));
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_CAPSLOCK, 1},
+                         {KEY_1, 1},
+                         {KEY_1, 0},
+                         {KEY_CAPSLOCK, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_F2", "Out: R KEY_F2", "Out: P KEY_B",
+                           "Out: R KEY_B"});
+      CHECK(remapper.ActivateState("game/KEY_CAPSLOCK_layer"));
+    }
+  }
+
+  GIVEN("Profiles switched with keys") {
+    REQUIRE(config_parser.Parse({"profile default = RIGHTCTRL D",
+                                 "profile game = RIGHTCTRL G", "A = B"}));
+    REQUIRE(!config_parser.Parse({"profile x = ^A"}));
+    THEN("Switching releases keys held and swallows the last key") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1},
+                         {KEY_RIGHTCTRL, 1},
+                         {KEY_RIGHTCTRL, 0},
+                         {KEY_G, 1},
+                         {KEY_G, 0},
+                         {KEY_A, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_A", "Out: P KEY_RIGHTCTRL",
+                           "Out: R KEY_RIGHTCTRL", "Out: R KEY_A",
+                           "Out: P KEY_B", "Out: R KEY_B"});
+      CHECK(remapper.ActiveProfileName() == "game");
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTCTRL, 1},
+                         {KEY_RIGHTCTRL, 0},
+                         {KEY_D, 1},
+                         {KEY_D, 0},
+                         {KEY_A, 1}}) ==
+            vector<string>{"Out: P KEY_RIGHTCTRL", "Out: R KEY_RIGHTCTRL",
+                           "Out: P KEY_A"});
+      CHECK(remapper.ActiveProfileName() == "default");
+    }
+  }
+
+  GIVEN("Codes above 255") {
+    REQUIRE(config_parser.Parse({"RIGHTALT = BTN_LEFT", "F1 = MACRO1",
+                                 "F2 = KEY_BRIGHTNESS_MAX"}));
+    THEN("They are emitted") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_RIGHTALT, 1}, {KEY_F1, 1}}) ==
+            vector<string>{"Out: P BTN_LEFT", "Out: P KEY_MACRO1"});
+      CHECK(remapper.EmittedKeyCodes() ==
+            std::vector<int>{BTN_LEFT, KEY_BRIGHTNESS_MAX, KEY_MACRO1});
+    }
+  }
+
+  GIVEN("Plain remaps") {
+    REQUIRE(config_parser.Parse({"A = B", "B = A", "C = D", "F = G H",
+                                 "I = *", "CAPSLOCK + D = E"}));
+    THEN("Only those of keys not used elsewhere are pure") {
+      CHECK(remapper.PureRemaps() ==
+            std::vector<std::pair<int, int>>{{KEY_A, KEY_B}, {KEY_B, KEY_A}});
+    }
+    THEN("Removed mappings pass keys through") {
+      remapper.RemoveBaseMappings(KEY_A);
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_C, 1}}) ==
+            vector<string>{"Out: P KEY_A", "Out: P KEY_D"});
+    }
+  }
+
+  GIVEN("Duplicate assignments") {
+    REQUIRE(config_parser.Parse({"^RIGHTCTRL = ^RIGHTCTRL",
+                                 "RIGHTCTRL + 1 = ~RIGHTCTRL F1",
+                                 "RIGHTCTRL + 1 = ~RIGHTCTRL F1", "A = B",
+                                 "^A = C"}));
+    THEN("The first one is kept") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTCTRL, 1}, {KEY_1, 1}, {KEY_1, 0}}) ==
+            vector<string>{"Out: P KEY_RIGHTCTRL", "Out: R KEY_RIGHTCTRL",
+                           "Out: P KEY_F1", "Out: R KEY_F1"});
+    }
+    THEN("The first one is kept for either of press and release") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_B", "Out: R KEY_B"});
+    }
+  }
+
+  GIVEN("Plain remaps with profiles") {
+    REQUIRE(config_parser.Parse({"A = B", "profile game", "A = C"}));
+    THEN("None are pure") { CHECK(remapper.PureRemaps().empty()); }
+  }
+
+  GIVEN("Sequences") {
+    REQUIRE(config_parser.Parse({"A = B", "sequence RIGHTALT A = X Y",
+                                 "sequence RIGHTALT G = profile game",
+                                 "sequence RIGHTALT K = kill", "profile game",
+                                 "sequence RIGHTALT D = profile default"}));
+    REQUIRE(!config_parser.Parse({"sequence = X"}));
+    REQUIRE(!config_parser.Parse({"sequence A ^B = X"}));
+    THEN("The last key is not passed on") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTALT, 1},
+                         {KEY_RIGHTALT, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_RIGHTALT", "Out: R KEY_RIGHTALT",
+                           "Out: P KEY_X", "Out: R KEY_X", "Out: P KEY_Y",
+                           "Out: R KEY_Y", "Out: P KEY_B", "Out: R KEY_B"});
+    }
+    THEN("Sequences belong to their profile") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTALT, 1},
+                         {KEY_RIGHTALT, 0},
+                         {KEY_G, 1},
+                         {KEY_G, 0},
+                         {KEY_RIGHTALT, 1},
+                         {KEY_RIGHTALT, 0},
+                         {KEY_A, 1},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_RIGHTALT", "Out: R KEY_RIGHTALT",
+                           "Out: P KEY_RIGHTALT", "Out: R KEY_RIGHTALT",
+                           "Out: P KEY_A", "Out: R KEY_A"});
+      CHECK(remapper.ActiveProfileName() == "game");
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_RIGHTALT, 1}, {KEY_RIGHTALT, 0}, {KEY_D, 1}})
+                .size() == 2);
+      CHECK(remapper.ActiveProfileName() == "default");
+    }
+    THEN("Kill stops") {
+      CHECK_THROWS_AS(GetOutcomes(remapper, false,
+                                  {{KEY_RIGHTALT, 1},
+                                   {KEY_RIGHTALT, 0},
+                                   {KEY_K, 1}}),
+                      std::runtime_error);
+    }
+  }
+
+  GIVEN("Software repeat") {
+    using std::chrono::milliseconds;
+    const auto start = Remapper::Clock::time_point();
+    auto now = start;
+    remapper.SetClock([&now]() { return now; });
+    REQUIRE(config_parser.Parse({"repeat = 200ms 50ms", "repeat ESC = off",
+                                 "rapid_fire SPACE = 20ms",
+                                 "CAPSLOCK + repeat = 100ms 10ms",
+                                 "CAPSLOCK + 1 = F1", "A = B"}));
+    REQUIRE(!config_parser.Parse({"repeat = 200ms"}));
+    REQUIRE(!config_parser.Parse({"rapid_fire SPACE = 1ms"}));
+    REQUIRE(!config_parser.Parse({"repeat Q = 0ms 0ms"}));
+    vector<string> ticked;
+    // Ticks at each deadline up to `until`, as the timer would.
+    const auto tick_until = [&](milliseconds until) {
+      remapper.SetCallback([&](int key_code, int value) {
+        ticked.push_back(
+            std::to_string((now - start) / milliseconds(1)) +
+            (value == 1 ? " P " : value == 0 ? " R " : " T ") +
+            KeyCodeToName(key_code));
+      });
+      while (remapper.NextDeadline() &&
+             *remapper.NextDeadline() <= start + until) {
+        now = *remapper.NextDeadline();
+        remapper.Tick();
+      }
+      now = start + until;
+    };
+    THEN("Held keys repeat on the schedule instead of the kernel's") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_A, 2}}) ==
+            vector<string>{"Out: P KEY_B"});
+      tick_until(milliseconds(310));
+      CHECK(ticked ==
+            vector<string>{"200 T KEY_B", "250 T KEY_B", "300 T KEY_B"});
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 0}}) ==
+            vector<string>{"Out: R KEY_B"});
+      CHECK(!remapper.NextDeadline());
+    }
+    THEN("A late wakeup skips what it missed") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}}).size() == 1);
+      now = start + milliseconds(420);
+      remapper.SetCallback([&ticked](int key_code, int) {
+        ticked.push_back(KeyCodeToName(key_code));
+      });
+      remapper.Tick();
+      CHECK(ticked == vector<string>{"KEY_B"});
+      CHECK(remapper.NextDeadline() == start + milliseconds(450));
+    }
+    THEN("Only the key pressed last repeats, and off does not") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_ESC, 1}}).size() ==
+            2);
+      CHECK(!remapper.NextDeadline());
+      CHECK(GetOutcomes(remapper, false, {{KEY_ESC, 2}}).empty());
+    }
+    THEN("Rapid fire taps while held") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_SPACE, 1}}).size() == 1);
+      tick_until(milliseconds(45));
+      CHECK(ticked == vector<string>{"10 R KEY_SPACE", "20 P KEY_SPACE",
+                                     "30 R KEY_SPACE", "40 P KEY_SPACE"});
+      CHECK(GetOutcomes(remapper, false, {{KEY_SPACE, 0}}) ==
+            vector<string>{"Out: R KEY_SPACE"});
+      CHECK(GetOutcomes(remapper, false, {{KEY_SPACE, 1}}).size() == 1);
+      tick_until(milliseconds(55));
+      CHECK(GetOutcomes(remapper, false, {{KEY_SPACE, 0}}).empty());
+    }
+    THEN("Layers have their own repeat") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_CAPSLOCK, 1}, {KEY_1, 1}}) ==
+            vector<string>{"Out: P KEY_F1"});
+      tick_until(milliseconds(125));
+      CHECK(ticked ==
+            vector<string>{"100 T KEY_F1", "110 T KEY_F1", "120 T KEY_F1"});
+    }
+  }
+
+  GIVEN("Axes") {
+    REQUIRE(config_parser.Parse({"axis X = A D", "axis ABS_Z = SPACE",
+                                 "axis HAT0Y 60% 40% = nothing S",
+                                 "BTN_SOUTH = ENTER"}));
+    REQUIRE(!config_parser.Parse({"axis X = Q E"}));
+    REQUIRE(!config_parser.Parse({"axis Y 30% 50% = W S"}));
+    REQUIRE(!config_parser.Parse({"axis Y = W S X"}));
+    REQUIRE(!config_parser.Parse({"axis NOPE = W S"}));
+    const auto& mappings = remapper.axis_mappings();
+    REQUIRE(mappings.size() == 3);
+    CHECK(mappings[0].negative_key == KEY_A);
+    CHECK(mappings[0].positive_key == KEY_D);
+    CHECK(mappings[1].from_minimum);
+    CHECK(mappings[2].negative_key == -1);
+    CHECK(mappings[2].press_percent == 60);
+    CHECK(GetRemapperConfigDump(remapper).find(
+              "Axis: ABS_HAT0Y 60% 40%: nothing KEY_S\n") != string::npos);
+    // Keys of axes can be sent, though the device does not have them.
+    const auto emitted = remapper.EmittedKeyCodes();
+    CHECK(std::binary_search(emitted.begin(), emitted.end(), KEY_SPACE));
+    CHECK(GetOutcomes(remapper, false, {{BTN_SOUTH, 1}, {BTN_SOUTH, 0}}) ==
+          vector<string>{"Out: P KEY_ENTER", "Out: R KEY_ENTER"});
+  }
+
+  GIVEN("Mouse buttons and wheels") {
+    REQUIRE(config_parser.Parse({"BTN_SIDE + WHEELUP = VOLUMEUP",
+                                 "BTN_SIDE + WHEELDOWN = VOLUMEDOWN",
+                                 "BTN_EXTRA = LEFTCTRL C", "F13 = WHEELDOWN"}));
+    THEN("A side button holds a layer for the wheel") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{BTN_SIDE, 1},
+                         {kKeyWheelUp, 1},
+                         {kKeyWheelUp, 0},
+                         {BTN_SIDE, 0},
+                         {kKeyWheelUp, 1},
+                         {kKeyWheelUp, 0}}) ==
+            vector<string>{"Out: P KEY_VOLUMEUP", "Out: R KEY_VOLUMEUP",
+                           "Out: P KEY_WHEELUP", "Out: R KEY_WHEELUP"});
+    }
+    THEN("Wheel keys are reacted to, and sent, but not by the kernel") {
+      const auto input = remapper.InputKeyCodes();
+      CHECK(std::binary_search(input.begin(), input.end(), kKeyWheelUp));
+      CHECK(std::binary_search(input.begin(), input.end(), BTN_EXTRA));
+      const auto emitted = remapper.EmittedKeyCodes();
+      CHECK(std::binary_search(emitted.begin(), emitted.end(), kKeyWheelDown));
+      CHECK(remapper.PureRemaps().empty());
+    }
+  }
+
+  GIVEN("Keys mapped to the same key") {
+    REQUIRE(config_parser.Parse({"A = X", "B = X"}));
+    THEN("Output which changes nothing is dropped") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1}, {KEY_B, 1}, {KEY_B, 2}, {KEY_A, 0},
+                         {KEY_B, 2}, {KEY_B, 0}},
+                        false) ==
+            vector<string>{"Out: P KEY_X", "Out: T KEY_X", "Out: R KEY_X"});
+      CHECK(remapper.counters().redundant_dropped == 1);
+    }
+    THEN("In strict mode, it throws") {
+      CHECK_THROWS_AS(
+          GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_B, 1}}),
+          std::logic_error);
+    }
+  }
+
+  GIVEN("Debounce") {
+    auto now = Remapper::Clock::time_point();
+    remapper.SetClock([&now]() { return now; });
+    REQUIRE(config_parser.Parse({"debounce = 5ms", "debounce SPACE = 20ms",
+                                 "A = B"}));
+    REQUIRE(!config_parser.Parse({"debounce = 5"}));
+    REQUIRE(!config_parser.Parse({"debounce A = 500ms"}));
+    THEN("Chatter is dropped ahead of the mappings") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1}, {KEY_A, 0}, {KEY_A, 1}}) ==
+            vector<string>{"Out: P KEY_B"});
+      CHECK(remapper.debouncer().chatter(KEY_A) == 1);
+      now += std::chrono::milliseconds(10);
+      CHECK(GetOutcomes(remapper, false, {{KEY_A, 0}}) ==
+            vector<string>{"Out: R KEY_B"});
+    }
+    THEN("A short tap is released when the window ends") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_SPACE, 1}, {KEY_SPACE, 0}}) ==
+            vector<string>{"Out: P KEY_SPACE"});
+      REQUIRE(remapper.NextDeadline() == now + std::chrono::milliseconds(20));
+      now = *remapper.NextDeadline();
+      vector<string> ticked;
+      remapper.SetCallback([&ticked](int key_code, int value) {
+        ticked.push_back(std::to_string(value) + " " + KeyCodeToName(key_code));
+      });
+      remapper.Tick();
+      CHECK(ticked == vector<string>{"0 KEY_SPACE"});
+      CHECK(remapper.GetState().input_keys_down.empty());
+    }
+  }
+
+  GIVEN("Chords") {
+    auto now = Remapper::Clock::time_point();
+    remapper.SetClock([&now]() { return now; });
+    REQUIRE(config_parser.Parse({"chord_window = 30ms", "J & K = ESC",
+                                 "J & K & L = TAB", "K = UP"}));
+    REQUIRE(!config_parser.Parse({"J & K = F1"}));
+    REQUIRE(!config_parser.Parse({"J & J = F1"}));
+    REQUIRE(!config_parser.Parse({"chord_window = 0ms"}));
+    THEN("Keys pressed together act as the chord") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_J, 1}, {KEY_K, 1}, {KEY_L, 1}, {KEY_K, 0}}) ==
+            vector<string>{"Out: P KEY_TAB", "Out: R KEY_TAB"});
+      CHECK(GetOutcomes(remapper, false, {{KEY_L, 0}, {KEY_J, 0}}).empty());
+    }
+    THEN("A chord within a larger one waits for the window") {
+      CHECK(GetOutcomes(remapper, false, {{KEY_K, 1}, {KEY_J, 1}}).empty());
+      CHECK(remapper.NextDeadline() == now + std::chrono::milliseconds(30));
+      // Resolved by the next event if the timer fires late.
+      now += std::chrono::milliseconds(30);
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_J, 0}, {KEY_J, 1}, {KEY_K, 0}, {KEY_J, 0}}) ==
+            vector<string>{"Out: P KEY_ESC", "Out: R KEY_ESC", "Out: P KEY_J",
+                           "Out: R KEY_J"});
+    }
+    THEN("Other keys pass on what was held back at once") {
+      now += std::chrono::milliseconds(5);
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_K, 1}, {KEY_A, 1}, {KEY_K, 0}, {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_UP", "Out: P KEY_A", "Out: R KEY_UP",
+                           "Out: R KEY_A"});
+      CHECK(GetOutcomes(remapper, false, {{KEY_L, 1}, {KEY_J, 1}}).empty());
+      now += std::chrono::milliseconds(40);
+      vector<int> ticked;
+      remapper.SetCallback(
+          [&ticked](int key_code, int) { ticked.push_back(key_code); });
+      remapper.Tick();
+      CHECK(ticked == vector<int>{KEY_L, KEY_J});
+      CHECK(!remapper.NextDeadline());
+      const auto stats = remapper.chord_stats();
+      REQUIRE(stats.size() == 2);
+      CHECK(stats[0].key_codes == vector<int>{KEY_J, KEY_K});
+      CHECK(stats[0].fired == 0);
+      CHECK(stats[0].typed_through == 1);
+      CHECK(stats[1].typed_through == 2);
+      CHECK(stats[1].max_delay_us == 40000);
+    }
+  }
+
+  GIVEN("SOCD last") {
+    REQUIRE(config_parser.Parse({"socd A D", "D = RIGHT"}));
+    REQUIRE(!config_parser.Parse({"socd A S"}));
+    REQUIRE(!config_parser.Parse({"socd W = sideways"}));
+    THEN("The last pressed wins and the other one comes back") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1},
+                         {KEY_D, 1},
+                         {KEY_A, 2},
+                         {KEY_D, 2},
+                         {KEY_D, 0},
+                         {KEY_A, 0}}) ==
+            vector<string>{"Out: P KEY_A", "Out: R KEY_A", "Out: P KEY_RIGHT",
+                           "Out: T KEY_RIGHT", "Out: R KEY_RIGHT",
+                           "Out: P KEY_A", "Out: R KEY_A"});
+      CHECK(remapper.PureRemaps().empty());
+    }
+  }
+
+  GIVEN("SOCD neutral") {
+    REQUIRE(config_parser.Parse({"socd A D = neutral"}));
+    THEN("Neither is held while both are") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1}, {KEY_D, 1}, {KEY_A, 0}, {KEY_D, 0}}) ==
+            vector<string>{"Out: P KEY_A", "Out: R KEY_A", "Out: P KEY_D",
+                           "Out: R KEY_D"});
+    }
+  }
+
+  GIVEN("SOCD first") {
+    REQUIRE(config_parser.Parse({"socd W S = first"}));
+    THEN("The first pressed wins until released") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_W, 1}, {KEY_S, 1}, {KEY_W, 0}, {KEY_S, 0}}) ==
+            vector<string>{"Out: P KEY_W", "Out: R KEY_W", "Out: P KEY_S",
+                           "Out: R KEY_S"});
+    }
+  }
+
+  GIVEN("SOCD in a profile") {
+    REQUIRE(config_parser.Parse({"profile game", "socd A D"}));
+    THEN("Only that profile resolves the keys") {
+      CHECK(GetOutcomes(remapper, false,
+                        {{KEY_A, 1}, {KEY_D, 1}, {KEY_A, 0}, {KEY_D, 0}}) ==
+            vector<string>{"Out: P KEY_A", "Out: P KEY_D", "Out: R KEY_A",
+                           "Out: R KEY_D"});
+      REQUIRE(remapper.SelectProfile("game"));
+      CHECK(GetOutcomes(remapper, false, {{KEY_D, 1}, {KEY_A, 1}}) ==
+            vector<string>{"Out: P KEY_D", "Out: R KEY_D", "Out: P KEY_A"});
+    }
+  }
 }
 
 SCENARIO("Helper functions") {
@@ -352,4 +899,59 @@ SCENARIO("Helper functions") {
         {"# This whole line is a comment.", "A = B # Make A act as B."}));
     CHECK(GetRemapperConfigDump(remapper) == expected_dump);
   }
-}
\ No newline at end of file
+}
+SCENARIO("Optimized and compiled configs work as parsed") {
+  Remapper walked;
+  Remapper compiled;
+  auto config_lines = SplitLines(kConfigLines);
+  // Same as not mapped.
+  config_lines.push_back("RIGHTCTRL + END = *");
+  config_lines.push_back("X = *");
+  REQUIRE(ConfigParser(&walked).Parse(config_lines));
+  REQUIRE(ConfigParser(&compiled).Parse(config_lines));
+  const std::size_t parsed_bytes = compiled.MemoryUsage();
+  const auto optimized = compiled.Optimize();
+  CHECK(optimized.passthroughs_dropped == 2);
+  CHECK(optimized.action_lists_merged > 0);
+  CHECK(compiled.MemoryUsage() < parsed_bytes);
+  REQUIRE(compiled.CompileLayerStacks());
+  // E.g. CAPSLOCK on top of RIGHTCTRL.
+  const auto stats = compiled.layer_stack_stats();
+  REQUIRE(stats.has_value());
+  CHECK(stats->stacks > 5);
+  CHECK(stats->tables <= stats->stacks);
+  CHECK_FALSE(walked.layer_stack_stats().has_value());
+
+  // Random typing, where keys are only released or repeated while held.
+  const std::vector<int> keys = {KEY_1,        KEY_2,         KEY_A,
+                                 KEY_D,        KEY_ESC,       KEY_END,
+                                 KEY_CAPSLOCK, KEY_RIGHTCTRL, KEY_LEFTSHIFT,
+                                 KEY_DELETE,   KEY_X};
+  std::mt19937 random(42);
+  std::set<int> held;
+  std::vector<std::pair<int, int>> events;
+  for (int i = 0; i < 5000; ++i) {
+    const int key_code = keys[random() % keys.size()];
+    if (!held.contains(key_code)) {
+      held.insert(key_code);
+      events.push_back({key_code, 1});
+    } else if (random() % 2 == 0) {
+      events.push_back({key_code, 2});
+    } else {
+      held.erase(key_code);
+      events.push_back({key_code, 0});
+    }
+  }
+  THEN("The output is the same") {
+    // Keys mapped to the same key press it while held.
+    CHECK(GetOutcomes(compiled, false, events, false) ==
+          GetOutcomes(walked, false, events, false));
+    CHECK(compiled.counters().redundant_dropped > 0);
+    CHECK(compiled.counters().redundant_dropped ==
+          walked.counters().redundant_dropped);
+  }
+  THEN("Changing mappings undoes compilation") {
+    compiled.AddMapping("", KeyPressEvent(KEY_X), {KeyPressEvent(KEY_Y)});
+    CHECK_FALSE(compiled.layer_stack_stats().has_value());
+  }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "control_server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// More clients than this are turned away.
+const std::size_t kMaxClients = 8;
+
+// Longer commands than this are rejected.
+const std::size_t kMaxCommandLength = 1024;
+
+ControlServer::ControlServer(const std::string& socket_path,
+                             CommandHandler handler)
+    : socket_path_(socket_path), handler_(handler) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Control socket path is too long");
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    throw std::runtime_error("Could not create control socket: " +
+                             std::string(strerror(errno)));
+  }
+  // Remove a stale socket left by an instance that did not exit cleanly.
+  unlink(socket_path.c_str());
+  // Only the owner, usually root, may control the remapping.
+  const mode_t old_umask = umask(0077);
+  const int bind_ret =
+      bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  umask(old_umask);
+  if (bind_ret < 0 || listen(listen_fd_, kMaxClients) < 0) {
+    close(listen_fd_);
+    throw std::runtime_error("Could not listen on " + socket_path + ": " +
+                             std::string(strerror(errno)));
+  }
+}
+
+ControlServer::~ControlServer() {
+  for (const auto& client : clients_) close(client.fd);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+}
+
+void ControlServer::AddPollFds(std::vector<struct pollfd>& fds) const {
+  fds.push_back({listen_fd_, POLLIN, 0});
+  for (const auto& client : clients_) {
+    fds.push_back({client.fd, POLLIN, 0});
+  }
+}
+
+void ControlServer::HandlePollFds(std::span<const struct pollfd> fds) {
+  for (const auto& pfd : fds) {
+    if (pfd.revents == 0) continue;
+    if (pfd.fd == listen_fd_) {
+      Accept();
+      continue;
+    }
+    for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+      if (it->fd != pfd.fd) continue;
+      if (!Serve(*it)) {
+        close(it->fd);
+        clients_.erase(it);
+      }
+      break;
+    }
+  }
+}
+
+// PRIVATE
+
+void ControlServer::Accept() {
+  const int fd = accept4(listen_fd_, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) return;
+  if (clients_.size() >= kMaxClients) {
+    std::cerr << "WARNING: Too many control clients." << std::endl;
+    close(fd);
+    return;
+  }
+  clients_.push_back({fd, ""});
+}
+
+bool ControlServer::Serve(Client& client) {
+  char buffer[512];
+  const ssize_t len = read(client.fd, buffer, sizeof(buffer));
+  if (len < 0) return errno == EAGAIN || errno == EINTR;
+  // Disconnected.
+  if (len == 0) return false;
+
+  client.buffer.append(buffer, len);
+  std::size_t newline_pos;
+  while ((newline_pos = client.buffer.find('\n')) != std::string::npos) {
+    std::string command = client.buffer.substr(0, newline_pos);
+    client.buffer.erase(0, newline_pos + 1);
+    if (!command.empty() && command.back() == '\r') command.pop_back();
+    if (command.empty()) continue;
+
+    const std::string reply = handler_(command) + "\n";
+    // Replies are small. If the client does not read them, it is dropped.
+    // MSG_NOSIGNAL, as a client gone before the reply, i.e. EPIPE, is only a
+    // disconnect, and SIGPIPE would kill the daemon with the device grabbed.
+    if (send(client.fd, reply.data(), reply.size(), MSG_NOSIGNAL) !=
+        ssize_t(reply.size())) {
+      return false;
+    }
+  }
+  return client.buffer.size() <= kMaxCommandLength;
+}
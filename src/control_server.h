@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A unix socket to control a running instance, served from the main loop.
+//
+// The protocol is line based. Each line received is a command, and the reply
+// is zero or more lines of data followed by a line which is either "OK" or
+// "ERROR <reason>". E.g. -
+//   $ echo "profile game" | socat - UNIX-CONNECT:/run/keyshift.sock
+//   OK
+//
+// All sockets are non-blocking, so that a misbehaving client cannot stall
+// processing of key events.
+#ifndef __CONTROL_SERVER_H
+#define __CONTROL_SERVER_H
+
+#include <poll.h>
+
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+class ControlServer {
+ public:
+  // Returns the reply to a command, without the final newline.
+  using CommandHandler = std::function<std::string(const std::string&)>;
+
+  ControlServer(const std::string& socket_path, CommandHandler handler);
+
+  ~ControlServer();
+
+  ControlServer(const ControlServer&) = delete;
+  ControlServer& operator=(const ControlServer&) = delete;
+
+  // Appends the fds to be polled for.
+  void AddPollFds(std::vector<struct pollfd>& fds) const;
+
+  // Accepts connections and serves commands, given the fds which were added
+  // with AddPollFds() after they are polled.
+  void HandlePollFds(std::span<const struct pollfd> fds);
+
+ private:
+  struct Client {
+    int fd;
+    // Incomplete line received so far.
+    std::string buffer;
+  };
+
+  void Accept();
+
+  // Returns false if the client should be disconnected.
+  bool Serve(Client& client);
+
+  std::string socket_path_;
+  CommandHandler handler_;
+  int listen_fd_ = -1;
+  std::vector<Client> clients_;
+};
+
+#endif  // __CONTROL_SERVER_H
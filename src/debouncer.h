@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __DEBOUNCER_H
+#define __DEBOUNCER_H
+
+#include <linux/input-event-codes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Filters chatter of worn switches, i.e. a key flickering between pressed and
+// released around a single press or release. Eager: the first edge passes at
+// once, so debouncing adds no latency, and edges within the window after it
+// are suppressed. If the key ends up in the other state by the end of the
+// window, e.g. for a tap shorter than the window, that edge is passed on then
+// by Tick().
+//
+// Keys are in a flat array indexed by key code, allocated once any key has a
+// window.
+class Debouncer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Result { kPassed, kChatter, kDropped };
+
+  bool enabled() const { return !keys_.empty(); }
+
+  // Window of keys not set with SetWindow(). Zero does not debounce them.
+  void SetDefaultWindow(Clock::duration window) {
+    Allocate();
+    default_window_ = window;
+    for (auto& key : keys_) {
+      if (!key.window_set) key.window = window;
+    }
+  }
+
+  // Window of one key, whatever the default. Zero does not debounce it.
+  void SetWindow(int key_code, Clock::duration window) {
+    if (key_code < 0 || key_code >= KEY_CNT) return;
+    Allocate();
+    keys_[key_code].window = window;
+    keys_[key_code].window_set = true;
+  }
+
+  Clock::duration default_window() const { return default_window_; }
+
+  Clock::duration window(int key_code) const {
+    return enabled() && key_code >= 0 && key_code < KEY_CNT
+               ? keys_[key_code].window
+               : Clock::duration::zero();
+  }
+
+  // To be called on every key event, in order. Repeats pass only while the
+  // key is pressed as far as passed on.
+  Result Filter(int key_code, int value, Clock::time_point now) {
+    if (!enabled() || key_code < 0 || key_code >= KEY_CNT) {
+      return Result::kPassed;
+    }
+    Key& key = keys_[key_code];
+    if (key.window == Clock::duration::zero()) return Result::kPassed;
+    if (value == 2) return key.down ? Result::kPassed : Result::kDropped;
+    const bool down = value == 1;
+    const bool in_window = now < key.last_edge + key.window;
+    key.raw_down = down;
+    if (down == key.down) {
+      // Back to the state passed on, e.g. the press after a chattered release.
+      // Outside of a window, e.g. the release of a key held before the state
+      // was known, it is passed on as is.
+      return in_window ? Result::kDropped : Result::kPassed;
+    }
+    if (in_window) {
+      ++key.chatter;
+      ++total_chatter_;
+      if (std::find(unsettled_.begin(), unsettled_.end(), key_code) ==
+          unsettled_.end()) {
+        unsettled_.push_back(key_code);
+      }
+      return Result::kChatter;
+    }
+    key.down = down;
+    key.last_edge = now;
+    return Result::kPassed;
+  }
+
+  // When Tick() is next due, while keys chattered within their window.
+  std::optional<Clock::time_point> NextDeadline() const {
+    std::optional<Clock::time_point> deadline;
+    for (const int key_code : unsettled_) {
+      const Key& key = keys_[key_code];
+      const auto end = key.last_edge + key.window;
+      if (!deadline.has_value() || end < *deadline) deadline = end;
+    }
+    return deadline;
+  }
+
+  // Calls emit(key_code, value) for keys which ended their window in the other
+  // state. That edge starts a window of its own.
+  template <typename Emit>
+  void Tick(Clock::time_point now, Emit emit) {
+    for (std::size_t i = 0; i < unsettled_.size();) {
+      const int key_code = unsettled_[i];
+      Key& key = keys_[key_code];
+      if (now < key.last_edge + key.window) {
+        ++i;
+        continue;
+      }
+      unsettled_[i] = unsettled_.back();
+      unsettled_.pop_back();
+      if (key.raw_down != key.down) {
+        key.down = key.raw_down;
+        key.last_edge = now;
+        emit(key_code, key.down ? 1 : 0);
+      }
+    }
+  }
+
+  // Takes the keys as held, e.g. after events were dropped, and forgets edges
+  // still within their window.
+  void Resync(const std::vector<int>& keys_down) {
+    if (!enabled()) return;
+    for (auto& key : keys_) {
+      key.down = key.raw_down = false;
+      key.last_edge = Clock::time_point::min();
+    }
+    for (const int key_code : keys_down) {
+      if (key_code < 0 || key_code >= KEY_CNT) continue;
+      keys_[key_code].down = keys_[key_code].raw_down = true;
+    }
+    unsettled_.clear();
+  }
+
+  uint64_t chatter(int key_code) const {
+    return enabled() && key_code >= 0 && key_code < KEY_CNT
+               ? keys_[key_code].chatter
+               : 0;
+  }
+
+  uint64_t total_chatter() const { return total_chatter_; }
+
+  // Pairs of key code and edges suppressed, for keys which chattered.
+  std::vector<std::pair<int, uint64_t>> ChatterCounts() const {
+    std::vector<std::pair<int, uint64_t>> counts;
+    for (int key_code = 0; key_code < int(keys_.size()); ++key_code) {
+      if (keys_[key_code].chatter != 0) {
+        counts.push_back({key_code, keys_[key_code].chatter});
+      }
+    }
+    return counts;
+  }
+
+  // Continues counts of ChatterCounts(), e.g. of the Debouncer of a previous
+  // config. Dropped if nothing is debounced any more.
+  void RestoreChatterCounts(
+      const std::vector<std::pair<int, uint64_t>>& counts) {
+    if (!enabled()) return;
+    for (const auto& [key_code, count] : counts) {
+      if (key_code < 0 || key_code >= KEY_CNT) continue;
+      keys_[key_code].chatter += count;
+      total_chatter_ += count;
+    }
+  }
+
+  std::size_t bytes() const {
+    return keys_.capacity() * sizeof(Key) + unsettled_.capacity() * sizeof(int);
+  }
+
+ private:
+  struct Key {
+    Clock::duration window = Clock::duration::zero();
+    // Edge last passed on, and when. Long ago to begin with.
+    Clock::time_point last_edge = Clock::time_point::min();
+    bool down = false;
+    // As last read, which may differ from down within the window.
+    bool raw_down = false;
+    bool window_set = false;
+    uint64_t chatter = 0;
+  };
+
+  void Allocate() {
+    if (keys_.empty()) keys_.resize(KEY_CNT);
+  }
+
+  std::vector<Key> keys_;
+  // Keys which chattered and whose window has not ended yet.
+  std::vector<int> unsettled_;
+  Clock::duration default_window_ = Clock::duration::zero();
+  uint64_t total_chatter_ = 0;
+};
+
+#endif  // __DEBOUNCER_H
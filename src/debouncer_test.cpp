@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "debouncer.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+
+SCENARIO("Debouncing") {
+  Debouncer debouncer;
+  const auto start = Debouncer::Clock::time_point();
+  using Result = Debouncer::Result;
+
+  GIVEN("No windows") {
+    THEN("Everything passes") {
+      CHECK(!debouncer.enabled());
+      CHECK(debouncer.Filter(KEY_A, 1, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_A, 1, start) == Result::kPassed);
+      CHECK(!debouncer.NextDeadline());
+    }
+  }
+
+  GIVEN("A window for all keys, and one for a key") {
+    debouncer.SetWindow(KEY_SPACE, milliseconds(20));
+    debouncer.SetDefaultWindow(milliseconds(5));
+    debouncer.SetWindow(KEY_ENTER, milliseconds(0));
+    CHECK(debouncer.window(KEY_A) == milliseconds(5));
+    CHECK(debouncer.window(KEY_SPACE) == milliseconds(20));
+    std::vector<std::string> settled;
+    const auto tick = [&](Debouncer::Clock::time_point now) {
+      debouncer.Tick(now, [&settled](int key_code, int value) {
+        settled.push_back(std::to_string(key_code) + " " +
+                          std::to_string(value));
+      });
+    };
+
+    THEN("The first edge passes, and chatter within the window does not") {
+      CHECK(debouncer.Filter(KEY_A, 1, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_A, 0, start + milliseconds(1)) ==
+            Result::kChatter);
+      CHECK(debouncer.Filter(KEY_A, 1, start + milliseconds(2)) ==
+            Result::kDropped);
+      CHECK(debouncer.Filter(KEY_A, 2, start + milliseconds(3)) ==
+            Result::kPassed);
+      // Settled in the state passed on, so nothing to pass on.
+      tick(*debouncer.NextDeadline());
+      CHECK(settled.empty());
+      CHECK(debouncer.Filter(KEY_A, 0, start + milliseconds(30)) ==
+            Result::kPassed);
+      CHECK(debouncer.chatter(KEY_A) == 1);
+      CHECK(debouncer.total_chatter() == 1);
+    }
+    THEN("A tap shorter than the window is released once it ends") {
+      CHECK(debouncer.Filter(KEY_SPACE, 1, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_SPACE, 0, start + milliseconds(8)) ==
+            Result::kChatter);
+      CHECK(debouncer.NextDeadline() == start + milliseconds(20));
+      tick(start + milliseconds(19));
+      CHECK(settled.empty());
+      tick(start + milliseconds(20));
+      CHECK(settled == std::vector<std::string>{"57 0"});
+      CHECK(!debouncer.NextDeadline());
+    }
+    THEN("Keys with a zero window are not debounced") {
+      CHECK(debouncer.Filter(KEY_ENTER, 1, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_ENTER, 0, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_ENTER, 1, start) == Result::kPassed);
+    }
+    THEN("A resync takes the keys as held") {
+      CHECK(debouncer.Filter(KEY_A, 1, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_A, 0, start) == Result::kChatter);
+      debouncer.Resync({KEY_B});
+      CHECK(!debouncer.NextDeadline());
+      CHECK(debouncer.Filter(KEY_B, 2, start) == Result::kPassed);
+      CHECK(debouncer.Filter(KEY_A, 2, start) == Result::kDropped);
+    }
+    THEN("Chatter counts carry over") {
+      Debouncer other;
+      other.RestoreChatterCounts({{KEY_A, 3}});
+      CHECK(other.total_chatter() == 0);
+      debouncer.RestoreChatterCounts({{KEY_A, 3}, {KEY_CNT, 1}});
+      CHECK(debouncer.ChatterCounts() ==
+            std::vector<std::pair<int, uint64_t>>{{KEY_A, 3}});
+      CHECK(debouncer.total_chatter() == 3);
+    }
+  }
+}
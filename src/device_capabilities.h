@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Event types and codes supported by an input device, so that the virtual
+// device can be built to match the grabbed one.
+#ifndef __DEVICE_CAPABILITIES_H
+#define __DEVICE_CAPABILITIES_H
+
+#include <linux/input.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct DeviceCapabilities {
+  // bits[0] has a bit per event type, and bits[type] a bit per code of that
+  // type. Same layout as filled by EVIOCGBIT. KEY_CNT is the largest count.
+  uint8_t bits[EV_CNT][KEY_CNT / 8 + 1] = {};
+  // Bit per INPUT_PROP_*.
+  uint8_t properties[INPUT_PROP_CNT / 8 + 1] = {};
+  // Only for the codes of EV_ABS which are set.
+  struct input_absinfo abs_info[ABS_CNT] = {};
+
+  bool Has(int type) const { return TestBit(bits[0], type); }
+  bool Has(int type, int code) const {
+    return Has(type) && TestBit(bits[type], code);
+  }
+  bool HasProperty(int property) const {
+    return TestBit(properties, property);
+  }
+
+  void Add(int type, int code) {
+    SetBit(bits[0], type);
+    SetBit(bits[type], code);
+  }
+
+  // Adds what the other device supports, e.g. to send the events of both on
+  // one virtual device. Ranges of axes already set are kept.
+  void Merge(const DeviceCapabilities& other) {
+    for (int code = 0; code < ABS_CNT; ++code) {
+      if (other.Has(EV_ABS, code) && !Has(EV_ABS, code)) {
+        abs_info[code] = other.abs_info[code];
+      }
+    }
+    for (int type = 0; type < EV_CNT; ++type) {
+      for (std::size_t i = 0; i < sizeof(bits[type]); ++i) {
+        bits[type][i] |= other.bits[type][i];
+      }
+    }
+    for (std::size_t i = 0; i < sizeof(properties); ++i) {
+      properties[i] |= other.properties[i];
+    }
+  }
+
+  // Number of possible codes for the event type.
+  static int CodeCount(int type) {
+    switch (type) {
+      case EV_KEY: return KEY_CNT;
+      case EV_REL: return REL_CNT;
+      case EV_ABS: return ABS_CNT;
+      case EV_MSC: return MSC_CNT;
+      case EV_SW: return SW_CNT;
+      case EV_LED: return LED_CNT;
+      case EV_SND: return SND_CNT;
+      case EV_REP: return REP_CNT;
+      case EV_FF: return FF_CNT;
+      default: return 0;
+    }
+  }
+
+ private:
+  static bool TestBit(const uint8_t* bits, int bit) {
+    return bits[bit / 8] & (1 << (bit % 8));
+  }
+  static void SetBit(uint8_t* bits, int bit) {
+    bits[bit / 8] |= 1 << (bit % 8);
+  }
+};
+
+#endif  // __DEVICE_CAPABILITIES_H
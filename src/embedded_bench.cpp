@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// For builds with KEYSHIFT_EMBEDDED_CONFIG. Checks that the generated tables
+// give the same output as the runtime ones on a trace of key events, and
+// compares the time taken per event.
+//
+// A trace has a key code and value per line, e.g. "30 1" for pressing A.
+// Without one, random typing on the keys of the config is used.
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config_parser.h"
+#include "embedded_config.h"
+#include "remap_operator.h"
+#include "utility/argparse.h"
+
+using Trace = std::vector<std::pair<int, int>>;
+
+// Keys are only released or repeated while held.
+Trace RandomTrace(const Remapper& remapper, std::size_t size) {
+  std::set<int> key_set = {KEY_A, KEY_SPACE, KEY_ENTER};
+  for (const auto& table : remapper.ExportLayerTables()) {
+    for (const auto& [key_event, instructions] : table.entries) {
+      key_set.insert(key_event.key_code);
+    }
+  }
+  const std::vector<int> keys(key_set.begin(), key_set.end());
+  std::mt19937 random(42);
+  std::set<int> held;
+  Trace trace;
+  while (trace.size() < size) {
+    const int key_code = keys[random() % keys.size()];
+    if (!held.contains(key_code)) {
+      held.insert(key_code);
+      trace.push_back({key_code, 1});
+    } else if (random() % 2 == 0) {
+      trace.push_back({key_code, 2});
+    } else {
+      held.erase(key_code);
+      trace.push_back({key_code, 0});
+    }
+  }
+  return trace;
+}
+
+// Returns the output, and the time taken per event in ns.
+std::pair<Trace, double> Run(Remapper& remapper, const Trace& trace,
+                             int repetitions) {
+  Trace output;
+  remapper.SetCallback([&output](int key_code, int value) {
+    output.push_back({key_code, value});
+  });
+  const auto start_time = std::chrono::steady_clock::now();
+  for (int repetition = 0; repetition < repetitions; ++repetition) {
+    output.clear();
+    for (const auto& [key_code, value] : trace) {
+      remapper.Process(key_code, value);
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start_time;
+  return {output,
+          std::chrono::duration<double, std::nano>(elapsed).count() /
+              (double(trace.size()) * repetitions)};
+}
+
+int main(const int argc, const char** argv) {
+  ArgumentParser parser;
+  parser.AddBool("help", "Show a short help.");
+  parser.AddString("trace", "File with a key code and value per line.");
+  parser.AddString("repetitions", "Times to process the trace, default 100.");
+  parser.Parse(argc, argv);
+  if (parser.GetBool("help")) {
+    parser.ShowHelp();
+    return EXIT_SUCCESS;
+  }
+  const auto arg_trace = parser.GetString("trace");
+  const int repetitions =
+      std::stoi(parser.GetString("repetitions").value_or("100"));
+
+  const std::vector<std::string> lines(std::begin(kEmbeddedConfig),
+                                       std::end(kEmbeddedConfig));
+  Remapper runtime;
+  Remapper embedded;
+  for (auto* remapper : {&runtime, &embedded}) {
+    if (!ConfigParser(remapper).Parse(lines)) {
+      std::cerr << "ERROR: Failed to parse the built in config." << std::endl;
+      return EXIT_FAILURE;
+    }
+    remapper->Optimize();
+    remapper->CompileLayerStacks();
+  }
+  runtime.UseEmbeddedTables(false);
+  if (!embedded.UseEmbeddedTables(true)) {
+    std::cerr << "ERROR: Generated tables do not match." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Trace trace;
+  if (arg_trace.has_value()) {
+    std::ifstream file(arg_trace.value());
+    int key_code, value;
+    while (file >> key_code >> value) trace.push_back({key_code, value});
+  } else {
+    trace = RandomTrace(runtime, 10000);
+  }
+  if (trace.empty()) {
+    std::cerr << "ERROR: Empty trace." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Once to compare, as the state carries over between repetitions.
+  if (Run(runtime, trace, 1).first != Run(embedded, trace, 1).first) {
+    std::cerr << "ERROR: Outputs differ." << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double runtime_ns = Run(runtime, trace, repetitions).second;
+  const double embedded_ns = Run(embedded, trace, repetitions).second;
+  std::cout << "Events: " << trace.size() << " x " << repetitions << std::endl
+            << "Runtime tables: " << runtime_ns << " ns/event" << std::endl
+            << "Generated tables: " << embedded_ns << " ns/event" << std::endl;
+  return EXIT_SUCCESS;
+}
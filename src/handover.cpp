@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "handover.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "remap_operator.h"
+#include "utility/essentials.h"
+
+// Bump on any incompatible change of the serialized state.
+const std::string kStateHeader = "keyshift-state 2";
+
+// Older states which are still read, e.g. from the binary being upgraded.
+// They lack what was added since, i.e. bound releases.
+const std::string kOlderStateHeaders[] = {"keyshift-state 1"};
+
+const std::string kDeletedSuffix = " (deleted)";
+
+std::string SerializeState(const RemapperState& state) {
+  std::ostringstream oss;
+  oss << kStateHeader << "\n";
+  oss << "profile " << state.profile_name << "\n";
+  oss << "seq " << state.event_seq_num << "\n";
+  oss << "counters " << state.counters.passthrough << " "
+      << state.counters.remapped << " " << state.counters.blocked << " "
+      << state.counters.layer_activations << " "
+      << state.counters.redundant_dropped << "\n";
+  oss << "down";
+  for (const int key_code : state.input_keys_down) oss << " " << key_code;
+  oss << "\n";
+  if (!state.chatter.empty()) {
+    oss << "chatter";
+    for (const auto& [key_code, count] : state.chatter) {
+      oss << " " << key_code << " " << count;
+    }
+    oss << "\n";
+  }
+  for (const auto& [key_code, seq_num] : state.keys_held) {
+    oss << "held " << key_code << " " << seq_num << "\n";
+  }
+  for (const auto& [key_code, released] : state.bound_releases) {
+    oss << "release " << key_code;
+    for (const int released_key_code : released) {
+      oss << " " << released_key_code;
+    }
+    oss << "\n";
+  }
+  // Name is last, since it may contain spaces.
+  for (const auto& layer : state.active_layers) {
+    oss << "layer " << layer.event_seq_num << " " << layer.key_event.key_code
+        << " " << int(layer.key_event.value) << " "
+        << int(layer.null_event_applicable) << " " << layer.state_name << "\n";
+  }
+  return oss.str();
+}
+
+std::optional<RemapperState> DeserializeState(const std::string& serialized) {
+  std::istringstream iss(serialized);
+  std::string line;
+  if (!std::getline(iss, line) ||
+      (line != kStateHeader &&
+       std::find(std::begin(kOlderStateHeaders), std::end(kOlderStateHeaders),
+                 line) == std::end(kOlderStateHeaders))) {
+    std::cerr << "ERROR: Unknown state format: " << line << std::endl;
+    return std::nullopt;
+  }
+  RemapperState state;
+  while (std::getline(iss, line)) {
+    std::istringstream line_stream(line);
+    std::string kind;
+    line_stream >> kind;
+    if (kind == "profile") {
+      line_stream >> state.profile_name;
+    } else if (kind == "seq") {
+      line_stream >> state.event_seq_num;
+    } else if (kind == "counters") {
+      line_stream >> state.counters.passthrough >> state.counters.remapped >>
+          state.counters.blocked >> state.counters.layer_activations;
+      // States of older versions end here.
+      if (!line_stream.fail() &&
+          !(line_stream >> state.counters.redundant_dropped) &&
+          line_stream.eof()) {
+        line_stream.clear();
+      }
+    } else if (kind == "down") {
+      int key_code;
+      while (line_stream >> key_code) state.input_keys_down.push_back(key_code);
+      // Reading stops at the end of the line, which is not an error.
+      if (line_stream.eof()) line_stream.clear();
+    } else if (kind == "chatter") {
+      int key_code;
+      uint64_t count;
+      while (line_stream >> key_code >> count) {
+        state.chatter.push_back({key_code, count});
+      }
+      if (line_stream.eof()) line_stream.clear();
+    } else if (kind == "held") {
+      int key_code, seq_num;
+      line_stream >> key_code >> seq_num;
+      state.keys_held.push_back({key_code, seq_num});
+    } else if (kind == "release") {
+      int key_code;
+      if (line_stream >> key_code) {
+        std::vector<int> released;
+        int released_key_code;
+        while (line_stream >> released_key_code) {
+          released.push_back(released_key_code);
+        }
+        // Reading stops at the end of the line, which is not an error.
+        if (line_stream.eof()) line_stream.clear();
+        state.bound_releases.push_back({key_code, released});
+      }
+    } else if (kind == "layer") {
+      RemapperState::Layer layer;
+      int value, null_event_applicable;
+      line_stream >> layer.event_seq_num >> layer.key_event.key_code >> value >>
+          null_event_applicable;
+      layer.key_event.value = KeyEventType(value);
+      layer.null_event_applicable = null_event_applicable != 0;
+      // Skip the single space separator, and take the rest as the name.
+      line_stream.get();
+      std::getline(line_stream, layer.state_name);
+      state.active_layers.push_back(layer);
+    } else {
+      std::cerr << "ERROR: Unknown state line: " << line << std::endl;
+      return std::nullopt;
+    }
+    if (line_stream.fail()) {
+      std::cerr << "ERROR: Malformed state line: " << line << std::endl;
+      return std::nullopt;
+    }
+  }
+  return state;
+}
+
+[[nodiscard]] bool SendHandover(int socket_fd, const Handover& handover) {
+  const std::string payload = SerializeState(handover.state);
+  const uint32_t payload_size = payload.size();
+
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<uint32_t*>(&payload_size);
+  iov[0].iov_len = sizeof(payload_size);
+  iov[1].iov_base = const_cast<char*>(payload.data());
+  iov[1].iov_len = payload.size();
+
+  const int fds[3] = {handover.input_fd, handover.uinput_fd,
+                      handover.mouse_fd};
+  // The mouse is sent only if there is one.
+  const std::size_t fds_size = sizeof(int) * (handover.mouse_fd >= 0 ? 3 : 2);
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(fds_size);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds_size);
+  memcpy(CMSG_DATA(cmsg), fds, fds_size);
+
+  const ssize_t sent = sendmsg(socket_fd, &msg, 0);
+  if (sent != ssize_t(sizeof(payload_size) + payload.size())) {
+    perror("Handover sendmsg failed");
+    return false;
+  }
+  return true;
+}
+
+std::optional<Handover> ReceiveHandover(int socket_fd) {
+  uint32_t payload_size = 0;
+  struct iovec iov;
+  iov.iov_base = &payload_size;
+  iov.iov_len = sizeof(payload_size);
+
+  int fds[3] = {-1, -1, -1};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if (recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC) !=
+      ssize_t(sizeof(payload_size))) {
+    perror("Handover recvmsg failed");
+    close(socket_fd);
+    return std::nullopt;
+  }
+  const struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  // Two fds, or three with a mouse.
+  if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+      (cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)) &&
+       cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))) {
+    std::cerr << "ERROR: Handover did not contain the device fds."
+              << std::endl;
+    close(socket_fd);
+    return std::nullopt;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+
+  std::string payload(payload_size, '\0');
+  std::size_t received = 0;
+  while (received < payload.size()) {
+    const ssize_t len =
+        read(socket_fd, payload.data() + received, payload.size() - received);
+    if (len <= 0) break;
+    received += len;
+  }
+  close(socket_fd);
+
+  const auto state = DeserializeState(payload);
+  if (received != payload.size() || !state.has_value()) {
+    std::cerr << "ERROR: Could not read the handed over state." << std::endl;
+    for (const int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+    return std::nullopt;
+  }
+  return Handover{fds[0], fds[1], state.value(), fds[2]};
+}
+
+std::string GetExecutablePath() {
+  std::string path = std::filesystem::read_symlink("/proc/self/exe").string();
+  // If the binary was replaced on disk, the link is to the unlinked original.
+  if (path.ends_with(kDeletedSuffix)) {
+    path.resize(path.size() - kDeletedSuffix.size());
+  }
+  return path;
+}
+
+void ExecWithHandover(const std::string& exe_path,
+                      std::vector<std::string> args, const Handover& handover) {
+  int socket_fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socket_fds) < 0) {
+    perror("socketpair");
+    return;
+  }
+  // The sending end is closed on exec. What is sent stays buffered in the
+  // receiving end, which must survive the exec.
+  fcntl(socket_fds[1], F_SETFD, 0);
+  if (!SendHandover(socket_fds[0], handover)) {
+    close(socket_fds[0]);
+    close(socket_fds[1]);
+    return;
+  }
+  // The new binary gets the devices only through the socket.
+  for (const int fd :
+       {handover.input_fd, handover.uinput_fd, handover.mouse_fd}) {
+    if (fd >= 0) fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+  }
+
+  std::erase_if(args, [](const std::string& arg) {
+    return StartsWith(arg, "--takeover-fd");
+  });
+  args.push_back("--takeover-fd=" + std::to_string(socket_fds[1]));
+  std::vector<char*> argv;
+  for (auto& arg : args) argv.push_back(arg.data());
+  argv.push_back(nullptr);
+
+  std::cout << "Handing over to " << exe_path << std::endl;
+  execv(exe_path.c_str(), argv.data());
+
+  // Only reached if exec failed. The devices are still owned by us.
+  perror("execv");
+  close(socket_fds[0]);
+  close(socket_fds[1]);
+}
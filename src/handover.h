@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Hands over a running instance to a new binary, without releasing the grab
+// or recreating the virtual device.
+//
+// The running instance sends the grabbed input fds, the uinput fd and the
+// Remapper state over a socket with SCM_RIGHTS, and exec()s the new binary
+// with --takeover-fd pointing at the other end of the socket. The pid stays
+// the same, and since the input fd stays open throughout, events arriving in
+// the meantime stay queued in the kernel and are processed by the new binary.
+#ifndef __HANDOVER_H
+#define __HANDOVER_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "remap_operator.h"
+
+struct Handover {
+  int input_fd = -1;
+  int uinput_fd = -1;
+  RemapperState state;
+  // The mouse grabbed along with the keyboard, or -1 for none.
+  int mouse_fd = -1;
+};
+
+// Text representation of a RemapperState, to be passed to the new binary.
+std::string SerializeState(const RemapperState& state);
+
+std::optional<RemapperState> DeserializeState(const std::string& serialized);
+
+// Sends the fds and the state over a connected unix socket.
+[[nodiscard]] bool SendHandover(int socket_fd, const Handover& handover);
+
+// Receives what was sent with SendHandover(). Closes socket_fd.
+std::optional<Handover> ReceiveHandover(int socket_fd);
+
+// Returns the path of the binary on disk for the running process. If the
+// binary was replaced, this is the path of the replacement.
+std::string GetExecutablePath();
+
+// Replaces the current process with the binary at exe_path, invoked with args
+// (args[0] being the program name) and --takeover-fd. Returns only on failure.
+void ExecWithHandover(const std::string& exe_path,
+                      std::vector<std::string> args, const Handover& handover);
+
+#endif  // __HANDOVER_H
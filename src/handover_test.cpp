@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "handover.h"
+
+#include <linux/input-event-codes.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "remap_operator.h"
+
+RemapperState SampleState() {
+  RemapperState state;
+  state.profile_name = "game";
+  state.event_seq_num = 7;
+  state.counters = {10, 11, 12, 13, 14};
+  state.input_keys_down = {KEY_LEFTSHIFT, KEY_CAPSLOCK};
+  state.chatter = {{KEY_A, 3}, {KEY_SPACE, 1ull << 40}};
+  state.keys_held = {{KEY_LEFTSHIFT, 2}, {KEY_F1, 6}};
+  state.bound_releases = {{KEY_J, {KEY_ESC}}, {KEY_K, {}}};
+  state.active_layers = {
+      {3, KeyPressEvent(KEY_CAPSLOCK), "KEY_CAPSLOCK_layer", false},
+      {5, KeyPressEvent(KEY_DELETE), "name with spaces", true}};
+  return state;
+}
+
+void CheckSameState(const RemapperState& actual,
+                    const RemapperState& expected) {
+  CHECK(actual.profile_name == expected.profile_name);
+  CHECK(actual.event_seq_num == expected.event_seq_num);
+  CHECK(actual.counters.passthrough == expected.counters.passthrough);
+  CHECK(actual.counters.layer_activations ==
+        expected.counters.layer_activations);
+  CHECK(actual.counters.redundant_dropped ==
+        expected.counters.redundant_dropped);
+  CHECK(actual.input_keys_down == expected.input_keys_down);
+  CHECK(actual.chatter == expected.chatter);
+  CHECK(actual.keys_held == expected.keys_held);
+  CHECK(actual.bound_releases == expected.bound_releases);
+  REQUIRE(actual.active_layers.size() == expected.active_layers.size());
+  for (std::size_t i = 0; i < actual.active_layers.size(); ++i) {
+    const auto& actual_layer = actual.active_layers[i];
+    const auto& expected_layer = expected.active_layers[i];
+    CHECK(actual_layer.event_seq_num == expected_layer.event_seq_num);
+    CHECK(actual_layer.key_event == expected_layer.key_event);
+    CHECK(actual_layer.state_name == expected_layer.state_name);
+    CHECK(actual_layer.null_event_applicable ==
+          expected_layer.null_event_applicable);
+  }
+}
+
+SCENARIO("State serialization") {
+  const auto state = DeserializeState(SerializeState(SampleState()));
+  REQUIRE(state.has_value());
+  CheckSameState(state.value(), SampleState());
+
+  CHECK(!DeserializeState("keyshift-state 0\n").has_value());
+  CHECK(!DeserializeState("keyshift-state 1\nheld x\n").has_value());
+  CHECK(!DeserializeState("keyshift-state 2\nrelease\n").has_value());
+  CHECK(!DeserializeState("keyshift-state 2\nrelease 36 x\n").has_value());
+  // Without counters added since.
+  const auto older = DeserializeState("keyshift-state 1\ncounters 1 2 3 4\n");
+  REQUIRE(older.has_value());
+  CHECK(older->counters.layer_activations == 4);
+  CHECK(older->counters.redundant_dropped == 0);
+  CHECK(!DeserializeState("keyshift-state 1\ncounters 1 2 3 4 x\n"));
+}
+
+SCENARIO("Handover over a socket") {
+  int socket_fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds) == 0);
+  // Any fd will do in place of the devices.
+  int pipe_fds[2];
+  REQUIRE(pipe(pipe_fds) == 0);
+
+  REQUIRE(SendHandover(socket_fds[0],
+                       Handover{pipe_fds[0], pipe_fds[1], SampleState()}));
+  close(socket_fds[0]);
+  const auto handover = ReceiveHandover(socket_fds[1]);
+  REQUIRE(handover.has_value());
+  CheckSameState(handover->state, SampleState());
+  CHECK(handover->mouse_fd == -1);
+
+  // The received fds refer to the same pipe.
+  REQUIRE(write(handover->uinput_fd, "x", 1) == 1);
+  char c = 0;
+  REQUIRE(read(pipe_fds[0], &c, 1) == 1);
+  CHECK(c == 'x');
+
+  for (const int fd :
+       {pipe_fds[0], pipe_fds[1], handover->input_fd, handover->uinput_fd}) {
+    close(fd);
+  }
+}
+
+SCENARIO("Handover of a mouse along with the keyboard") {
+  int socket_fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds) == 0);
+  int pipe_fds[2];
+  REQUIRE(pipe(pipe_fds) == 0);
+
+  REQUIRE(SendHandover(socket_fds[0], Handover{pipe_fds[0], pipe_fds[1],
+                                               SampleState(), pipe_fds[1]}));
+  close(socket_fds[0]);
+  const auto handover = ReceiveHandover(socket_fds[1]);
+  REQUIRE(handover.has_value());
+  REQUIRE(handover->mouse_fd >= 0);
+
+  REQUIRE(write(handover->mouse_fd, "m", 1) == 1);
+  char c = 0;
+  REQUIRE(read(pipe_fds[0], &c, 1) == 1);
+  CHECK(c == 'm');
+
+  for (const int fd : {pipe_fds[0], pipe_fds[1], handover->input_fd,
+                       handover->uinput_fd, handover->mouse_fd}) {
+    close(fd);
+  }
+}
@@ -21,7 +21,11 @@
 #include <linux/input.h>
 
 #include <chrono>
+#include <optional>
 #include <thread>
+#include <vector>
+
+#include "device_capabilities.h"
 
 const int kOpenRetryDurationMs = 2500;
 
@@ -43,6 +47,10 @@ class InputDevice {
     }
   }
 
+  // Takes over a device which is already open and grabbed, e.g. by a previous
+  // instance which handed it over.
+  explicit InputDevice(int grabbed_fd) : fd_(grabbed_fd), grabbed_(true) {}
+
   // Movable but not copyable.
   InputDevice(InputDevice&& other) = default;
   InputDevice& operator=(InputDevice&& other) = default;
@@ -79,6 +87,79 @@ class InputDevice {
 
   int get_fd() const { return fd_; }
 
+  // Keys held, as known to the kernel.
+  std::optional<std::vector<int>> GetKeysDown() const {
+    unsigned char key_state[KEY_CNT / 8 + 1];
+    memset(key_state, 0, sizeof(key_state));
+    if (ioctl(fd_, EVIOCGKEY(sizeof(key_state)), key_state) < 0) {
+      perror("EVIOCGKEY");
+      return std::nullopt;
+    }
+    std::vector<int> keys_down;
+    for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+      if (key_state[key_code / 8] & (1 << (key_code % 8))) {
+        keys_down.push_back(key_code);
+      }
+    }
+    return keys_down;
+  }
+
+  // Current position of an axis, as known to the kernel.
+  std::optional<int> GetAxisValue(int code) const {
+    struct input_absinfo info;
+    if (ioctl(fd_, EVIOCGABS(code), &info) < 0) {
+      perror("EVIOCGABS");
+      return std::nullopt;
+    }
+    return info.value;
+  }
+
+  // If masked, asks the kernel not to queue any event of the type for this
+  // client, so that they cost neither a wakeup nor a read. Returns false if
+  // the kernel does not support EVIOCSMASK.
+  bool SetEventTypeMasked(int type, bool masked) {
+    // A bit per code which is let through.
+    unsigned char codes[KEY_CNT / 8 + 1];
+    memset(codes, masked ? 0 : 0xff, sizeof(codes));
+    struct input_mask mask;
+    mask.type = type;
+    mask.codes_size = sizeof(codes);
+    mask.codes_ptr = reinterpret_cast<uint64_t>(codes);
+    if (ioctl(fd_, EVIOCSMASK, &mask) < 0) {
+      perror("EVIOCSMASK");
+      return false;
+    }
+    return true;
+  }
+
+  // Reads which event types and codes the device can send.
+  DeviceCapabilities GetCapabilities() const {
+    DeviceCapabilities capabilities;
+    if (ioctl(fd_, EVIOCGBIT(0, sizeof(capabilities.bits[0])),
+              capabilities.bits[0]) < 0) {
+      perror("EVIOCGBIT");
+      return capabilities;
+    }
+    for (int type = 1; type < EV_CNT; ++type) {
+      if (!capabilities.Has(type)) continue;
+      if (ioctl(fd_, EVIOCGBIT(type, sizeof(capabilities.bits[type])),
+                capabilities.bits[type]) < 0) {
+        perror("EVIOCGBIT");
+      }
+    }
+    if (ioctl(fd_, EVIOCGPROP(sizeof(capabilities.properties)),
+              capabilities.properties) < 0) {
+      perror("EVIOCGPROP");
+    }
+    for (int code = 0; code < ABS_CNT; ++code) {
+      if (!capabilities.Has(EV_ABS, code)) continue;
+      if (ioctl(fd_, EVIOCGABS(code), &capabilities.abs_info[code]) < 0) {
+        perror("EVIOCGABS");
+      }
+    }
+    return capabilities;
+  }
+
  private:
   bool IsAnyKeyPressed() {
     // KEY_CNT / 8 + 1 since one bit will be used per key.
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_KEYMAP_H
+#define __KERNEL_KEYMAP_H
+
+#include <linux/input.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Keyboards translate scan codes to key codes with a keymap in the kernel,
+// which can be changed with EVIOCSKEYCODE_V2. Remapping keys there costs
+// nothing per event, as the remapped key code is what keyshift reads.
+//
+// The keymap belongs to the device, not to keyshift, and is restored on
+// destruction.
+class KernelKeymap {
+ public:
+  // Remaps every scan code of `from` to `to` for the {from, to} pairs. A pair
+  // is either applied for all of its scan codes or not at all.
+  KernelKeymap(int fd, const std::vector<std::pair<int, int>>& remaps)
+      : fd_(fd), requested_(remaps) {
+    // Read the whole keymap first, so that e.g. swaps see the original codes.
+    std::vector<input_keymap_entry> entries;
+    for (unsigned int index = 0; index < kMaxEntries; ++index) {
+      const auto entry = GetEntry(index);
+      if (!entry.has_value()) break;
+      entries.push_back(*entry);
+    }
+
+    for (const auto& [from, to] : remaps) {
+      const std::size_t num_changes = changes_.size();
+      bool success = true;
+      for (const auto& entry : entries) {
+        if (static_cast<int>(entry.keycode) != from) continue;
+        if (!SetKeyCode(entry.index, to)) {
+          success = false;
+          break;
+        }
+        changes_.push_back({entry.index, entry.keycode});
+      }
+      if (!success) {
+        RestoreFrom(num_changes);
+        continue;
+      }
+      if (changes_.size() > num_changes) applied_.push_back({from, to});
+    }
+  }
+
+  ~KernelKeymap() { RestoreFrom(0); }
+
+  // Not copyable, as only one may restore the keymap.
+  KernelKeymap(const KernelKeymap&) = delete;
+  KernelKeymap& operator=(const KernelKeymap&) = delete;
+
+  // Remaps which the kernel now does.
+  const std::vector<std::pair<int, int>>& applied() const { return applied_; }
+  // Remaps asked for, whether applied or not.
+  const std::vector<std::pair<int, int>>& requested() const {
+    return requested_;
+  }
+
+ private:
+  // Larger keymaps are not expected from keyboards.
+  static constexpr unsigned int kMaxEntries = 65536;
+
+  struct Change {
+    unsigned int index;
+    unsigned int original_key_code;
+  };
+
+  std::optional<input_keymap_entry> GetEntry(unsigned int index) const {
+    input_keymap_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.flags = INPUT_KEYMAP_BY_INDEX;
+    entry.index = index;
+    // Fails past the last entry, or if the device has no keymap.
+    if (ioctl(fd_, EVIOCGKEYCODE_V2, &entry) < 0) return std::nullopt;
+    return entry;
+  }
+
+  bool SetKeyCode(unsigned int index, unsigned int key_code) const {
+    input_keymap_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.flags = INPUT_KEYMAP_BY_INDEX;
+    entry.index = index;
+    entry.keycode = key_code;
+    if (ioctl(fd_, EVIOCSKEYCODE_V2, &entry) < 0) {
+      perror("EVIOCSKEYCODE_V2");
+      return false;
+    }
+    return true;
+  }
+
+  // Undoes changes from the given one onwards, latest first.
+  void RestoreFrom(std::size_t first_change) {
+    while (changes_.size() > first_change) {
+      const auto& change = changes_.back();
+      SetKeyCode(change.index, change.original_key_code);
+      changes_.pop_back();
+    }
+  }
+
+  int fd_;
+  std::vector<std::pair<int, int>> requested_;
+  std::vector<std::pair<int, int>> applied_;
+  std::vector<Change> changes_;
+};
+
+#endif  // __KERNEL_KEYMAP_H
@@ -25,6 +25,8 @@
 #include <optional>
 #include <unordered_map>
 
+#include "wheel_keys.h"
+
 class KeyCodes {
  public:
   static const std::shared_ptr<KeyCodes> instance() {
@@ -319,6 +321,312 @@ class KeyCodes {
       {KEY_RFKILL, "KEY_RFKILL"},
 
       {KEY_MICMUTE, "KEY_MICMUTE"},
+
+      // Codes above 255, e.g. buttons and keys of media remotes.
+      {BTN_0, "BTN_0"},
+      {BTN_1, "BTN_1"},
+      {BTN_2, "BTN_2"},
+      {BTN_3, "BTN_3"},
+      {BTN_4, "BTN_4"},
+      {BTN_5, "BTN_5"},
+      {BTN_6, "BTN_6"},
+      {BTN_7, "BTN_7"},
+      {BTN_8, "BTN_8"},
+      {BTN_9, "BTN_9"},
+
+      {BTN_LEFT, "BTN_LEFT"},
+      {BTN_RIGHT, "BTN_RIGHT"},
+      {BTN_MIDDLE, "BTN_MIDDLE"},
+      {BTN_SIDE, "BTN_SIDE"},
+      {BTN_EXTRA, "BTN_EXTRA"},
+      {BTN_FORWARD, "BTN_FORWARD"},
+      {BTN_BACK, "BTN_BACK"},
+      {BTN_TASK, "BTN_TASK"},
+
+      {BTN_SOUTH, "BTN_SOUTH"},
+      {BTN_EAST, "BTN_EAST"},
+      {BTN_C, "BTN_C"},
+      {BTN_NORTH, "BTN_NORTH"},
+      {BTN_WEST, "BTN_WEST"},
+      {BTN_Z, "BTN_Z"},
+      {BTN_TL, "BTN_TL"},
+      {BTN_TR, "BTN_TR"},
+      {BTN_TL2, "BTN_TL2"},
+      {BTN_TR2, "BTN_TR2"},
+      {BTN_SELECT, "BTN_SELECT"},
+      {BTN_START, "BTN_START"},
+      {BTN_MODE, "BTN_MODE"},
+      {BTN_THUMBL, "BTN_THUMBL"},
+      {BTN_THUMBR, "BTN_THUMBR"},
+      {BTN_DPAD_UP, "BTN_DPAD_UP"},
+      {BTN_DPAD_DOWN, "BTN_DPAD_DOWN"},
+      {BTN_DPAD_LEFT, "BTN_DPAD_LEFT"},
+      {BTN_DPAD_RIGHT, "BTN_DPAD_RIGHT"},
+
+      {KEY_OK, "KEY_OK"},
+      {KEY_SELECT, "KEY_SELECT"},
+      {KEY_GOTO, "KEY_GOTO"},
+      {KEY_CLEAR, "KEY_CLEAR"},
+      {KEY_POWER2, "KEY_POWER2"},
+      {KEY_OPTION, "KEY_OPTION"},
+      {KEY_INFO, "KEY_INFO"},
+      {KEY_TIME, "KEY_TIME"},
+      {KEY_VENDOR, "KEY_VENDOR"},
+      {KEY_ARCHIVE, "KEY_ARCHIVE"},
+      {KEY_PROGRAM, "KEY_PROGRAM"},
+      {KEY_CHANNEL, "KEY_CHANNEL"},
+      {KEY_FAVORITES, "KEY_FAVORITES"},
+      {KEY_EPG, "KEY_EPG"},
+      {KEY_PVR, "KEY_PVR"},
+      {KEY_MHP, "KEY_MHP"},
+      {KEY_LANGUAGE, "KEY_LANGUAGE"},
+      {KEY_TITLE, "KEY_TITLE"},
+      {KEY_SUBTITLE, "KEY_SUBTITLE"},
+      {KEY_ANGLE, "KEY_ANGLE"},
+      {KEY_FULL_SCREEN, "KEY_FULL_SCREEN"},
+      {KEY_MODE, "KEY_MODE"},
+      {KEY_KEYBOARD, "KEY_KEYBOARD"},
+      {KEY_ASPECT_RATIO, "KEY_ASPECT_RATIO"},
+      {KEY_PC, "KEY_PC"},
+      {KEY_TV, "KEY_TV"},
+      {KEY_TV2, "KEY_TV2"},
+      {KEY_VCR, "KEY_VCR"},
+      {KEY_VCR2, "KEY_VCR2"},
+      {KEY_SAT, "KEY_SAT"},
+      {KEY_SAT2, "KEY_SAT2"},
+      {KEY_CD, "KEY_CD"},
+      {KEY_TAPE, "KEY_TAPE"},
+      {KEY_RADIO, "KEY_RADIO"},
+      {KEY_TUNER, "KEY_TUNER"},
+      {KEY_PLAYER, "KEY_PLAYER"},
+      {KEY_TEXT, "KEY_TEXT"},
+      {KEY_DVD, "KEY_DVD"},
+      {KEY_AUX, "KEY_AUX"},
+      {KEY_MP3, "KEY_MP3"},
+      {KEY_AUDIO, "KEY_AUDIO"},
+      {KEY_VIDEO, "KEY_VIDEO"},
+      {KEY_DIRECTORY, "KEY_DIRECTORY"},
+      {KEY_LIST, "KEY_LIST"},
+      {KEY_MEMO, "KEY_MEMO"},
+      {KEY_CALENDAR, "KEY_CALENDAR"},
+      {KEY_RED, "KEY_RED"},
+      {KEY_GREEN, "KEY_GREEN"},
+      {KEY_YELLOW, "KEY_YELLOW"},
+      {KEY_BLUE, "KEY_BLUE"},
+      {KEY_CHANNELUP, "KEY_CHANNELUP"},
+      {KEY_CHANNELDOWN, "KEY_CHANNELDOWN"},
+      {KEY_FIRST, "KEY_FIRST"},
+      {KEY_LAST, "KEY_LAST"},
+      {KEY_AB, "KEY_AB"},
+      {KEY_NEXT, "KEY_NEXT"},
+      {KEY_RESTART, "KEY_RESTART"},
+      {KEY_SLOW, "KEY_SLOW"},
+      {KEY_SHUFFLE, "KEY_SHUFFLE"},
+      {KEY_BREAK, "KEY_BREAK"},
+      {KEY_PREVIOUS, "KEY_PREVIOUS"},
+      {KEY_DIGITS, "KEY_DIGITS"},
+      {KEY_TEEN, "KEY_TEEN"},
+      {KEY_TWEN, "KEY_TWEN"},
+      {KEY_VIDEOPHONE, "KEY_VIDEOPHONE"},
+      {KEY_GAMES, "KEY_GAMES"},
+      {KEY_ZOOMIN, "KEY_ZOOMIN"},
+      {KEY_ZOOMOUT, "KEY_ZOOMOUT"},
+      {KEY_ZOOMRESET, "KEY_ZOOMRESET"},
+      {KEY_WORDPROCESSOR, "KEY_WORDPROCESSOR"},
+      {KEY_EDITOR, "KEY_EDITOR"},
+      {KEY_SPREADSHEET, "KEY_SPREADSHEET"},
+      {KEY_GRAPHICSEDITOR, "KEY_GRAPHICSEDITOR"},
+      {KEY_PRESENTATION, "KEY_PRESENTATION"},
+      {KEY_DATABASE, "KEY_DATABASE"},
+      {KEY_NEWS, "KEY_NEWS"},
+      {KEY_VOICEMAIL, "KEY_VOICEMAIL"},
+      {KEY_ADDRESSBOOK, "KEY_ADDRESSBOOK"},
+      {KEY_MESSENGER, "KEY_MESSENGER"},
+      {KEY_DISPLAYTOGGLE, "KEY_DISPLAYTOGGLE"},
+      {KEY_SPELLCHECK, "KEY_SPELLCHECK"},
+      {KEY_LOGOFF, "KEY_LOGOFF"},
+      {KEY_DOLLAR, "KEY_DOLLAR"},
+      {KEY_EURO, "KEY_EURO"},
+      {KEY_FRAMEBACK, "KEY_FRAMEBACK"},
+      {KEY_FRAMEFORWARD, "KEY_FRAMEFORWARD"},
+      {KEY_CONTEXT_MENU, "KEY_CONTEXT_MENU"},
+      {KEY_MEDIA_REPEAT, "KEY_MEDIA_REPEAT"},
+      {KEY_10CHANNELSUP, "KEY_10CHANNELSUP"},
+      {KEY_10CHANNELSDOWN, "KEY_10CHANNELSDOWN"},
+      {KEY_IMAGES, "KEY_IMAGES"},
+      {KEY_NOTIFICATION_CENTER, "KEY_NOTIFICATION_CENTER"},
+      {KEY_PICKUP_PHONE, "KEY_PICKUP_PHONE"},
+      {KEY_HANGUP_PHONE, "KEY_HANGUP_PHONE"},
+      {KEY_DEL_EOL, "KEY_DEL_EOL"},
+      {KEY_DEL_EOS, "KEY_DEL_EOS"},
+      {KEY_INS_LINE, "KEY_INS_LINE"},
+      {KEY_DEL_LINE, "KEY_DEL_LINE"},
+      {KEY_FN, "KEY_FN"},
+      {KEY_FN_ESC, "KEY_FN_ESC"},
+      {KEY_FN_F1, "KEY_FN_F1"},
+      {KEY_FN_F2, "KEY_FN_F2"},
+      {KEY_FN_F3, "KEY_FN_F3"},
+      {KEY_FN_F4, "KEY_FN_F4"},
+      {KEY_FN_F5, "KEY_FN_F5"},
+      {KEY_FN_F6, "KEY_FN_F6"},
+      {KEY_FN_F7, "KEY_FN_F7"},
+      {KEY_FN_F8, "KEY_FN_F8"},
+      {KEY_FN_F9, "KEY_FN_F9"},
+      {KEY_FN_F10, "KEY_FN_F10"},
+      {KEY_FN_F11, "KEY_FN_F11"},
+      {KEY_FN_F12, "KEY_FN_F12"},
+      {KEY_FN_1, "KEY_FN_1"},
+      {KEY_FN_2, "KEY_FN_2"},
+      {KEY_FN_D, "KEY_FN_D"},
+      {KEY_FN_E, "KEY_FN_E"},
+      {KEY_FN_F, "KEY_FN_F"},
+      {KEY_FN_S, "KEY_FN_S"},
+      {KEY_FN_B, "KEY_FN_B"},
+      {KEY_FN_RIGHT_SHIFT, "KEY_FN_RIGHT_SHIFT"},
+      {KEY_BRL_DOT1, "KEY_BRL_DOT1"},
+      {KEY_BRL_DOT2, "KEY_BRL_DOT2"},
+      {KEY_BRL_DOT3, "KEY_BRL_DOT3"},
+      {KEY_BRL_DOT4, "KEY_BRL_DOT4"},
+      {KEY_BRL_DOT5, "KEY_BRL_DOT5"},
+      {KEY_BRL_DOT6, "KEY_BRL_DOT6"},
+      {KEY_BRL_DOT7, "KEY_BRL_DOT7"},
+      {KEY_BRL_DOT8, "KEY_BRL_DOT8"},
+      {KEY_BRL_DOT9, "KEY_BRL_DOT9"},
+      {KEY_BRL_DOT10, "KEY_BRL_DOT10"},
+      {KEY_NUMERIC_0, "KEY_NUMERIC_0"},
+      {KEY_NUMERIC_1, "KEY_NUMERIC_1"},
+      {KEY_NUMERIC_2, "KEY_NUMERIC_2"},
+      {KEY_NUMERIC_3, "KEY_NUMERIC_3"},
+      {KEY_NUMERIC_4, "KEY_NUMERIC_4"},
+      {KEY_NUMERIC_5, "KEY_NUMERIC_5"},
+      {KEY_NUMERIC_6, "KEY_NUMERIC_6"},
+      {KEY_NUMERIC_7, "KEY_NUMERIC_7"},
+      {KEY_NUMERIC_8, "KEY_NUMERIC_8"},
+      {KEY_NUMERIC_9, "KEY_NUMERIC_9"},
+      {KEY_NUMERIC_STAR, "KEY_NUMERIC_STAR"},
+      {KEY_NUMERIC_POUND, "KEY_NUMERIC_POUND"},
+      {KEY_NUMERIC_A, "KEY_NUMERIC_A"},
+      {KEY_NUMERIC_B, "KEY_NUMERIC_B"},
+      {KEY_NUMERIC_C, "KEY_NUMERIC_C"},
+      {KEY_NUMERIC_D, "KEY_NUMERIC_D"},
+      {KEY_CAMERA_FOCUS, "KEY_CAMERA_FOCUS"},
+      {KEY_WPS_BUTTON, "KEY_WPS_BUTTON"},
+      {KEY_TOUCHPAD_TOGGLE, "KEY_TOUCHPAD_TOGGLE"},
+      {KEY_TOUCHPAD_ON, "KEY_TOUCHPAD_ON"},
+      {KEY_TOUCHPAD_OFF, "KEY_TOUCHPAD_OFF"},
+      {KEY_CAMERA_ZOOMIN, "KEY_CAMERA_ZOOMIN"},
+      {KEY_CAMERA_ZOOMOUT, "KEY_CAMERA_ZOOMOUT"},
+      {KEY_CAMERA_UP, "KEY_CAMERA_UP"},
+      {KEY_CAMERA_DOWN, "KEY_CAMERA_DOWN"},
+      {KEY_CAMERA_LEFT, "KEY_CAMERA_LEFT"},
+      {KEY_CAMERA_RIGHT, "KEY_CAMERA_RIGHT"},
+      {KEY_ATTENDANT_ON, "KEY_ATTENDANT_ON"},
+      {KEY_ATTENDANT_OFF, "KEY_ATTENDANT_OFF"},
+      {KEY_ATTENDANT_TOGGLE, "KEY_ATTENDANT_TOGGLE"},
+      {KEY_LIGHTS_TOGGLE, "KEY_LIGHTS_TOGGLE"},
+      {KEY_ALS_TOGGLE, "KEY_ALS_TOGGLE"},
+      {KEY_ROTATE_LOCK_TOGGLE, "KEY_ROTATE_LOCK_TOGGLE"},
+      {KEY_BUTTONCONFIG, "KEY_BUTTONCONFIG"},
+      {KEY_TASKMANAGER, "KEY_TASKMANAGER"},
+      {KEY_JOURNAL, "KEY_JOURNAL"},
+      {KEY_CONTROLPANEL, "KEY_CONTROLPANEL"},
+      {KEY_APPSELECT, "KEY_APPSELECT"},
+      {KEY_SCREENSAVER, "KEY_SCREENSAVER"},
+      {KEY_VOICECOMMAND, "KEY_VOICECOMMAND"},
+      {KEY_ASSISTANT, "KEY_ASSISTANT"},
+      {KEY_KBD_LAYOUT_NEXT, "KEY_KBD_LAYOUT_NEXT"},
+      {KEY_EMOJI_PICKER, "KEY_EMOJI_PICKER"},
+      {KEY_DICTATE, "KEY_DICTATE"},
+      {KEY_BRIGHTNESS_MIN, "KEY_BRIGHTNESS_MIN"},
+      {KEY_BRIGHTNESS_MAX, "KEY_BRIGHTNESS_MAX"},
+      {KEY_KBDINPUTASSIST_PREV, "KEY_KBDINPUTASSIST_PREV"},
+      {KEY_KBDINPUTASSIST_NEXT, "KEY_KBDINPUTASSIST_NEXT"},
+      {KEY_KBDINPUTASSIST_PREVGROUP, "KEY_KBDINPUTASSIST_PREVGROUP"},
+      {KEY_KBDINPUTASSIST_NEXTGROUP, "KEY_KBDINPUTASSIST_NEXTGROUP"},
+      {KEY_KBDINPUTASSIST_ACCEPT, "KEY_KBDINPUTASSIST_ACCEPT"},
+      {KEY_KBDINPUTASSIST_CANCEL, "KEY_KBDINPUTASSIST_CANCEL"},
+      {KEY_RIGHT_UP, "KEY_RIGHT_UP"},
+      {KEY_RIGHT_DOWN, "KEY_RIGHT_DOWN"},
+      {KEY_LEFT_UP, "KEY_LEFT_UP"},
+      {KEY_LEFT_DOWN, "KEY_LEFT_DOWN"},
+      {KEY_ROOT_MENU, "KEY_ROOT_MENU"},
+      {KEY_MEDIA_TOP_MENU, "KEY_MEDIA_TOP_MENU"},
+      {KEY_NUMERIC_11, "KEY_NUMERIC_11"},
+      {KEY_NUMERIC_12, "KEY_NUMERIC_12"},
+      {KEY_AUDIO_DESC, "KEY_AUDIO_DESC"},
+      {KEY_3D_MODE, "KEY_3D_MODE"},
+      {KEY_NEXT_FAVORITE, "KEY_NEXT_FAVORITE"},
+      {KEY_STOP_RECORD, "KEY_STOP_RECORD"},
+      {KEY_PAUSE_RECORD, "KEY_PAUSE_RECORD"},
+      {KEY_VOD, "KEY_VOD"},
+      {KEY_UNMUTE, "KEY_UNMUTE"},
+      {KEY_FASTREVERSE, "KEY_FASTREVERSE"},
+      {KEY_SLOWREVERSE, "KEY_SLOWREVERSE"},
+      {KEY_DATA, "KEY_DATA"},
+      {KEY_ONSCREEN_KEYBOARD, "KEY_ONSCREEN_KEYBOARD"},
+      {KEY_PRIVACY_SCREEN_TOGGLE, "KEY_PRIVACY_SCREEN_TOGGLE"},
+      {KEY_SELECTIVE_SCREENSHOT, "KEY_SELECTIVE_SCREENSHOT"},
+      {KEY_NEXT_ELEMENT, "KEY_NEXT_ELEMENT"},
+      {KEY_PREVIOUS_ELEMENT, "KEY_PREVIOUS_ELEMENT"},
+      {KEY_AUTOPILOT_ENGAGE_TOGGLE, "KEY_AUTOPILOT_ENGAGE_TOGGLE"},
+      {KEY_MARK_WAYPOINT, "KEY_MARK_WAYPOINT"},
+      {KEY_SOS, "KEY_SOS"},
+      {KEY_NAV_CHART, "KEY_NAV_CHART"},
+      {KEY_FISHING_CHART, "KEY_FISHING_CHART"},
+      {KEY_SINGLE_RANGE_RADAR, "KEY_SINGLE_RANGE_RADAR"},
+      {KEY_DUAL_RANGE_RADAR, "KEY_DUAL_RANGE_RADAR"},
+      {KEY_RADAR_OVERLAY, "KEY_RADAR_OVERLAY"},
+      {KEY_TRADITIONAL_SONAR, "KEY_TRADITIONAL_SONAR"},
+      {KEY_CLEARVU_SONAR, "KEY_CLEARVU_SONAR"},
+      {KEY_SIDEVU_SONAR, "KEY_SIDEVU_SONAR"},
+      {KEY_NAV_INFO, "KEY_NAV_INFO"},
+      {KEY_BRIGHTNESS_MENU, "KEY_BRIGHTNESS_MENU"},
+      {KEY_MACRO1, "KEY_MACRO1"},
+      {KEY_MACRO2, "KEY_MACRO2"},
+      {KEY_MACRO3, "KEY_MACRO3"},
+      {KEY_MACRO4, "KEY_MACRO4"},
+      {KEY_MACRO5, "KEY_MACRO5"},
+      {KEY_MACRO6, "KEY_MACRO6"},
+      {KEY_MACRO7, "KEY_MACRO7"},
+      {KEY_MACRO8, "KEY_MACRO8"},
+      {KEY_MACRO9, "KEY_MACRO9"},
+      {KEY_MACRO10, "KEY_MACRO10"},
+      {KEY_MACRO11, "KEY_MACRO11"},
+      {KEY_MACRO12, "KEY_MACRO12"},
+      {KEY_MACRO13, "KEY_MACRO13"},
+      {KEY_MACRO14, "KEY_MACRO14"},
+      {KEY_MACRO15, "KEY_MACRO15"},
+      {KEY_MACRO16, "KEY_MACRO16"},
+      {KEY_MACRO17, "KEY_MACRO17"},
+      {KEY_MACRO18, "KEY_MACRO18"},
+      {KEY_MACRO19, "KEY_MACRO19"},
+      {KEY_MACRO20, "KEY_MACRO20"},
+      {KEY_MACRO21, "KEY_MACRO21"},
+      {KEY_MACRO22, "KEY_MACRO22"},
+      {KEY_MACRO23, "KEY_MACRO23"},
+      {KEY_MACRO24, "KEY_MACRO24"},
+      {KEY_MACRO25, "KEY_MACRO25"},
+      {KEY_MACRO26, "KEY_MACRO26"},
+      {KEY_MACRO27, "KEY_MACRO27"},
+      {KEY_MACRO28, "KEY_MACRO28"},
+      {KEY_MACRO29, "KEY_MACRO29"},
+      {KEY_MACRO30, "KEY_MACRO30"},
+      {KEY_MACRO_RECORD_START, "KEY_MACRO_RECORD_START"},
+      {KEY_MACRO_RECORD_STOP, "KEY_MACRO_RECORD_STOP"},
+      {KEY_MACRO_PRESET_CYCLE, "KEY_MACRO_PRESET_CYCLE"},
+      {KEY_MACRO_PRESET1, "KEY_MACRO_PRESET1"},
+      {KEY_MACRO_PRESET2, "KEY_MACRO_PRESET2"},
+      {KEY_MACRO_PRESET3, "KEY_MACRO_PRESET3"},
+      {KEY_KBD_LCD_MENU1, "KEY_KBD_LCD_MENU1"},
+      {KEY_KBD_LCD_MENU2, "KEY_KBD_LCD_MENU2"},
+      {KEY_KBD_LCD_MENU3, "KEY_KBD_LCD_MENU3"},
+      {KEY_KBD_LCD_MENU4, "KEY_KBD_LCD_MENU4"},
+      {KEY_KBD_LCD_MENU5, "KEY_KBD_LCD_MENU5"},
+      // Not sent by devices, see wheel_keys.h.
+      {kKeyWheelUp, "KEY_WHEELUP"},
+      {kKeyWheelDown, "KEY_WHEELDOWN"},
+      {kKeyWheelLeft, "KEY_WHEELLEFT"},
+      {kKeyWheelRight, "KEY_WHEELRIGHT"},
   };
 
   std::unordered_map<std::string, int> name_to_keycode_;
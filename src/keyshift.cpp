@@ -18,35 +18,70 @@
 // impossible.
 // So, to test, run this with `sudo timeout 20s ./<binary>`.
 //
+#include <errno.h>
 #include <linux/input.h>
 #include <poll.h>
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <boost/algorithm/string.hpp>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
 #include <expected>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <vector>
 
+#include "axis_mapper.h"
 #include "config_parser.h"
+#include "control_server.h"
+#include "handover.h"
 #include "input_device.h"
+#include "kernel_keymap.h"
 #include "keycode_lookup.h"
 #include "remap_operator.h"
+#include "stats.h"
 #include "utility/argparse.h"
+#include "utility/deadline_timer.h"
 #include "utility/every_n_ms.h"
+#include "utility/file_watcher.h"
 #include "utility/os_level_mutex.h"
 #include "version.h"
 #include "virtual_device.h"
+#include "wheel_keys.h"
+
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+// Generated by keyshift-embed.
+#include "embedded_config.h"
+#endif
 
 // How long to poll for reads before looking for interruptions.
 const int kReadTimeoutMS = 1500;
 
+// Events read at once. A frame is usually well under this.
+const int kReadBatchSize = 64;
+
 // Set to true on interrupts.
 std::atomic<bool> kInterrupted(false);
 
+// Set to true on SIGHUP, to reload the config.
+std::atomic<bool> kReloadRequested(false);
+
+// Set to true on SIGUSR2, to hand over to a new binary.
+std::atomic<bool> kUpgradeRequested(false);
+
+// Loads the config afresh. Used for reloads while running.
+using RemapperLoader = std::function<std::expected<Remapper, std::string>()>;
+
 // Disable echoing input when run in terminal.
 void DisableEcho() {
   struct termios tty;
@@ -65,15 +100,39 @@ std::optional<ArgumentParser> ParseArgs(const int argc, const char** argv) {
   parser.AddBool("help", "Show a short help.");
   parser.AddString(
       "kbd", "Address of the -kbd device to remap in `/dev/input/by-path/`.");
+  parser.AddString("mouse",
+                   "Address of a -mouse device in `/dev/input/by-path/` to "
+                   "grab along with --kbd. Its buttons and wheels go through "
+                   "the config, sharing layers with the keyboard.");
+#ifndef KEYSHIFT_EMBEDDED_CONFIG
   parser.AddString("config",
                    "Config as a semi-colon delimited strings, e.g. 'A=B;B=A'.");
   parser.AddString("config-file", "File with remapping configuration.");
+#endif
   parser.AddBool(
       "dump", "Show internal representation of the parsed config, and exit.");
   parser.AddBool(
       "dry-run",
       "If passed, will not start a service but will only show previews.");
+#ifndef KEYSHIFT_EMBEDDED_CONFIG
+  parser.AddBool("watch",
+                 "Reload the config when --config-file changes. Regardless of "
+                 "this, a SIGHUP also reloads the config.");
+#endif
+  parser.AddString("control-socket",
+                   "Path of a unix socket to accept commands on, e.g. to "
+                   "activate layers or switch profiles. See README.md.");
+  parser.AddBool("filter-scan-codes",
+                 "Do not pass on EV_MSC scan codes. The kernel then stops "
+                 "sending them to keyshift at all, which saves a read per key "
+                 "event.");
+  parser.AddBool("kernel-remap",
+                 "Let the kernel do plain remaps like A = B, by changing the "
+                 "keymap of the device. See README.md.");
   parser.AddBool("version", "Display commit id and exit.");
+  parser.AddString("takeover-fd",
+                   "Internal. Socket to take over a running instance from, set "
+                   "when it upgrades on SIGUSR2.");
 
   parser.Parse(argc, argv);
 
@@ -94,7 +153,12 @@ std::optional<ArgumentParser> ParseArgs(const int argc, const char** argv) {
 std::expected<Remapper, std::string> GetRemapper(
     const std::optional<std::string>& config,
     const std::optional<std::string>& config_file) {
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+  std::vector<std::string> lines(std::begin(kEmbeddedConfig),
+                                 std::end(kEmbeddedConfig));
+#else
   std::vector<std::string> lines;
+#endif
   if (config_file.has_value()) {
     std::ifstream file(config_file.value());
     if (!file.is_open()) {
@@ -124,75 +188,562 @@ void SignalHandler(const int signum) {
   kInterrupted.store(true);
 }
 
-int MainLoop(InputDevice& device, Remapper& remapper, bool echo_inputs) {
+void ReloadSignalHandler(const int) { kReloadRequested.store(true); }
+
+void UpgradeSignalHandler(const int) { kUpgradeRequested.store(true); }
+
+// Copies the counters kept by the Remapper. Must be called within an update.
+void PublishRemapperCounters(const Remapper& remapper, StatsPage& stats_page) {
+  auto& stats = stats_page.stats();
+  const auto& counters = remapper.counters();
+  StatsPage::Set(stats.passthrough, counters.passthrough);
+  StatsPage::Set(stats.remapped, counters.remapped);
+  StatsPage::Set(stats.blocked, counters.blocked);
+  StatsPage::Set(stats.layer_activations, counters.layer_activations);
+  StatsPage::Set(stats.redundant_dropped, counters.redundant_dropped);
+  StatsPage::Set(stats.chatter_suppressed,
+                 remapper.debouncer().total_chatter());
+}
+
+// Writes the events queued on the virtual device, or else writes `through`
+// straight from the caller's buffer, see VirtualDevice::WriteThrough(). Must
+// be called within an update.
+void FlushOutput(VirtualDevice& out_device, KeyshiftStats& stats,
+                 std::span<const struct input_event> through = {}) {
+  const auto on_written = [&stats](const struct input_event& ev) {
+    StatsPage::Add(stats.events_out[ev.type < EV_CNT ? ev.type : EV_SYN]);
+  };
+  const auto result = through.empty()
+                          ? out_device.Flush(on_written)
+                          : out_device.WriteThrough(through, on_written);
+  if (result == VirtualDevice::FlushResult::kBlocked) [[unlikely]] {
+    // The rest is written once the device polls POLLOUT.
+    StatsPage::Add(stats.write_blocked);
+  } else if (result == VirtualDevice::FlushResult::kFailed) [[unlikely]] {
+    StatsPage::Add(stats.write_failures);
+  }
+}
+
+// Executes a command received on the control socket.
+std::string HandleControlCommand(const std::string& command,
+                                 Remapper& remapper, StatsPage& stats_page) {
+  StatsPage::Add(stats_page.stats().control_commands);
+  std::istringstream iss(command);
+  std::string verb, argument;
+  iss >> verb;
+  std::getline(iss >> std::ws, argument);
+
+  if (verb == "activate") {
+    if (!remapper.ActivateState(argument)) {
+      return "ERROR No such state, or already active: " + argument;
+    }
+    return "OK";
+  }
+  if (verb == "deactivate") {
+    if (!remapper.DeactivateState(argument)) {
+      return "ERROR Not active: " + argument;
+    }
+    return "OK";
+  }
+  if (verb == "profile") {
+    if (!remapper.SelectProfile(argument)) {
+      return "ERROR No such profile: " + argument;
+    }
+    return "OK";
+  }
+  if (verb == "status") {
+    auto state = remapper.GetState();
+    std::sort(state.keys_held.begin(), state.keys_held.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return lhs.second < rhs.second;
+              });
+    std::ostringstream oss;
+    oss << "profile " << state.profile_name << "\nprofiles";
+    for (const auto& profile_name : remapper.ProfileNames()) {
+      oss << " " << profile_name;
+    }
+    oss << "\nlayers";
+    for (const auto& layer : state.active_layers) {
+      oss << " " << layer.state_name;
+    }
+    oss << "\nheld";
+    for (const auto& [key_code, seq_num] : state.keys_held) {
+      oss << " " << KeyCodeToName(key_code);
+    }
+    oss << "\nOK";
+    return oss.str();
+  }
+  if (verb == "counters") {
+    // Commands are handled within an update, so the remapper counters may be
+    // ahead of the page.
+    PublishRemapperCounters(remapper, stats_page);
+    return FormatStats(ReadStatsUnlocked(stats_page.stats())) + "OK";
+  }
+  if (verb == "chords") {
+    std::ostringstream oss;
+    for (const auto& chord : remapper.chord_stats()) {
+      for (std::size_t i = 0; i < chord.key_codes.size(); ++i) {
+        oss << (i > 0 ? " & " : "") << KeyCodeToName(chord.key_codes[i]);
+      }
+      oss << ": fired " << chord.fired << ", typed through "
+          << chord.typed_through << ", delay total " << chord.delay_us
+          << "us, max " << chord.max_delay_us << "us\n";
+    }
+    oss << "OK";
+    return oss.str();
+  }
+  if (verb == "chatter") {
+    const auto& debouncer = remapper.debouncer();
+    std::ostringstream oss;
+    for (const auto& [key_code, count] : debouncer.ChatterCounts()) {
+      oss << KeyCodeToName(key_code) << ": " << count << ", window "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 debouncer.window(key_code))
+                 .count()
+          << "ms\n";
+    }
+    oss << "OK";
+    return oss.str();
+  }
+  if (verb == "reload") {
+    kReloadRequested.store(true);
+    return "OK";
+  }
+  if (verb == "upgrade") {
+    kUpgradeRequested.store(true);
+    return "OK";
+  }
+  return "ERROR Unknown command. Available: activate STATE, deactivate STATE, "
+         "profile NAME, status, counters, chords, chatter, reload, "
+         "upgrade";
+}
+
+// Builds a Remapper with the new config on the side, and swaps it in between
+// two events. Keys held and layers active are carried over. The devices, and
+// therefore the grab, are not touched.
+void ReloadConfig(Remapper& remapper, const RemapperLoader& load_remapper) {
+  const auto start_time = std::chrono::steady_clock::now();
+  // Keys held back for chords are not part of the state carried over.
+  remapper.FlushChords();
+  auto new_remapper = load_remapper();
+  if (!new_remapper) {
+    std::cerr << "ERROR: Reload failed, continuing with the old config. "
+              << new_remapper.error() << std::endl;
+    return;
+  }
+  const auto loaded_time = std::chrono::steady_clock::now();
+  new_remapper->RestoreState(remapper.GetState());
+  remapper = std::move(new_remapper.value());
+  const auto swapped_time = std::chrono::steady_clock::now();
+
+  std::cout << "Config reloaded. Load: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   loaded_time - start_time)
+                   .count()
+            << "us, swap: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   swapped_time - loaded_time)
+                   .count()
+            << "us." << std::endl;
+}
+
+// Sets up the AxisMapper for the axes the config maps, with the ranges of the
+// device's axes.
+void MapAxes(const Remapper& remapper, const DeviceCapabilities& capabilities,
+             AxisMapper& axis_mapper) {
+  axis_mapper.Clear();
+  for (const auto& mapping : remapper.axis_mappings()) {
+    if (!capabilities.Has(EV_ABS, mapping.axis) ||
+        !axis_mapper.Map(mapping, capabilities.abs_info[mapping.axis])) {
+      std::cerr << "WARNING: The device has no axis "
+                << AxisCodeToName(mapping.axis) << "." << std::endl;
+    }
+  }
+}
+
+// Everything the main loop serves besides the input device.
+struct LoopServices {
+  RemapperLoader load_remapper;
+  // Sets up the AxisMapper and the WheelKeys for the config of the remapper.
+  std::function<void()> map_inputs;
+  // Returns only if the upgrade failed.
+  std::function<void()> upgrade_binary;
+  // Optional.
+  FileWatcher* config_watcher = nullptr;
+  // Optional.
+  ControlServer* control_server = nullptr;
+};
+
+// Key events go through the remapper, as do samples of axes mapped by
+// axis_mapper once they cross a threshold, and notches of wheels mapped by
+// wheel_keys. Everything else is forwarded to out_device as is, within the
+// same frames. out_device is null for a dry run, where nothing is forwarded.
+//
+// The events of mouse, if not null, go through the same remapper and out to
+// the same out_device, so that its buttons share layers with the keyboard.
+int MainLoop(InputDevice& device, InputDevice* mouse,
+             VirtualDevice* out_device, Remapper& remapper,
+             AxisMapper& axis_mapper, const WheelKeys& wheel_keys,
+             bool echo_inputs, const LoopServices& services,
+             StatsPage& stats_page) {
   // Set up handlers which will set kInterrupded on any error.
   std::signal(SIGINT, SignalHandler);
   std::signal(SIGTERM, SignalHandler);
-  std::signal(SIGHUP, SignalHandler);
+  std::signal(SIGHUP, ReloadSignalHandler);
+  std::signal(SIGUSR2, UpgradeSignalHandler);
 
   // Most of the mess below is to set up timeouts. Had we not needed that, we'd
   // just change the if to while and put the kInterrupted detection within it.
   // However, without this, SIGTERM will wait indefinitely during poweroff until
   // a key is pressed - we don't want that.
-  const int fd = device.get_fd();
 
-  struct pollfd fds[1];
-  fds[0].fd = fd;
-  fds[0].events = POLLIN;
+  // Index 0 is the device, 1 the config watcher, 2 the virtual device while
+  // writes are blocked, 3 the timer, 4 the mouse, and the rest are for the
+  // control server.
+  std::vector<struct pollfd> fds;
+  fds.reserve(16);
+
+  // Wakes up for chords, repeats and debouncing, see
+  // Remapper::NextDeadline().
+  DeadlineTimer timer;
+
+  std::array<struct input_event, kReadBatchSize> events;
+  auto& stats = stats_page.stats();
+
+  // Queues events which do not go through the remapper.
+  const auto forward = [&](std::span<const struct input_event> forwarded) {
+    if (out_device != nullptr && !out_device->QueueEvents(forwarded))
+        [[unlikely]] {
+      StatsPage::Add(stats.output_overflows, forwarded.size());
+    }
+  };
+
+  // After a SYN_DROPPED, events are discarded up to the next SYN_REPORT, as
+  // the frame is incomplete. Then the remapper is brought in line with the
+  // keys actually held, and those of the axes where they are.
+  const auto resync = [&]() {
+    auto keys_down = device.GetKeysDown();
+    if (!keys_down) return;
+    if (mouse != nullptr) {
+      const auto buttons_down = mouse->GetKeysDown();
+      if (!buttons_down) return;
+      keys_down->insert(keys_down->end(), buttons_down->begin(),
+                        buttons_down->end());
+    }
+    if (!axis_mapper.empty()) {
+      axis_mapper.Resync(
+          [&device](int code) { return device.GetAxisValue(code); });
+      const auto axis_keys = axis_mapper.KeysDown();
+      keys_down->insert(keys_down->end(), axis_keys.begin(), axis_keys.end());
+    }
+    remapper.Resync(*keys_down);
+    if (out_device != nullptr) out_device->EndFrame();
+  };
+
+  // Keys of axes which crossed a threshold.
+  const auto process_axis_key = [&](int key_code, int value) {
+    if (echo_inputs) [[unlikely]] {
+      std::cout << "In: " << (value == 1 ? "P " : "R ")
+                << KeyCodeToName(key_code) << " (axis)" << std::endl;
+    }
+    remapper.Process(key_code, value);
+  };
+
+  // Notches of wheels, as a press and a release each.
+  const auto process_wheel_key = [&](int key_code, int value) {
+    if (echo_inputs) [[unlikely]] {
+      std::cout << "In: " << (value == 1 ? "P " : "R ")
+                << KeyCodeToName(key_code) << std::endl;
+    }
+    remapper.Process(key_code, value);
+  };
+
+  // For key events emitted outside of a frame read, e.g. on reloads.
+  const auto flush_all = [&]() {
+    if (out_device == nullptr) return;
+    out_device->EndFrame();
+    FlushOutput(*out_device, stats);
+  };
+
+  // Must be called within an update.
+  const auto reload = [&]() {
+    const bool had_axes = !axis_mapper.empty();
+    ReloadConfig(remapper, services.load_remapper);
+    services.map_inputs();
+    // Keys of axes no longer mapped are released, and those newly mapped
+    // pressed where the axes are.
+    if (had_axes || !axis_mapper.empty()) resync();
+    StatsPage::Add(stats.reloads);
+    flush_all();
+  };
+
+  // Axes may rest away from their center, or be held on a takeover.
+  if (!axis_mapper.empty()) {
+    stats_page.BeginUpdate();
+    resync();
+    flush_all();
+    stats_page.EndUpdate();
+  }
+
+  // Events of each device are discarded after a SYN_DROPPED, see resync.
+  bool discarding_keyboard = false;
+  bool discarding_mouse = false;
+  // The device read last. A frame left incomplete by one device is ended
+  // before events of the other are added.
+  const InputDevice* last_read = &device;
+
+  // Reads a batch of events of input, and processes them. Must be called
+  // within an update.
+  const auto read_events = [&](InputDevice& input, bool& discarding) {
+    if (out_device != nullptr && &input != last_read) out_device->EndFrame();
+    last_read = &input;
+    const ssize_t bytes = read(input.get_fd(), events.data(), sizeof(events));
+    if (bytes <= 0) [[unlikely]] {
+      StatsPage::Add(stats.read_failures);
+      // Happens at an alarming rate sometimes!
+      // Counted 1102381 lines in log in a few minites.
+      // EVEY_N_MS ensures we do not spam the journal.
+      EVERY_N_MS_W_SUPPRESSED(500, perror("Failed read"));
+      return;
+    }
+    const auto batch =
+        std::span(events.data(), bytes / sizeof(struct input_event));
+    // Events since the last key event, which are forwarded as is.
+    std::size_t unforwarded = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      const auto& ie = batch[i];
+      StatsPage::Add(stats.events_in[ie.type < EV_CNT ? ie.type : EV_SYN]);
+      if (discarding) [[unlikely]] {
+        StatsPage::Add(stats.events_discarded);
+        unforwarded = i + 1;
+        if (ie.type == EV_SYN && ie.code == SYN_REPORT) {
+          discarding = false;
+          resync();
+        }
+        continue;
+      }
+      if (ie.type == EV_SYN && ie.code == SYN_DROPPED) [[unlikely]] {
+        StatsPage::Add(stats.syn_dropped);
+        // Complete frames before it are still forwarded.
+        const auto run = batch.subspan(unforwarded, i - unforwarded);
+        const auto last_report =
+            std::find_if(run.rbegin(), run.rend(), [](const auto& event) {
+              return event.type == EV_SYN && event.code == SYN_REPORT;
+            });
+        const std::size_t complete = run.rend() - last_report;
+        forward(run.first(complete));
+        StatsPage::Add(stats.events_discarded, run.size() - complete + 1);
+        unforwarded = i + 1;
+        discarding = true;
+        continue;
+      }
+      if (ie.type == EV_ABS && axis_mapper.Maps(ie.code)) {
+        // Not forwarded. Keys pressed come in order with the rest.
+        forward(batch.subspan(unforwarded, i - unforwarded));
+        unforwarded = i + 1;
+        axis_mapper.Process(ie.code, ie.value, process_axis_key);
+        continue;
+      }
+      // Pointer motion is not taken, so it stays within the runs forwarded.
+      if (ie.type == EV_REL && wheel_keys.Maps(ie.code)) {
+        forward(batch.subspan(unforwarded, i - unforwarded));
+        unforwarded = i + 1;
+        wheel_keys.Process(ie.code, ie.value, process_wheel_key);
+        continue;
+      }
+      if (ie.type != EV_KEY) continue;
+      if (ie.value == 1) StatsPage::Add(stats.key_presses);
+
+      // Keep the order of events within the frame.
+      forward(batch.subspan(unforwarded, i - unforwarded));
+      unforwarded = i + 1;
+
+      if (echo_inputs) [[unlikely]] {
+        std::cout << "In: ";
+        std::cout << (ie.value == 1   ? "P "
+                      : ie.value == 0 ? "R "
+                                      : "T ")
+                  << KeyCodeToName(ie.code);
+        std::cout << std::endl;
+      }
 
-  struct input_event ie;
+      // This will call the function set with SetCallback() as new key
+      // events are generated.
+      const auto start_time = std::chrono::steady_clock::now();
+      remapper.Process(ie.code, ie.value);
+      stats_page.AddLatency(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start_time)
+              .count());
+    }
+    PublishRemapperCounters(remapper, stats_page);
+    if (out_device == nullptr) return;
+    if (unforwarded == 0 && out_device->empty()) {
+      // Nothing of the batch went elsewhere, e.g. as it is pointer motion
+      // only, so it is written straight from the read buffer.
+      FlushOutput(*out_device, stats, batch);
+    } else {
+      forward(batch.subspan(unforwarded));
+      // An incomplete frame at the end is kept until the rest of it is
+      // read.
+      FlushOutput(*out_device, stats);
+    }
+  };
 
   while (true) {
     // Gracefully exit on interruption.
     if (kInterrupted.load()) [[unlikely]]
       return 2;
 
-    const int poll_ret = poll(fds, 1, kReadTimeoutMS);
+    if (kReloadRequested.exchange(false)) [[unlikely]] {
+      stats_page.BeginUpdate();
+      reload();
+      stats_page.EndUpdate();
+    }
+    if (kUpgradeRequested.exchange(false)) [[unlikely]] {
+      stats_page.BeginUpdate();
+      remapper.FlushChords();
+      flush_all();
+      stats_page.EndUpdate();
+      services.upgrade_binary();
+    }
+
+    fds.clear();
+    fds.push_back({device.get_fd(), POLLIN, 0});
+    // Negative fds are ignored by poll().
+    fds.push_back({services.config_watcher != nullptr
+                       ? services.config_watcher->get_fd()
+                       : -1,
+                   POLLIN, 0});
+    fds.push_back({out_device != nullptr && out_device->HasPending()
+                       ? out_device->get_fd()
+                       : -1,
+                   POLLOUT, 0});
+    fds.push_back({timer.get_fd(), POLLIN, 0});
+    fds.push_back({mouse != nullptr ? mouse->get_fd() : -1, POLLIN, 0});
+    if (services.control_server != nullptr) {
+      services.control_server->AddPollFds(fds);
+    }
+    timer.Set(remapper.NextDeadline());
+
+    const int poll_ret = poll(fds.data(), fds.size(), kReadTimeoutMS);
     switch (poll_ret) {
       [[unlikely]] case -1:
-        // This can also occur when the interrupt happens amidst system call.
-        // perror(x) will show "x: Interrupted system call".
+        // Signals interrupt the poll. Those are handled at the top of the loop.
+        if (errno == EINTR) continue;
         perror("ERROR reading device");
         return 1;
       case 0:
         // Timeout.
         break;
       default:
-        // There is data to be read, and the read is no longer blocking.
-        if (read(fd, &ie, sizeof(struct input_event)) > 0) [[likely]] {
-          if (ie.type != EV_KEY) continue;
-
-          if (echo_inputs) [[unlikely]] {
-            std::cout << "In: ";
-            std::cout << (ie.value == 1   ? "P "
-                          : ie.value == 0 ? "R "
-                                          : "T ")
-                      << KeyCodeToName(ie.code);
-            std::cout << std::endl;
+        // Before reading, so that events come after what was due before them.
+        if (fds[3].revents & POLLIN) [[unlikely]] {
+          if (const auto due = timer.Consume()) {
+            const auto late = std::chrono::steady_clock::now() - *due;
+            stats_page.BeginUpdate();
+            stats_page.AddTimerJitter(std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::microseconds>(late)
+                       .count()));
+            remapper.Tick();
+            PublishRemapperCounters(remapper, stats_page);
+            flush_all();
+            stats_page.EndUpdate();
           }
-
-          // This will call the function set with SetCallback() as new key
-          // events are generated.
-          remapper.Process(ie.code, ie.value);
-        } else [[unlikely]] {
-          // Happens at an alarming rate sometimes!
-          // Counted 1102381 lines in log in a few minites.
-          // EVEY_N_MS ensures we do not spam the journal.
-          EVERY_N_MS_W_SUPPRESSED(500, perror("Failed read"));
+        }
+        if (fds[1].revents & POLLIN) [[unlikely]] {
+          if (services.config_watcher->ConsumeEvents()) {
+            stats_page.BeginUpdate();
+            reload();
+            stats_page.EndUpdate();
+          }
+        }
+        if (services.control_server != nullptr) {
+          // Commands may release keys, or read the stats.
+          stats_page.BeginUpdate();
+          services.control_server->HandlePollFds(
+              std::span(fds.begin() + 5, fds.end()));
+          PublishRemapperCounters(remapper, stats_page);
+          flush_all();
+          stats_page.EndUpdate();
+        }
+        if (fds[2].revents & POLLOUT) [[unlikely]] {
+          stats_page.BeginUpdate();
+          FlushOutput(*out_device, stats);
+          stats_page.EndUpdate();
+        }
+        if (fds[0].revents != 0) {
+          // There is data to be read, and the read is no longer blocking.
+          stats_page.BeginUpdate();
+          read_events(device, discarding_keyboard);
+          stats_page.EndUpdate();
+        }
+        if (fds[4].revents != 0) {
+          stats_page.BeginUpdate();
+          read_events(*mouse, discarding_mouse);
+          stats_page.EndUpdate();
         }
     }
   }
 }
 
+// Moves the plain remaps of the config to the keymap of the device, and
+// removes them from the remapper, which then no longer sees the original keys.
+// The keymap is only changed if the remaps differ from the current ones. Keys
+// the mouse has too are left to the remapper, as the keymap is the keyboard's.
+void OffloadPureRemaps(int device_fd,
+                       const DeviceCapabilities& mouse_capabilities,
+                       Remapper& remapper,
+                       std::unique_ptr<KernelKeymap>& kernel_keymap) {
+  auto remaps = remapper.PureRemaps();
+  std::erase_if(remaps, [&mouse_capabilities](const auto& remap) {
+    return mouse_capabilities.Has(EV_KEY, remap.first);
+  });
+  if (!kernel_keymap || kernel_keymap->requested() != remaps) {
+    // Restore the original keymap before changing it again.
+    kernel_keymap.reset();
+    kernel_keymap = std::make_unique<KernelKeymap>(device_fd, remaps);
+    std::cout << "Kernel remaps " << kernel_keymap->applied().size() << " of "
+              << remaps.size() << " plain remaps." << std::endl;
+  }
+  for (const auto& [from, to] : kernel_keymap->applied()) {
+    remapper.RemoveBaseMappings(from);
+  }
+}
+
+// Precomputes how keys resolve on each stack of layers. If there are too many
+// stacks, layers are walked instead.
+void CompileLayers(Remapper& remapper) {
+  if (!remapper.CompileLayerStacks()) return;
+  const auto stats = remapper.layer_stack_stats().value();
+  std::cout << "Compiled " << stats.stacks << " layer stacks to "
+            << stats.tables << " tables, about " << stats.bytes << " bytes."
+            << std::endl;
+}
+
 int main(const int argc, const char** argv) {
   auto args_opt = ParseArgs(argc, argv);
   if (!args_opt) return 0;
   auto args = args_opt.value();
   const bool arg_dump = args.GetBool("dump");
   const bool arg_dry_run = args.GetBool("dry-run");
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+  // The config is built in.
+  const std::optional<std::string> arg_config;
+  const std::optional<std::string> arg_config_file;
+  const bool arg_watch = false;
+#else
   const std::optional<std::string> arg_config = args.GetString("config");
   const std::optional<std::string> arg_config_file =
       args.GetString("config-file");
+  const bool arg_watch = args.GetBool("watch");
+#endif
+  const bool arg_filter_scan_codes = args.GetBool("filter-scan-codes");
+  const bool arg_kernel_remap = args.GetBool("kernel-remap");
+  const std::optional<std::string> arg_control_socket =
+      args.GetString("control-socket");
+  const std::optional<std::string> arg_takeover_fd =
+      args.GetString("takeover-fd");
 
   auto remapper_exc = GetRemapper(arg_config, arg_config_file);
   if (!remapper_exc) {
@@ -201,9 +752,19 @@ int main(const int argc, const char** argv) {
   }
   Remapper remapper = std::move(remapper_exc.value());
   if (arg_dump) {
+    const std::size_t parsed_bytes = remapper.MemoryUsage();
+    const OptimizeStats optimized = remapper.Optimize();
+    const std::size_t optimized_bytes = remapper.MemoryUsage();
+    remapper.CompileLayerStacks();
     remapper.DumpConfig();
+    std::cout << "Optimized: dropped " << optimized.passthroughs_dropped
+              << " passthroughs, merged " << optimized.action_lists_merged
+              << " action lists" << std::endl;
+    std::cout << "Memory: about " << parsed_bytes << " bytes as parsed, "
+              << optimized_bytes << " bytes optimized" << std::endl;
     return EXIT_SUCCESS;
   }
+  remapper.Optimize();
 
   const auto arg_kbd_opt = args.GetString("kbd");
   if (!arg_kbd_opt.has_value()) {
@@ -214,9 +775,27 @@ int main(const int argc, const char** argv) {
   }
 
   const std::string arg_kbd = arg_kbd_opt.value();
+  const std::optional<std::string> arg_mouse = args.GetString("mouse");
+
+  std::optional<Handover> handover;
+  if (arg_takeover_fd.has_value()) {
+    if (arg_dry_run) {
+      std::cerr << "ERROR: Cannot take over in dry-run." << std::endl;
+      return EXIT_FAILURE;
+    }
+    handover = ReceiveHandover(std::stoi(arg_takeover_fd.value()));
+    if (!handover) return EXIT_FAILURE;
+    if ((handover->mouse_fd >= 0) != arg_mouse.has_value()) {
+      std::cerr << "ERROR: The previous instance had a different --mouse."
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
   std::optional<OSMutex> mutex;
   // Use mutex only if this is not dry-run and we intend to grab the device.
-  if (!arg_dry_run) {
+  // On a takeover, the device is already grabbed.
+  if (!arg_dry_run && !handover) {
     mutex = AcquireOSMutex("keyshift_" + arg_kbd);
     if (!mutex) {
       std::cerr << "Another instance is starting for specified kbd, exiting."
@@ -224,12 +803,63 @@ int main(const int argc, const char** argv) {
       return EXIT_FAILURE;
     }
   }
-  InputDevice device(arg_kbd.c_str());
-  VirtualDevice out_device;
+  std::unique_ptr<FileWatcher> config_watcher;
+  if (arg_watch) {
+    if (!arg_config_file.has_value()) {
+      std::cerr << "ERROR: --watch needs --config-file." << std::endl;
+      return EXIT_FAILURE;
+    }
+    config_watcher = std::make_unique<FileWatcher>(arg_config_file.value());
+  }
 
+  InputDevice device = handover ? InputDevice(handover->input_fd)
+                                : InputDevice(arg_kbd.c_str());
+  // The mask stays with the device on a takeover, so it is set either way.
+  if (arg_filter_scan_codes || handover) {
+    device.SetEventTypeMasked(EV_MSC, arg_filter_scan_codes);
+  }
+  std::unique_ptr<InputDevice> mouse;
+  DeviceCapabilities mouse_capabilities;
+  if (arg_mouse.has_value()) {
+    mouse = handover ? std::make_unique<InputDevice>(handover->mouse_fd)
+                     : std::make_unique<InputDevice>(arg_mouse->c_str());
+    mouse_capabilities = mouse->GetCapabilities();
+  }
+
+  // The virtual device can send whatever the grabbed ones can, and what the
+  // config adds. Wheel keys are sent as notches of the wheel.
+  const DeviceCapabilities in_capabilities = device.GetCapabilities();
+  DeviceCapabilities out_capabilities = in_capabilities;
+  out_capabilities.Merge(mouse_capabilities);
+  const auto can_emit = [&out_capabilities](int key_code) {
+    return IsWheelKey(key_code)
+               ? out_capabilities.Has(EV_REL, WheelNotch(key_code).first)
+               : out_capabilities.Has(EV_KEY, key_code);
+  };
+  for (const int key_code : remapper.EmittedKeyCodes()) {
+    if (IsWheelKey(key_code)) {
+      out_capabilities.Add(EV_REL, WheelNotch(key_code).first);
+    } else {
+      out_capabilities.Add(EV_KEY, key_code);
+    }
+  }
+  VirtualDevice out_device = handover ? VirtualDevice(handover->uinput_fd)
+                                      : VirtualDevice(out_capabilities);
+
+  // A dry run must not clobber the stats of an instance running for real. On
+  // a takeover, the counters of the previous instance are continued.
+  std::unique_ptr<StatsPage> stats_page =
+      arg_dry_run ? std::make_unique<StatsPage>()
+                  : std::make_unique<StatsPage>(arg_kbd, handover.has_value());
+  auto& stats = stats_page->stats();
+
+  std::unique_ptr<KernelKeymap> kernel_keymap;
+  std::function<void(int, int)> emit_fn;
+  std::function<void()> flush_fn;
   if (arg_dry_run) {
     DisableEcho();
-    auto echo_on_emit_fn = [](int key_code, int press) {
+    emit_fn = [&stats](int key_code, int press) {
+      StatsPage::Add(stats.events_out[EV_KEY]);
       std::cout << "  Out: ";
       std::cout << (press == 1   ? "P "
                     : press == 0 ? "R "
@@ -237,22 +867,124 @@ int main(const int argc, const char** argv) {
                 << KeyCodeToName(key_code);
       std::cout << std::endl;
     };
-    remapper.SetCallback(echo_on_emit_fn);
+    remapper.SetCallback(emit_fn);
     printf("Dryrun - processing disabled, echo enabled.\n");
   } else {
-    remapper.SetCallback([&out_device](int code, int value) {
-      out_device.DoKeyEvent(code, value);
-    });
+    // Written along with the rest of the frame being processed.
+    emit_fn = [&out_device, &out_capabilities](int code, int value) {
+      if (IsWheelKey(code)) [[unlikely]] {
+        // A notch for each press or repeat, along with the finer steps if
+        // the wheel has them.
+        if (value == 0) return;
+        const auto [rel_code, direction] = WheelNotch(code);
+        out_device.QueueEvent(EV_REL, rel_code, direction);
+        if (out_capabilities.Has(EV_REL, HiResCode(rel_code))) {
+          out_device.QueueEvent(EV_REL, HiResCode(rel_code),
+                                direction * kHiResPerNotch);
+        }
+        return;
+      }
+      out_device.QueueEvent(EV_KEY, code, value);
+    };
+    flush_fn = [&out_device, &stats]() {
+      out_device.EndFrame();
+      FlushOutput(out_device, stats);
+    };
+    remapper.SetCallback(emit_fn);
+    remapper.SetFlushCallback(flush_fn);
+    if (handover) {
+      remapper.RestoreState(handover->state);
+      printf("Took over from the previous instance.\n");
+    }
     device.Grab();
+    if (mouse) mouse->Grab();
     // Preserve the mutex only until a device has been grabbed.
     // This helps to not maintain the file in /dev/shm.
     // Also it is sufficeint to ensure if multiple calls happen during
     // initialization, e.g. because of udev rules matching multiple times, they
     // are blocked.
     mutex.reset();
+    if (arg_kernel_remap) {
+      OffloadPureRemaps(device.get_fd(), mouse_capabilities, remapper,
+                        kernel_keymap);
+    }
     printf("Processing enabled.\n");
   }
+  CompileLayers(remapper);
+
+  const RemapperLoader load_remapper =
+      [&]() -> std::expected<Remapper, std::string> {
+    auto new_remapper = GetRemapper(arg_config, arg_config_file);
+    if (new_remapper) {
+      new_remapper->Optimize();
+      new_remapper->SetCallback(emit_fn);
+      new_remapper->SetFlushCallback(flush_fn);
+      if (kernel_keymap) {
+        OffloadPureRemaps(device.get_fd(), mouse_capabilities, *new_remapper,
+                          kernel_keymap);
+      }
+      CompileLayers(*new_remapper);
+      // The virtual device cannot be changed without a restart.
+      for (const int key_code : new_remapper->EmittedKeyCodes()) {
+        if (!can_emit(key_code)) {
+          std::cerr << "WARNING: " << KeyCodeToName(key_code)
+                    << " cannot be sent until keyshift is restarted."
+                    << std::endl;
+        }
+      }
+    }
+    return new_remapper;
+  };
 
-  // Control returns from MainLoop only if interrupted or killed.
-  return MainLoop(device, remapper, arg_dry_run);
+  const std::vector<std::string> original_args(argv, argv + argc);
+  const auto upgrade_binary = [&]() {
+    if (arg_dry_run) {
+      std::cerr << "ERROR: Upgrade is not supported in dry-run." << std::endl;
+      return;
+    }
+    // The new instance sets up the keymap again from the original one.
+    std::vector<std::pair<int, int>> kernel_remaps;
+    if (kernel_keymap) {
+      kernel_remaps = kernel_keymap->requested();
+      kernel_keymap.reset();
+    }
+    ExecWithHandover(GetExecutablePath(), original_args,
+                     Handover{device.get_fd(), out_device.get_fd(),
+                              remapper.GetState(),
+                              mouse ? mouse->get_fd() : -1});
+    std::cerr << "ERROR: Upgrade failed, continuing." << std::endl;
+    if (arg_kernel_remap) {
+      kernel_keymap =
+          std::make_unique<KernelKeymap>(device.get_fd(), kernel_remaps);
+    }
+  };
+
+  AxisMapper axis_mapper;
+  WheelKeys wheel_keys;
+  const auto map_inputs = [&]() {
+    MapAxes(remapper, in_capabilities, axis_mapper);
+    wheel_keys.Map(remapper.InputKeyCodes());
+  };
+  map_inputs();
+
+  std::unique_ptr<ControlServer> control_server;
+  if (arg_control_socket.has_value()) {
+    control_server = std::make_unique<ControlServer>(
+        arg_control_socket.value(), [&](const std::string& command) {
+          return HandleControlCommand(command, remapper, *stats_page);
+        });
+  }
+
+  // Control returns from MainLoop only if interrupted or killed. The kill combo
+  // throws, and is caught so that the keymap of the device is restored.
+  try {
+    return MainLoop(device, mouse.get(), arg_dry_run ? nullptr : &out_device,
+                    remapper, axis_mapper, wheel_keys, arg_dry_run,
+                    LoopServices{load_remapper, map_inputs, upgrade_binary,
+                                 config_watcher.get(), control_server.get()},
+                    *stats_page);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
 }
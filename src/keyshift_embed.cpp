@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generates embedded_config.h from a config, for builds with
+// KEYSHIFT_EMBEDDED_CONFIG. It holds the config itself, and the compiled layer
+// tables as switch statements, which the compiler turns into jump tables.
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "config_parser.h"
+#include "remap_operator.h"
+#include "utility/argparse.h"
+
+// As a C++ string literal.
+std::string Quote(const std::string& str) {
+  std::string quoted = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (c < ' ' || c == 0x7f) {
+      char escaped[5];
+      snprintf(escaped, sizeof(escaped), "\\%03o", (unsigned char)c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+std::string Describe(Instruction instruction) {
+  std::ostringstream oss;
+  const Action action = DecompileInstruction(instruction);
+  if (std::holds_alternative<KeyEvent>(action)) {
+    oss << std::get<KeyEvent>(action);
+  } else if (std::holds_alternative<ActionLayerChange>(action)) {
+    oss << "Layer Change: " << std::get<ActionLayerChange>(action).layer_index;
+  } else {
+    oss << "Wait: " << std::get<ActionWait>(action).milli_seconds << "ms";
+  }
+  return oss.str();
+}
+
+void Generate(const std::string& config_file,
+              const std::vector<std::string>& lines, const Remapper& remapper,
+              std::ostream& os) {
+  const auto tables = remapper.ExportLayerTables();
+
+  // Each distinct action list once.
+  std::vector<Instruction> program;
+  std::map<std::vector<Instruction>, std::size_t> offsets;
+  for (const auto& table : tables) {
+    for (const auto& [key_event, instructions] : table.entries) {
+      if (offsets.try_emplace(instructions, program.size()).second) {
+        program.insert(program.end(), instructions.begin(), instructions.end());
+      }
+    }
+  }
+
+  os << "// Generated by keyshift-embed from " << config_file
+     << ". Do not edit.\n"
+     << "#ifndef __EMBEDDED_CONFIG_H\n"
+     << "#define __EMBEDDED_CONFIG_H\n\n"
+     << "#include <cstdint>\n"
+     << "#include <optional>\n"
+     << "#include <span>\n\n"
+     << "#include \"remap_operator.h\"\n\n";
+
+  os << "inline constexpr const char* kEmbeddedConfig[] = {\n";
+  for (const auto& line : lines) os << "    " << Quote(line) << ",\n";
+  os << "};\n\n";
+
+  os << "inline constexpr uint64_t kEmbeddedFingerprint = "
+     << remapper.LayerStacksFingerprint() << "ull;\n\n";
+
+  os << "inline constexpr Instruction kEmbeddedProgram[] = {\n";
+  for (const Instruction instruction : program) {
+    os << "    " << instruction << "u,  // " << Describe(instruction) << "\n";
+  }
+  // Arrays cannot be empty.
+  os << "    0,\n};\n\n";
+
+  os << "inline constexpr bool kEmbeddedAllowOtherKeys[] = {\n";
+  for (const auto& table : tables) {
+    os << "    " << (table.allow_other_keys ? "true" : "false") << ",\n";
+  }
+  os << "};\n\n";
+
+  os << "// Actions of a key event in a compiled table, or nullopt if the\n"
+     << "// table does not have it.\n"
+     << "inline std::optional<std::span<const Instruction>> EmbeddedLookup(\n"
+     << "    int table, int key_code, KeyEventType value) {\n"
+     << "  const std::span<const Instruction> program(kEmbeddedProgram);\n"
+     << "  switch (table) {\n";
+  for (std::size_t table_id = 0; table_id < tables.size(); ++table_id) {
+    os << "    case " << table_id << ":\n"
+       << "      switch (key_code * 4 + int(value)) {\n";
+    for (const auto& [key_event, instructions] : tables[table_id].entries) {
+      os << "        case " << key_event.key_code * 4 + int(key_event.value)
+         << ":  // " << key_event << "\n"
+         << "          return program.subspan(" << offsets[instructions] << ", "
+         << instructions.size() << ");\n";
+    }
+    os << "      }\n"
+       << "      break;\n";
+  }
+  os << "  }\n"
+     << "  return std::nullopt;\n"
+     << "}\n\n"
+     << "#endif  // __EMBEDDED_CONFIG_H\n";
+}
+
+int main(const int argc, const char** argv) {
+  ArgumentParser parser;
+  parser.AddBool("help", "Show a short help.");
+  parser.AddString("config-file", "Config to build into keyshift.");
+  parser.AddString("output", "Header to write, embedded_config.h.");
+  parser.Parse(argc, argv);
+  const auto arg_config_file = parser.GetString("config-file");
+  const auto arg_output = parser.GetString("output");
+  if (parser.GetBool("help") || !arg_config_file || !arg_output) {
+    parser.ShowHelp();
+    return EXIT_SUCCESS;
+  }
+
+  std::ifstream file(arg_config_file.value());
+  if (!file.is_open()) {
+    std::cerr << "ERROR: Could not open " << arg_config_file.value()
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(file, line)) lines.push_back(line);
+
+  // Same as keyshift does when it loads a config.
+  Remapper remapper;
+  ConfigParser config_parser(&remapper);
+  if (!config_parser.Parse(lines)) {
+    std::cerr << "ERROR: Failed to parse " << arg_config_file.value()
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  remapper.Optimize();
+  if (!remapper.CompileLayerStacks()) {
+    std::cerr << "ERROR: Too many stacks of layers to build in." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ostringstream generated;
+  Generate(arg_config_file.value(), lines, remapper, generated);
+  std::ofstream output(arg_output.value());
+  output << generated.str();
+  if (!output) {
+    std::cerr << "ERROR: Could not write " << arg_output.value() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Prints the stats of a running keyshift instance. Reads them from shared
+// memory, so the instance is not disturbed however often this is run.
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "stats.h"
+#include "utility/argparse.h"
+
+int main(const int argc, const char** argv) {
+  ArgumentParser parser;
+  parser.AddBool("help", "Show a short help.");
+  parser.AddString("kbd", "Same --kbd as passed to the keyshift instance.");
+  parser.AddString("interval-ms",
+                   "If passed, keeps printing the stats at this interval.");
+  parser.Parse(argc, argv);
+  const auto arg_kbd = parser.GetString("kbd");
+  if (parser.GetBool("help") || !arg_kbd.has_value()) {
+    parser.ShowHelp();
+    return EXIT_SUCCESS;
+  }
+  const auto arg_interval_ms = parser.GetString("interval-ms");
+
+  const std::string segment_name = StatsSegmentName(arg_kbd.value());
+  const int fd = shm_open(segment_name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    perror(("ERROR: Could not open " + segment_name).c_str());
+    return EXIT_FAILURE;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size != sizeof(KeyshiftStats)) {
+    std::cerr << "ERROR: Stats of a different version of keyshift."
+              << std::endl;
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  void* addr =
+      mmap(nullptr, sizeof(KeyshiftStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    perror("ERROR: mmap failed");
+    return EXIT_FAILURE;
+  }
+  const auto& stats = *static_cast<const KeyshiftStats*>(addr);
+
+  while (true) {
+    const auto snapshot = ReadStats(stats);
+    if (!snapshot) {
+      std::cerr << "ERROR: Could not read the stats consistently."
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << FormatStats(snapshot.value()) << std::flush;
+    if (!arg_interval_ms.has_value()) return EXIT_SUCCESS;
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(std::stoi(arg_interval_ms.value())));
+    std::cout << std::endl;
+  }
+}
@@ -17,25 +17,79 @@
 #include "remap_operator.h"
 
 #include <stdio.h>
+#include <strings.h>
 
 #include <algorithm>
+#include <bit>
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <optional>
+#include <sstream>
 #include <stack>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "keycode_lookup.h"
 #include "utility/essentials.h"
+#include "wheel_keys.h"
+
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+// Generated by keyshift-embed.
+#include "embedded_config.h"
+#endif
 
 const std::string kKillCombo = "KEYSHIFTRESERVEDCMDKILL";
 
+// Longest repeat delay or interval.
+const std::chrono::milliseconds kMaxRepeatTime{60000};
+
+// Longest debounce window. Switches settle within a few ms, so anything much
+// longer drops intended taps.
+const int kMaxDebounceMs = 100;
+
+// Approximate memory held by a std::unordered_map, whose nodes hold a pointer
+// and the hash besides the value.
+template <typename Map>
+std::size_t ApproximateBytes(const Map& map) {
+  return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*)) +
+         map.bucket_count() * sizeof(void*);
+}
+
+// As shown by DumpConfig().
+std::string DescribeRepeat(const RepeatSettings& settings) {
+  switch (settings.mode) {
+    case RepeatSettings::Mode::kOff:
+      return "off";
+    case RepeatSettings::Mode::kRapidFire:
+      return "rapid fire every " + std::to_string(settings.interval.count()) +
+             "ms";
+    case RepeatSettings::Mode::kRepeat:
+      break;
+  }
+  return "after " + std::to_string(settings.delay.count()) + "ms, every " +
+         std::to_string(settings.interval.count()) + "ms";
+}
+
+// Throws std::invalid_argument if out of range.
+void CheckRepeatSettings(const RepeatSettings& settings) {
+  using Mode = RepeatSettings::Mode;
+  if (settings.mode == Mode::kOff) return;
+  // Rapid fire is pressed half of the interval.
+  const auto min_interval = std::chrono::milliseconds(
+      settings.mode == Mode::kRapidFire ? 2 : 1);
+  if (settings.interval < min_interval || settings.interval > kMaxRepeatTime ||
+      settings.delay.count() < 0 || settings.delay > kMaxRepeatTime) {
+    throw std::invalid_argument("Repeat delay or interval out of range");
+  }
+}
+
 KeyEvent KeyPressEvent(int key_code) {
   return KeyEvent{key_code, KeyEventType::kKeyPress};
 }
@@ -44,6 +98,68 @@ KeyEvent KeyReleaseEvent(int key_code) {
   return KeyEvent{key_code, KeyEventType::kKeyRelease};
 }
 
+Instruction CompileAction(const Action& action) {
+  OpCode op_code;
+  int operand;
+  if (std::holds_alternative<KeyEvent>(action)) {
+    const auto& key_event = std::get<KeyEvent>(action);
+    op_code = OpCode(key_event.value);
+    operand = key_event.key_code;
+  } else if (std::holds_alternative<ActionLayerChange>(action)) {
+    op_code = OpCode::kLayerPush;
+    operand = std::get<ActionLayerChange>(action).layer_index;
+  } else {
+    op_code = OpCode::kWait;
+    operand = std::get<ActionWait>(action).milli_seconds;
+  }
+  if (operand < 0 || Instruction(operand) > kOperandMask) {
+    throw std::invalid_argument("Action operand out of range");
+  }
+  return MakeInstruction(op_code, operand);
+}
+
+Action DecompileInstruction(Instruction instruction) {
+  const int operand = GetOperand(instruction);
+  switch (GetOpCode(instruction)) {
+    case OpCode::kRelease:
+    case OpCode::kPress:
+    case OpCode::kRepeat:
+      return KeyEvent{operand, KeyEventType(GetOpCode(instruction))};
+    case OpCode::kLayerPush:
+      return ActionLayerChange{operand};
+    case OpCode::kWait:
+      break;
+  }
+  return ActionWait{operand};
+}
+
+// Names of modifiers by bit, in the order they are shown.
+constexpr std::pair<ModifierMask, const char*> kModifierNames[] = {
+    {kModifierLeftShift, "LShift"}, {kModifierRightShift, "RShift"},
+    {kModifierShift, "Shift"},      {kModifierLeftCtrl, "LCtrl"},
+    {kModifierRightCtrl, "RCtrl"},  {kModifierCtrl, "Ctrl"},
+    {kModifierLeftAlt, "LAlt"},     {kModifierRightAlt, "RAlt"},
+    {kModifierAlt, "Alt"},          {kModifierLeftMeta, "LMeta"},
+    {kModifierRightMeta, "RMeta"},  {kModifierMeta, "Meta"},
+};
+
+std::optional<ModifierMask> ModifierNameToMask(const std::string& name) {
+  for (const auto& [mask, modifier_name] : kModifierNames) {
+    if (strcasecmp(name.c_str(), modifier_name) == 0) return mask;
+  }
+  return std::nullopt;
+}
+
+std::string ModifierMaskToName(ModifierMask mask) {
+  std::string name;
+  for (const auto& [bit, modifier_name] : kModifierNames) {
+    if (!(mask & bit)) continue;
+    if (!name.empty()) name += "-";
+    name += modifier_name;
+  }
+  return name;
+}
+
 Remapper::Remapper() {
   // Ensure "" has index 0.
   if (StateNameToIndex("") != 0) {
@@ -57,43 +173,71 @@ Remapper::Remapper() {
     // Should not happen!
     throw std::runtime_error("Unexpected all_states_ init failure");
   }
+  AddProfile(kDefaultProfileName, "");
 
   // Initialize kill combo keycodes from string.
+  std::vector<int> kill_key_codes;
   for (const char c : kKillCombo) {
     auto key_code = NameToKeyCode(std::string("KEY_") + c);
     if (!key_code.has_value()) {
       throw std::runtime_error("Cannot create combo for kKillCombo");
     }
-    combo_kill_keycodes_.push_back(key_code.value());
+    kill_key_codes.push_back(key_code.value());
   }
+  AddSequence(kill_key_codes, {-1, SequenceKind::kKill, {}, 0});
+  keys_to_release_.reserve(32);
+  UpdateProfileKeys();
 }
 
 void Remapper::SetCallback(std::function<void(int, int)> emit_key_code) {
   emit_key_code_ = emit_key_code;
 }
 
+void Remapper::SetFlushCallback(std::function<void()> flush) {
+  flush_ = flush;
+}
+
 // Default state_name is "".
 void Remapper::AddMapping(const std::string& state_name, KeyEvent key_event,
                           const std::vector<Action>& actions) {
+  ClearCompiledStacks();
   auto& keyboard_state = all_states_[StateNameToIndex(state_name)];
 
   // If exists, append. Else set.
   const auto it = keyboard_state.action_map.find(key_event);
   if (it != keyboard_state.action_map.end()) {
-    it->second.insert(it->second.end(), actions.begin(), actions.end());
+    std::vector<Action> all_actions;
+    for (const Instruction instruction : Instructions(it->second)) {
+      all_actions.push_back(DecompileInstruction(instruction));
+    }
+    all_actions.insert(all_actions.end(), actions.begin(), actions.end());
+    it->second = Compile(all_actions);
   } else {
-    keyboard_state.action_map[key_event] = actions;
+    keyboard_state.action_map[key_event] = Compile(actions);
+  }
+}
+
+ActionList Remapper::Compile(const std::vector<Action>& actions) {
+  // Compile all first, so that program_ is unchanged if any fails.
+  std::vector<Instruction> instructions;
+  for (const auto& action : actions) {
+    instructions.push_back(CompileAction(action));
   }
+  const ActionList action_list{uint32_t(program_.size()),
+                               uint32_t(instructions.size())};
+  program_.insert(program_.end(), instructions.begin(), instructions.end());
+  return action_list;
 }
 
 void Remapper::SetNullEventActions(const std::string& state_name,
                                    const std::vector<Action> actions) {
   auto& keyboard_state = all_states_[StateNameToIndex(state_name)];
-  keyboard_state.null_event_actions = actions;
+  keyboard_state.null_event_actions = Compile(actions);
 }
 
 void Remapper::SetAllowOtherKeys(const std::string& state_name,
                                  bool allow_other_keys) {
+  ClearCompiledStacks();
   auto& keyboard_state = all_states_[StateNameToIndex(state_name)];
   keyboard_state.allow_other_keys = allow_other_keys;
 }
@@ -102,15 +246,731 @@ ActionLayerChange Remapper::ActionActivateState(std::string state_name) {
   return ActionLayerChange{StateNameToIndex(state_name)};
 }
 
+void Remapper::AddProfile(const std::string& profile_name,
+                          const std::string& base_state_name) {
+  for (const auto& profile : profiles_) {
+    if (profile.name == profile_name) return;
+  }
+  ClearCompiledStacks();
+  profiles_.push_back(
+      {profile_name, StateNameToIndex(base_state_name), {}, {}, {}, {}, {}});
+}
+
+void Remapper::SetProfileSwitchKeys(const std::string& profile_name,
+                                    const std::vector<int>& key_codes) {
+  const std::size_t index = ProfileIndex(profile_name);
+  AddSequence(key_codes, {-1, SequenceKind::kSwitchProfile, {}, index});
+  profiles_[index].switch_keys = key_codes;
+}
+
+std::size_t Remapper::ProfileIndex(const std::string& profile_name) const {
+  for (std::size_t index = 0; index < profiles_.size(); ++index) {
+    if (profiles_[index].name == profile_name) return index;
+  }
+  throw std::invalid_argument("Unknown profile " + profile_name);
+}
+
+void Remapper::AddSequence(const std::vector<int>& key_codes,
+                           const Sequence& sequence) {
+  if (sequence_matcher_.Add(key_codes) != int(sequences_.size())) {
+    // Should not happen!
+    throw std::runtime_error("Sequence ids out of step");
+  }
+  sequences_.push_back(sequence);
+}
+
+void Remapper::AddSequence(const std::string& profile_name,
+                           const std::vector<int>& key_codes,
+                           const std::vector<Action>& actions) {
+  const int profile_index = ProfileIndex(profile_name);
+  for (const auto& action : actions) {
+    // Nothing would release the layer.
+    if (std::holds_alternative<ActionLayerChange>(action)) {
+      throw std::invalid_argument("Sequences cannot activate layers");
+    }
+  }
+  AddSequence(key_codes,
+              {profile_index, SequenceKind::kActions, Compile(actions), 0});
+}
+
+void Remapper::AddSequenceProfileSwitch(const std::string& profile_name,
+                                        const std::vector<int>& key_codes,
+                                        const std::string& switch_to) {
+  AddSequence(key_codes, {int(ProfileIndex(profile_name)),
+                          SequenceKind::kSwitchProfile, {},
+                          ProfileIndex(switch_to)});
+}
+
+void Remapper::AddSequenceKill(const std::string& profile_name,
+                               const std::vector<int>& key_codes) {
+  AddSequence(key_codes, {int(ProfileIndex(profile_name)),
+                          SequenceKind::kKill, {}, 0});
+}
+
+void Remapper::AddSocdGroup(const std::string& profile_name,
+                            const std::vector<int>& key_codes, SocdMode mode) {
+  if (key_codes.size() < 2 || key_codes.size() > kMaxSocdKeys) {
+    throw std::invalid_argument("A SOCD group needs 2 to " +
+                                std::to_string(kMaxSocdKeys) + " keys");
+  }
+  for (auto& profile : profiles_) {
+    if (profile.name != profile_name) continue;
+    for (const int key_code : key_codes) {
+      if (key_code < 0 || key_code >= KEY_CNT) {
+        throw std::invalid_argument("Invalid key code " +
+                                    std::to_string(key_code));
+      }
+      const auto in_group = [key_code](const std::vector<int>& group) {
+        return std::find(group.begin(), group.end(), key_code) != group.end();
+      };
+      if (std::count(key_codes.begin(), key_codes.end(), key_code) > 1 ||
+          std::any_of(profile.socd_groups.begin(), profile.socd_groups.end(),
+                      [&](const auto& group) {
+                        return in_group(group.key_codes);
+                      })) {
+        throw std::invalid_argument(KeyCodeToName(key_code) +
+                                    " is already in a SOCD group");
+      }
+    }
+    profile.socd_groups.push_back({key_codes, mode, 0, 0, {}});
+    UpdateProfileKeys();
+    return;
+  }
+  throw std::invalid_argument("Unknown profile " + profile_name);
+}
+
+void Remapper::AddChord(const std::string& profile_name,
+                        const std::vector<int>& key_codes,
+                        const std::vector<Action>& press_actions,
+                        const std::vector<Action>& release_actions) {
+  auto& profile = profiles_[ProfileIndex(profile_name)];
+  std::vector<int> sorted = key_codes;
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted.size() < 2 ||
+      std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+    throw std::invalid_argument("A chord needs 2 or more different keys");
+  }
+  for (const int key_code : sorted) {
+    if (key_code < 0 || key_code >= KEY_CNT) {
+      throw std::invalid_argument("Invalid key code " +
+                                  std::to_string(key_code));
+    }
+  }
+  for (const auto& chord : profile.chords) {
+    if (chord.key_codes == sorted) {
+      throw std::invalid_argument("Chord already assigned");
+    }
+  }
+  for (const auto* actions : {&press_actions, &release_actions}) {
+    for (const auto& action : *actions) {
+      // Nothing would release the layer.
+      if (std::holds_alternative<ActionLayerChange>(action)) {
+        throw std::invalid_argument("Chords cannot activate layers");
+      }
+    }
+  }
+  profile.chords.push_back({sorted, Compile(press_actions),
+                            Compile(release_actions), ChordStats{sorted}});
+  UpdateProfileKeys();
+}
+
+void Remapper::SetRepeat(const std::string& state_name,
+                         RepeatSettings settings) {
+  CheckRepeatSettings(settings);
+  all_states_[StateNameToIndex(state_name)].repeat = settings;
+  software_repeat_ = true;
+}
+
+void Remapper::SetKeyRepeat(const std::string& profile_name, int key_code,
+                            RepeatSettings settings) {
+  auto& profile = profiles_[ProfileIndex(profile_name)];
+  if (key_code < 0 || key_code >= KEY_CNT) {
+    throw std::invalid_argument("Invalid key code " + std::to_string(key_code));
+  }
+  CheckRepeatSettings(settings);
+  profile.key_repeats[key_code] = settings;
+  software_repeat_ = true;
+}
+
+void Remapper::SetDebounce(std::optional<int> key_code, int milli_seconds) {
+  if (milli_seconds < 0 || milli_seconds > kMaxDebounceMs) {
+    throw std::invalid_argument("Debounce window out of range, up to " +
+                                std::to_string(kMaxDebounceMs) + "ms");
+  }
+  const auto window = std::chrono::milliseconds(milli_seconds);
+  if (!key_code.has_value()) {
+    debouncer_.SetDefaultWindow(window);
+    return;
+  }
+  if (*key_code < 0 || *key_code >= KEY_CNT) {
+    throw std::invalid_argument("Invalid key code " +
+                                std::to_string(*key_code));
+  }
+  debouncer_.SetWindow(*key_code, window);
+}
+
+void Remapper::AddAxisMapping(const AxisMapping& mapping) {
+  if (mapping.axis < 0 || mapping.axis >= ABS_CNT) {
+    throw std::invalid_argument("Invalid axis " +
+                                std::to_string(mapping.axis));
+  }
+  for (const auto& other : axis_mappings_) {
+    if (other.axis == mapping.axis) {
+      throw std::invalid_argument("Axis already mapped: " +
+                                  AxisCodeToName(mapping.axis));
+    }
+  }
+  for (const int key_code : {mapping.negative_key, mapping.positive_key}) {
+    if (key_code >= KEY_CNT) {
+      throw std::invalid_argument("Invalid key code " +
+                                  std::to_string(key_code));
+    }
+  }
+  if (mapping.negative_key < 0 && mapping.positive_key < 0) {
+    throw std::invalid_argument("An axis mapping needs a key");
+  }
+  if (mapping.release_percent <= 0 ||
+      mapping.release_percent >= mapping.press_percent ||
+      mapping.press_percent > 100) {
+    throw std::invalid_argument(
+        "Axis thresholds must be 0 < release < press <= 100%");
+  }
+  axis_mappings_.push_back(mapping);
+}
+
+void Remapper::AddModifierMapping(const std::string& profile_name,
+                                  int key_code, ModifierMask modifiers,
+                                  const std::vector<Action>& press_actions,
+                                  const std::vector<Action>& release_actions) {
+  auto& profile = profiles_[ProfileIndex(profile_name)];
+  if (key_code < 0 || key_code >= KEY_CNT) {
+    throw std::invalid_argument("Invalid key code " + std::to_string(key_code));
+  }
+  if (modifiers == 0) {
+    throw std::invalid_argument("A modifier mapping needs modifiers");
+  }
+  for (const auto* actions : {&press_actions, &release_actions}) {
+    for (const auto& action : *actions) {
+      // The release goes to the mapping, not to the layer.
+      if (std::holds_alternative<ActionLayerChange>(action)) {
+        throw std::invalid_argument("Modifier mappings cannot activate layers");
+      }
+    }
+  }
+  auto& mappings = profile.modifier_mappings[key_code];
+  for (const auto& mapping : mappings) {
+    if (mapping.modifiers == modifiers) {
+      throw std::invalid_argument("Modifier mapping already assigned");
+    }
+  }
+  const ModifierMapping mapping{modifiers, Compile(press_actions),
+                                Compile(release_actions)};
+  // Stable, so that of equally many modifiers the first added wins.
+  mappings.insert(
+      std::find_if(mappings.begin(), mappings.end(),
+                   [modifiers](const ModifierMapping& other) {
+                     return std::popcount(other.modifiers) <
+                            std::popcount(modifiers);
+                   }),
+      mapping);
+  UpdateProfileKeys();
+}
+
+bool Remapper::SelectProfile(const std::string& profile_name) {
+  for (std::size_t index = 0; index < profiles_.size(); ++index) {
+    if (profiles_[index].name != profile_name) continue;
+    SwitchToProfile(index);
+    return true;
+  }
+  return false;
+}
+
+const std::string& Remapper::ActiveProfileName() const {
+  return profiles_[active_profile_].name;
+}
+
+std::vector<std::string> Remapper::ProfileNames() const {
+  std::vector<std::string> names;
+  for (const auto& profile : profiles_) names.push_back(profile.name);
+  return names;
+}
+
+bool Remapper::ActivateState(const std::string& state_name) {
+  const auto index = MapLookup(state_name_to_index_, state_name);
+  if (!index.has_value()) return false;
+  auto* new_state = &all_states_[*index];
+  if (!new_state->activate()) return false;
+  // KEY_RESERVED is never released, so only DeactivateState() ends it.
+  active_layers_.push_back(
+      LayerActivation{event_seq_num_++, KeyPressEvent(KEY_RESERVED), new_state,
+                      CompiledChildStack(*index)});
+  return true;
+}
+
+bool Remapper::DeactivateState(const std::string& state_name) {
+  const auto index = MapLookup(state_name_to_index_, state_name);
+  if (!index.has_value()) return false;
+  for (std::size_t layer_index = 0; layer_index < active_layers_.size();
+       ++layer_index) {
+    if (active_layers_[layer_index].this_state == &all_states_[*index]) {
+      DeactivateNLayers(active_layers_.size() - layer_index);
+      return true;
+    }
+  }
+  return false;
+}
+
 void Remapper::Process(const int key_code_int, const int value) {
+  if (debouncer_.enabled() &&
+      debouncer_.Filter(key_code_int, value, clock_()) !=
+          Debouncer::Result::kPassed) [[unlikely]] {
+    return;
+  }
+  ProcessDebounced(key_code_int, value);
+}
+
+void Remapper::ProcessDebounced(const int key_code_int, const int value,
+                                bool match_sequences) {
+  if (key_code_int >= 0 && key_code_int < KEY_CNT) [[likely]] {
+    if (value == int(KeyEventType::kKeyPress)) {
+      input_keys_down_.set(key_code_int);
+    } else if (value == int(KeyEventType::kKeyRelease)) {
+      input_keys_down_.reset(key_code_int);
+    }
+    if (const ModifierMask side = ModifierSideBit(key_code_int)) {
+      ModifierMask sides = modifiers_held_ & kModifierSides;
+      if (value == int(KeyEventType::kKeyRelease)) {
+        sides &= ~side;
+      } else {
+        sides |= side;
+      }
+      modifiers_held_ = WithEitherSide(sides);
+    }
+  }
   const KeyEvent key_event{key_code_int, KeyEventType(value)};
-  ProcessCombos(key_event);
+  if (software_repeat_ && !TrackRepeats(key_event)) [[unlikely]] {
+    return;
+  }
+  if (match_sequences && ProcessCombos(key_event)) [[unlikely]] {
+    return;
+  }
+  ProcessTyped(key_event);
+}
+
+void Remapper::ProcessTyped(const KeyEvent& key_event) {
+  if (!bound_releases_.empty() && ProcessBoundRelease(key_event))
+      [[unlikely]] {
+    return;
+  }
+  if (chord_keys_.any()) [[unlikely]] {
+    ProcessChords(key_event);
+    return;
+  }
+  ProcessInput(key_event);
+}
+
+const RepeatSettings* Remapper::RepeatSettingsOf(int key_code) const {
+  const auto& key_repeats = profiles_[active_profile_].key_repeats;
+  if (const auto it = key_repeats.find(key_code); it != key_repeats.end()) {
+    return &it->second;
+  }
+  for (auto layer = active_layers_.rbegin(); layer != active_layers_.rend();
+       ++layer) {
+    if (layer->this_state->repeat.has_value()) {
+      return &layer->this_state->repeat.value();
+    }
+  }
+  const auto& base_repeat = all_states_[base_state_index_].repeat;
+  return base_repeat.has_value() ? &base_repeat.value() : nullptr;
+}
+
+bool Remapper::TrackRepeats(const KeyEvent& key_event) {
+  const int key_code = key_event.key_code;
+  if (key_code < 0 || key_code >= KEY_CNT) return true;
+  switch (key_event.value) {
+    case KeyEventType::kKeyRepeat:
+      return !soft_repeat_keys_.test(key_code);
+    case KeyEventType::kKeyPress: {
+      if (soft_repeat_keys_.test(key_code)) return true;
+      // As with the kernel, a key pressed stops the repeats of the previous.
+      repeating_key_ = -1;
+      const RepeatSettings* settings = RepeatSettingsOf(key_code);
+      if (settings == nullptr) return true;
+      soft_repeat_keys_.set(key_code);
+      const auto now = clock_();
+      if (settings->mode == RepeatSettings::Mode::kRepeat) {
+        repeating_key_ = key_code;
+        repeat_interval_ = settings->interval;
+        next_repeat_ = now + settings->delay;
+      } else if (settings->mode == RepeatSettings::Mode::kRapidFire) {
+        const auto half_interval = settings->interval / 2;
+        rapid_fires_.push_back({key_code, half_interval, now + half_interval,
+                                true});
+      }
+      return true;
+    }
+    case KeyEventType::kKeyRelease: {
+      if (!soft_repeat_keys_.test(key_code)) return true;
+      soft_repeat_keys_.reset(key_code);
+      if (repeating_key_ == key_code) repeating_key_ = -1;
+      const auto it = std::find_if(
+          rapid_fires_.begin(), rapid_fires_.end(),
+          [key_code](const RapidFire& fire) {
+            return fire.key_code == key_code;
+          });
+      if (it == rapid_fires_.end()) return true;
+      // If released by rapid fire, there is nothing more to release.
+      const bool down = it->down;
+      rapid_fires_.erase(it);
+      return down;
+    }
+  }
+  return true;
+}
+
+std::optional<Remapper::Clock::time_point> Remapper::NextDeadline() const {
+  std::optional<Clock::time_point> deadline;
+  const auto consider = [&deadline](Clock::time_point time) {
+    if (!deadline.has_value() || time < *deadline) deadline = time;
+  };
+  if (!pending_chord_keys_.empty()) consider(pending_since_ + chord_window_);
+  if (repeating_key_ >= 0) consider(next_repeat_);
+  for (const auto& fire : rapid_fires_) consider(fire.next);
+  if (const auto settle = debouncer_.NextDeadline()) consider(*settle);
+  return deadline;
+}
+
+void Remapper::ProcessChords(const KeyEvent& key_event) {
+  auto& pending = pending_chord_keys_;
+  // The timer may fire late, or after this event.
+  if (!pending.empty() && clock_() >= pending_since_ + chord_window_) {
+    ExpireChords();
+  }
+  const int key_code = key_event.key_code;
+  const bool in_range = key_code >= 0 && key_code < KEY_CNT;
+  if (key_event.value == KeyEventType::kKeyPress && in_range &&
+      chord_keys_.test(key_code) &&
+      std::find(pending.begin(), pending.end(), key_code) == pending.end()) {
+    if (pending.empty()) pending_since_ = clock_();
+    pending.push_back(key_code);
+    int exact = -1;
+    bool larger = false;
+    const auto& chords = profiles_[active_profile_].chords;
+    for (std::size_t index = 0; index < chords.size(); ++index) {
+      const auto& keys = chords[index].key_codes;
+      if (!std::all_of(pending.begin(), pending.end(), [&keys](int pressed) {
+            return std::binary_search(keys.begin(), keys.end(), pressed);
+          })) {
+        continue;
+      }
+      if (keys.size() == pending.size()) {
+        exact = index;
+      } else {
+        larger = true;
+      }
+    }
+    if (exact >= 0 && !larger) {
+      FireChord(exact);
+    } else if (exact < 0 && !larger) {
+      // No chord has all of these. Pass on the others, and this one may
+      // still begin a chord.
+      pending.pop_back();
+      PassOnPendingChordKeys();
+      ProcessChords(key_event);
+    }
+    return;
+  }
+
+  // Anything else is after the keys held back, which are passed on first.
+  if (!pending.empty()) PassOnPendingChordKeys();
+  if (in_range && chorded_keys_.test(key_code)) {
+    if (key_event.value != KeyEventType::kKeyRelease) return;
+    chorded_keys_.reset(key_code);
+    if (active_chord_ >= 0) {
+      const auto& chord = profiles_[active_profile_].chords[active_chord_];
+      if (std::binary_search(chord.key_codes.begin(), chord.key_codes.end(),
+                             key_code)) {
+        active_chord_ = -1;
+        ProcessActions(Instructions(chord.release_actions), std::nullopt);
+      }
+    }
+    return;
+  }
+  ProcessInput(key_event);
+}
+
+void Remapper::FireChord(const int chord_index) {
+  auto& chords = profiles_[active_profile_].chords;
+  if (active_chord_ >= 0) {
+    // Its keys are still held, but only one chord is tracked.
+    const int previous = std::exchange(active_chord_, -1);
+    ProcessActions(Instructions(chords[previous].release_actions),
+                   std::nullopt);
+  }
+  for (const int key_code : pending_chord_keys_) chorded_keys_.set(key_code);
+  pending_chord_keys_.clear();
+  ++chords[chord_index].stats.fired;
+  ++counters_.remapped;
+  active_state().null_event_applicable = false;
+  active_chord_ = chord_index;
+  ProcessActions(Instructions(chords[chord_index].press_actions),
+                 std::nullopt);
+}
+
+void Remapper::PassOnPendingChordKeys() {
+  auto& pending = pending_chord_keys_;
+  const uint64_t delay_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(clock_() -
+                                                            pending_since_)
+          .count();
+  for (auto& chord : profiles_[active_profile_].chords) {
+    const auto& keys = chord.key_codes;
+    if (std::all_of(pending.begin(), pending.end(), [&keys](int pressed) {
+          return std::binary_search(keys.begin(), keys.end(), pressed);
+        })) {
+      ++chord.stats.typed_through;
+      chord.stats.delay_us += delay_us;
+      chord.stats.max_delay_us = std::max(chord.stats.max_delay_us, delay_us);
+    }
+  }
+  // Not iterated in place, as nothing may be held back while passing on.
+  keys_to_pass_on_.swap(pending);
+  for (const int key_code : keys_to_pass_on_) {
+    ProcessInput(KeyPressEvent(key_code));
+  }
+  keys_to_pass_on_.clear();
+}
+
+void Remapper::Tick() {
+  const auto now = clock_();
+  debouncer_.Tick(now, [this](int key_code, int value) {
+    ProcessDebounced(key_code, value);
+  });
+  if (!pending_chord_keys_.empty() && now >= pending_since_ + chord_window_) {
+    ExpireChords();
+  }
+  // Deadlines stay on the schedule of the press. If late by more than an
+  // interval, the missed ones are skipped rather than sent in a burst.
+  if (repeating_key_ >= 0 && now >= next_repeat_) {
+    do {
+      next_repeat_ += repeat_interval_;
+    } while (next_repeat_ <= now);
+    ProcessTyped({repeating_key_, KeyEventType::kKeyRepeat});
+  }
+  // By index, as processing does not add or remove any.
+  for (std::size_t index = 0; index < rapid_fires_.size(); ++index) {
+    auto& fire = rapid_fires_[index];
+    if (now < fire.next) continue;
+    do {
+      fire.next += fire.half_interval;
+    } while (fire.next <= now);
+    fire.down = !fire.down;
+    ProcessTyped({fire.key_code, fire.down ? KeyEventType::kKeyPress
+                                           : KeyEventType::kKeyRelease});
+  }
+}
+
+void Remapper::ExpireChords() {
+  auto& pending = pending_chord_keys_;
+  // A chord within a larger one, e.g. J & K while J & K & L is possible.
+  const auto& chords = profiles_[active_profile_].chords;
+  for (std::size_t index = 0; index < chords.size(); ++index) {
+    const auto& keys = chords[index].key_codes;
+    if (keys.size() == pending.size() &&
+        std::is_permutation(keys.begin(), keys.end(), pending.begin())) {
+      FireChord(index);
+      return;
+    }
+  }
+  PassOnPendingChordKeys();
+}
+
+void Remapper::FlushChords() {
+  if (!pending_chord_keys_.empty()) PassOnPendingChordKeys();
+}
+
+std::vector<ChordStats> Remapper::chord_stats() const {
+  std::vector<ChordStats> stats;
+  for (const auto& chord : profiles_[active_profile_].chords) {
+    stats.push_back(chord.stats);
+  }
+  return stats;
+}
+
+void Remapper::ProcessInput(const KeyEvent& key_event) {
+  const int key_code_int = key_event.key_code;
+  if (key_code_int >= 0 && key_code_int < KEY_CNT &&
+      socd_slots_[key_code_int] >= 0) [[unlikely]] {
+    ProcessSocd(key_event, socd_slots_[key_code_int]);
+    return;
+  }
+  ProcessResolved(key_event);
+}
+
+void Remapper::ProcessSocd(const KeyEvent& key_event, const int slot) {
+  auto& group = profiles_[active_profile_].socd_groups[slot / kMaxSocdKeys];
+  const uint8_t bit = slot % kMaxSocdKeys;
+  const uint64_t mask = uint64_t{1} << bit;
+  auto& order = group.press_order;
+  if (key_event.value == KeyEventType::kKeyPress) {
+    if (group.held & mask) return;
+    group.held |= mask;
+    order.push_back(bit);
+  } else if (key_event.value == KeyEventType::kKeyRelease) {
+    if (!(group.held & mask)) {
+      // Held since before the group was set up, e.g. across a reload.
+      ProcessResolved(key_event);
+      return;
+    }
+    group.held &= ~mask;
+    order.erase(std::find(order.begin(), order.end(), bit));
+  } else {
+    // Only the key on the output repeats.
+    if (group.output & mask) {
+      ProcessResolved(key_event);
+    } else {
+      ++counters_.blocked;
+    }
+    return;
+  }
+
+  uint64_t desired = 0;
+  if (!order.empty()) {
+    switch (group.mode) {
+      case SocdMode::kLastPriority:
+        desired = uint64_t{1} << order.back();
+        break;
+      case SocdMode::kFirstPriority:
+        desired = uint64_t{1} << order.front();
+        break;
+      case SocdMode::kNeutral:
+        if (order.size() == 1) desired = group.held;
+        break;
+    }
+  }
+  const uint64_t released = group.output & ~desired;
+  const uint64_t pressed = desired & ~group.output;
+  if (released == 0 && pressed == 0) {
+    ++counters_.blocked;
+    return;
+  }
+  // Release first, so that the output never has two keys of the group held.
+  group.output = desired;
+  for (uint64_t bits = released; bits != 0; bits &= bits - 1) {
+    ProcessResolved(KeyReleaseEvent(group.key_codes[std::countr_zero(bits)]));
+  }
+  for (uint64_t bits = pressed; bits != 0; bits &= bits - 1) {
+    ProcessResolved(KeyPressEvent(group.key_codes[std::countr_zero(bits)]));
+  }
+}
+
+void Remapper::UpdateProfileKeys() {
+  socd_slots_.assign(KEY_CNT, -1);
+  const auto& groups = profiles_[active_profile_].socd_groups;
+  for (std::size_t group = 0; group < groups.size(); ++group) {
+    const auto& key_codes = groups[group].key_codes;
+    for (std::size_t bit = 0; bit < key_codes.size(); ++bit) {
+      socd_slots_[key_codes[bit]] = group * kMaxSocdKeys + bit;
+    }
+  }
+  chord_keys_.reset();
+  for (const auto& chord : profiles_[active_profile_].chords) {
+    for (const int key_code : chord.key_codes) chord_keys_.set(key_code);
+  }
+  modifier_mapped_keys_.reset();
+  for (const auto& [key_code, mappings] :
+       profiles_[active_profile_].modifier_mappings) {
+    modifier_mapped_keys_.set(key_code);
+  }
+}
+
+bool Remapper::ProcessModifierMapping(const KeyEvent& key_event) {
+  const int key_code = key_event.key_code;
+  if (key_event.value == KeyEventType::kKeyPress) {
+    if (!active_layers_.empty()) return false;
+    const auto& mappings =
+        profiles_[active_profile_].modifier_mappings.at(key_code);
+    for (const auto& mapping : mappings) {
+      if ((modifiers_held_ & mapping.modifiers) != mapping.modifiers) continue;
+      modifier_mapped_releases_[key_code] = mapping.release_actions;
+      ++counters_.remapped;
+      active_state().null_event_applicable = false;
+      ProcessActions(Instructions(mapping.press_actions), key_event);
+      return true;
+    }
+    return false;
+  }
+
+  const auto it = modifier_mapped_releases_.find(key_code);
+  if (it == modifier_mapped_releases_.end()) return false;
+  const ActionList release_actions = it->second;
+  ++counters_.remapped;
+  if (key_event.value == KeyEventType::kKeyRelease) {
+    modifier_mapped_releases_.erase(it);
+    ProcessActions(Instructions(release_actions), key_event);
+    return true;
+  }
+  // Same as a repeat of a mapping in a state, see ResolveInState().
+  for (const Instruction instruction : Instructions(release_actions)) {
+    if (GetOpCode(instruction) != OpCode::kRelease) continue;
+    ProcessKeyEvent({int(GetOperand(instruction)), KeyEventType::kKeyRepeat});
+    break;
+  }
+  return true;
+}
+
+bool Remapper::ProcessBoundRelease(const KeyEvent& key_event) {
+  const auto it = bound_releases_.find(key_event.key_code);
+  if (it == bound_releases_.end()) return false;
+  if (key_event.value == KeyEventType::kKeyPress) {
+    // The release was missed, so the press goes through the mappings.
+    bound_releases_.erase(it);
+    return false;
+  }
+  if (key_event.value == KeyEventType::kKeyRelease) {
+    const std::vector<int> released = std::move(it->second);
+    bound_releases_.erase(it);
+    // Keys already released, e.g. by another key of the same chord, are
+    // skipped.
+    for (const int key_code : released) {
+      ProcessKeyEvent(KeyReleaseEvent(key_code));
+    }
+  }
+  return true;
+}
+
+std::vector<int> Remapper::ReleasedKeyCodes(const ActionList& actions) const {
+  std::vector<int> key_codes;
+  for (const Instruction instruction : Instructions(actions)) {
+    if (GetOpCode(instruction) == OpCode::kRelease) {
+      key_codes.push_back(GetOperand(instruction));
+    }
+  }
+  return key_codes;
+}
+
+void Remapper::ProcessResolved(const KeyEvent& key_event) {
   // Check if key_event is in activated keyboard_state stack.
   if (DeactivateLayerByKey(key_event)) [[unlikely]] {
     return;
   }
 
-  const auto& actions = ExpandToActions(key_event);
+  if (key_event.key_code >= 0 && key_event.key_code < KEY_CNT &&
+      modifier_mapped_keys_.test(key_event.key_code) &&
+      ProcessModifierMapping(key_event)) [[unlikely]] {
+    return;
+  }
+
+  Instruction scratch;
+  const auto actions = ExpandToActions(key_event, scratch);
+
+  if (actions.empty()) {
+    ++counters_.blocked;
+  } else if (actions.size() == 1 && actions[0] == CompileAction(key_event)) {
+    ++counters_.passthrough;
+  } else {
+    ++counters_.remapped;
+  }
 
   if (!actions.empty()) {
     // Since a key was pressed, null event will not be triggered on
@@ -122,27 +982,31 @@ void Remapper::Process(const int key_code_int, const int value) {
 }
 
 void Remapper::DumpConfig(std::ostream& os) const {
+  const auto ShowActions = [this, &os](const ActionList& actions) {
+    for (const Instruction instruction : Instructions(actions)) {
+      const Action action = DecompileInstruction(instruction);
+      if (std::holds_alternative<KeyEvent>(action)) {
+        const auto& key_event = std::get<KeyEvent>(action);
+        os << "    Key: " << key_event << std::endl;
+      } else if (std::holds_alternative<ActionWait>(action)) {
+        const auto& wait = std::get<ActionWait>(action);
+        os << "    Wait: " << wait.milli_seconds << "ms" << std::endl;
+      } else if (std::holds_alternative<ActionLayerChange>(action)) {
+        const auto& layer_change = std::get<ActionLayerChange>(action);
+        os << "    Layer Change: " << layer_change.layer_index << std::endl;
+      } else {
+        std::cerr << "WARNING: Unknown action." << std::endl;
+      }
+    }
+  };
   for (std::size_t state_id = 0; state_id < all_states_.size(); ++state_id) {
     const auto& state = all_states_[state_id];
     os << "State #" << state_id << std::endl;
     os << "  Other keys: " << (state.allow_other_keys ? "Allow" : "Block")
        << std::endl;
-    const auto ShowActions = [&os](const std::vector<Action>& actions) {
-      for (const auto& action : actions) {
-        if (std::holds_alternative<KeyEvent>(action)) {
-          const auto& key_event = std::get<KeyEvent>(action);
-          os << "    Key: " << key_event << std::endl;
-        } else if (std::holds_alternative<ActionWait>(action)) {
-          const auto& wait = std::get<ActionWait>(action);
-          os << "    Wait: " << wait.milli_seconds << "ms" << std::endl;
-        } else if (std::holds_alternative<ActionLayerChange>(action)) {
-          const auto& layer_change = std::get<ActionLayerChange>(action);
-          os << "    Layer Change: " << layer_change.layer_index << std::endl;
-        } else {
-          std::cerr << "WARNING: Unknown action." << std::endl;
-        }
-      }
-    };
+    if (state.repeat.has_value()) {
+      os << "  Repeat: " << DescribeRepeat(*state.repeat) << std::endl;
+    }
     for (const auto& [trigger, actions] : state.action_map) {
       os << "  On: " << trigger << std::endl;
       ShowActions(actions);
@@ -152,6 +1016,422 @@ void Remapper::DumpConfig(std::ostream& os) const {
       ShowActions(state.null_event_actions);
     }
   }
+  if (const auto stats = layer_stack_stats()) {
+    os << "Layer stacks: " << stats->stacks << " compiled to " << stats->tables
+       << " tables, about " << stats->bytes << " bytes" << std::endl;
+  }
+  if (profiles_.size() > 1) {
+    for (const auto& profile : profiles_) {
+      os << "Profile " << profile.name << ": State #"
+         << profile.base_state_index << std::endl;
+      if (!profile.switch_keys.empty()) {
+        os << "  Switch keys:";
+        for (const int key_code : profile.switch_keys) {
+          os << " " << KeyCodeToName(key_code);
+        }
+        os << std::endl;
+      }
+    }
+  }
+  for (std::size_t id = 0; id < sequences_.size(); ++id) {
+    const auto& sequence = sequences_[id];
+    if (sequence.profile_index < 0) continue;
+    os << "Sequence";
+    if (profiles_.size() > 1) {
+      os << " in " << profiles_[sequence.profile_index].name;
+    }
+    os << ":";
+    for (const int key_code : sequence_matcher_.sequences()[id]) {
+      os << " " << KeyCodeToName(key_code);
+    }
+    os << std::endl;
+    if (sequence.kind == SequenceKind::kKill) {
+      os << "    Kill" << std::endl;
+    } else if (sequence.kind == SequenceKind::kSwitchProfile) {
+      os << "    Profile: " << profiles_[sequence.switch_to].name << std::endl;
+    } else {
+      ShowActions(sequence.actions);
+    }
+  }
+  for (const auto& profile : profiles_) {
+    for (const auto& chord : profile.chords) {
+      os << "Chord";
+      if (profiles_.size() > 1) os << " in " << profile.name;
+      os << " (" << chord_window_.count() << "ms):";
+      for (const int key_code : chord.key_codes) {
+        os << " " << KeyCodeToName(key_code);
+      }
+      os << std::endl;
+      ShowActions(chord.press_actions);
+      os << "  On release:" << std::endl;
+      ShowActions(chord.release_actions);
+    }
+  }
+  if (debouncer_.enabled()) {
+    const auto to_ms = [](Debouncer::Clock::duration window) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(window)
+          .count();
+    };
+    const auto default_window = debouncer_.default_window();
+    os << "Debounce: " << to_ms(default_window) << "ms" << std::endl;
+    for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+      const auto window = debouncer_.window(key_code);
+      if (window == default_window) continue;
+      os << "Debounce: " << KeyCodeToName(key_code) << " " << to_ms(window)
+         << "ms" << std::endl;
+    }
+  }
+  for (const auto& mapping : axis_mappings_) {
+    os << "Axis: " << AxisCodeToName(mapping.axis)
+       << (mapping.from_minimum ? " from minimum" : "") << " "
+       << mapping.press_percent << "% " << mapping.release_percent << "%:";
+    for (const int key_code : {mapping.negative_key, mapping.positive_key}) {
+      os << " " << (key_code >= 0 ? KeyCodeToName(key_code) : "nothing");
+    }
+    os << std::endl;
+  }
+  for (const auto& profile : profiles_) {
+    // Sorted, as the map is not.
+    const std::map<int, RepeatSettings> key_repeats(
+        profile.key_repeats.begin(), profile.key_repeats.end());
+    for (const auto& [key_code, settings] : key_repeats) {
+      os << "Repeat";
+      if (profiles_.size() > 1) os << " in " << profile.name;
+      os << ": " << KeyCodeToName(key_code) << " " << DescribeRepeat(settings)
+         << std::endl;
+    }
+  }
+  for (const auto& profile : profiles_) {
+    // Sorted, as the map is not.
+    std::map<int, std::vector<ModifierMapping>> by_key(
+        profile.modifier_mappings.begin(), profile.modifier_mappings.end());
+    for (const auto& [key_code, mappings] : by_key) {
+      for (const auto& mapping : mappings) {
+        os << "Modifier mapping";
+        if (profiles_.size() > 1) os << " in " << profile.name;
+        os << ": " << ModifierMaskToName(mapping.modifiers) << "-"
+           << KeyCodeToName(key_code) << std::endl;
+        ShowActions(mapping.press_actions);
+        os << "  On release:" << std::endl;
+        ShowActions(mapping.release_actions);
+      }
+    }
+  }
+  for (const auto& profile : profiles_) {
+    for (const auto& group : profile.socd_groups) {
+      os << "SOCD";
+      if (profiles_.size() > 1) os << " in " << profile.name;
+      os << " ("
+         << (group.mode == SocdMode::kLastPriority ? "last"
+             : group.mode == SocdMode::kNeutral    ? "neutral"
+                                                   : "first")
+         << "):";
+      for (const int key_code : group.key_codes) {
+        os << " " << KeyCodeToName(key_code);
+      }
+      os << std::endl;
+    }
+  }
+}
+
+std::vector<std::pair<int, int>> Remapper::PureRemaps() const {
+  if (profiles_.size() != 1) return {};
+  const auto& base_state = all_states_[base_state_index_];
+
+  // Only A = B, i.e. ^A = ^B and ~A = ~B, with the repeat derived.
+  const auto is_single = [this](const ActionList& actions,
+                                const KeyEvent& event) {
+    return actions.size == 1 &&
+           Instructions(actions)[0] == CompileAction(event);
+  };
+  std::unordered_map<int, int> remaps;
+  for (const auto& [key_event, actions] : base_state.action_map) {
+    if (key_event.value != KeyEventType::kKeyPress || actions.size != 1 ||
+        GetOpCode(Instructions(actions)[0]) != OpCode::kPress) {
+      continue;
+    }
+    const int from = key_event.key_code;
+    const int to = GetOperand(Instructions(actions)[0]);
+    if (from == to || !is_single(actions, KeyPressEvent(to))) continue;
+    const auto release = base_state.action_map.find(KeyReleaseEvent(from));
+    if (release == base_state.action_map.end() ||
+        !is_single(release->second, KeyReleaseEvent(to))) {
+      continue;
+    }
+    const auto repeat = base_state.action_map.find(
+        KeyEvent{from, KeyEventType::kKeyRepeat});
+    if (repeat != base_state.action_map.end() &&
+        !is_single(repeat->second, KeyEvent{to, KeyEventType::kKeyRepeat})) {
+      continue;
+    }
+    remaps.emplace(from, to);
+  }
+
+  // Sequences, SOCD groups and modifier mappings act on the keys as typed,
+  // which the kernel would change.
+  std::unordered_set<int> combo_keys;
+  for (const auto& key_codes : sequence_matcher_.sequences()) {
+    combo_keys.insert(key_codes.begin(), key_codes.end());
+  }
+  for (const auto& profile : profiles_) {
+    for (const auto& group : profile.socd_groups) {
+      combo_keys.insert(group.key_codes.begin(), group.key_codes.end());
+    }
+    // Their keys, and the modifiers as seen on the input.
+    for (const auto& [key_code, mappings] : profile.modifier_mappings) {
+      combo_keys.insert(key_code);
+      for (const auto& mapping : mappings) {
+        for (const int modifier :
+             {KEY_LEFTSHIFT, KEY_RIGHTSHIFT, KEY_LEFTCTRL, KEY_RIGHTCTRL,
+              KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA}) {
+          if (mapping.modifiers & WithEitherSide(ModifierSideBit(modifier))) {
+            combo_keys.insert(modifier);
+          }
+        }
+      }
+    }
+  }
+  // Keys of axes and wheels do not come through the keymap.
+  for (const auto& mapping : axis_mappings_) {
+    combo_keys.insert({mapping.negative_key, mapping.positive_key});
+  }
+  combo_keys.insert(
+      {kKeyWheelUp, kKeyWheelDown, kKeyWheelLeft, kKeyWheelRight});
+
+  // Once remapped by the kernel, the Remapper sees `to` instead of `from`, so
+  // neither may trigger anything else. Dropping a remap may leave another one
+  // with a trigger, so repeat until nothing changes.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::unordered_set<int> triggers;
+    for (const auto& state : all_states_) {
+      for (const auto& [key_event, actions] : state.action_map) {
+        if (&state == &base_state && MapContains(remaps, key_event.key_code)) {
+          continue;
+        }
+        triggers.insert(key_event.key_code);
+      }
+    }
+    for (auto it = remaps.begin(); it != remaps.end();) {
+      const auto [from, to] = *it;
+      if (triggers.contains(from) || triggers.contains(to) ||
+          combo_keys.contains(from) || combo_keys.contains(to)) {
+        it = remaps.erase(it);
+        changed = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::vector<std::pair<int, int>> result(remaps.begin(), remaps.end());
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+void Remapper::RemoveBaseMappings(int key_code) {
+  ClearCompiledStacks();
+  auto& action_map = all_states_[base_state_index_].action_map;
+  for (const auto value : {KeyEventType::kKeyPress, KeyEventType::kKeyRelease,
+                           KeyEventType::kKeyRepeat}) {
+    action_map.erase(KeyEvent{key_code, value});
+  }
+}
+
+std::vector<int> Remapper::EmittedKeyCodes() const {
+  std::vector<int> key_codes;
+  const auto add = [&](const ActionList& actions) {
+    for (const Instruction instruction : Instructions(actions)) {
+      const OpCode op_code = GetOpCode(instruction);
+      if (op_code == OpCode::kPress || op_code == OpCode::kRelease ||
+          op_code == OpCode::kRepeat) {
+        key_codes.push_back(GetOperand(instruction));
+      }
+    }
+  };
+  for (const auto& state : all_states_) {
+    for (const auto& [key_event, actions] : state.action_map) add(actions);
+    add(state.null_event_actions);
+  }
+  for (const auto& sequence : sequences_) add(sequence.actions);
+  for (const auto& profile : profiles_) {
+    for (const auto& chord : profile.chords) {
+      add(chord.press_actions);
+      add(chord.release_actions);
+    }
+    for (const auto& [key_code, mappings] : profile.modifier_mappings) {
+      for (const auto& mapping : mappings) {
+        add(mapping.press_actions);
+        add(mapping.release_actions);
+      }
+    }
+  }
+  // Not on the device, even if passed through.
+  for (const auto& mapping : axis_mappings_) {
+    for (const int key_code : {mapping.negative_key, mapping.positive_key}) {
+      if (key_code >= 0) key_codes.push_back(key_code);
+    }
+  }
+  std::sort(key_codes.begin(), key_codes.end());
+  key_codes.erase(std::unique(key_codes.begin(), key_codes.end()),
+                  key_codes.end());
+  return key_codes;
+}
+
+std::vector<int> Remapper::InputKeyCodes() const {
+  std::vector<int> key_codes;
+  for (const auto& state : all_states_) {
+    for (const auto& [key_event, actions] : state.action_map) {
+      key_codes.push_back(key_event.key_code);
+    }
+  }
+  for (const auto& sequence : sequence_matcher_.sequences()) {
+    key_codes.insert(key_codes.end(), sequence.begin(), sequence.end());
+  }
+  for (const auto& profile : profiles_) {
+    for (const auto& group : profile.socd_groups) {
+      key_codes.insert(key_codes.end(), group.key_codes.begin(),
+                       group.key_codes.end());
+    }
+    for (const auto& chord : profile.chords) {
+      key_codes.insert(key_codes.end(), chord.key_codes.begin(),
+                       chord.key_codes.end());
+    }
+    for (const auto& [key_code, mappings] : profile.modifier_mappings) {
+      key_codes.push_back(key_code);
+    }
+  }
+  for (const auto& mapping : axis_mappings_) {
+    for (const int key_code : {mapping.negative_key, mapping.positive_key}) {
+      if (key_code >= 0) key_codes.push_back(key_code);
+    }
+  }
+  std::sort(key_codes.begin(), key_codes.end());
+  key_codes.erase(std::unique(key_codes.begin(), key_codes.end()),
+                  key_codes.end());
+  return key_codes;
+}
+
+void Remapper::Resync(const std::vector<int>& input_keys_down) {
+  std::bitset<KEY_CNT> keys_down;
+  for (const int key_code : input_keys_down) {
+    if (key_code >= 0 && key_code < KEY_CNT) keys_down.set(key_code);
+  }
+  // The keys as read are settled, whatever chattered before.
+  debouncer_.Resync(input_keys_down);
+  // Keys typed before the drop are not followed by the ones typed since, so
+  // neither can complete a sequence, e.g. the kill combo.
+  sequence_matcher_.Reset();
+  const auto released = input_keys_down_ & ~keys_down;
+  const auto pressed = keys_down & ~input_keys_down_;
+  for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+    if (released.test(key_code)) {
+      ProcessDebounced(key_code, int(KeyEventType::kKeyRelease));
+    }
+  }
+  for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+    if (pressed.test(key_code)) {
+      ProcessDebounced(key_code, int(KeyEventType::kKeyPress),
+                       /*match_sequences=*/false);
+    }
+  }
+}
+
+RemapperState Remapper::GetState() const {
+  RemapperState state;
+  state.profile_name = ActiveProfileName();
+  state.event_seq_num = event_seq_num_;
+  state.counters = counters_;
+  state.chatter = debouncer_.ChatterCounts();
+  for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+    if (input_keys_down_.test(key_code)) {
+      state.input_keys_down.push_back(key_code);
+    }
+  }
+  state.keys_held.assign(keys_held_.begin(), keys_held_.end());
+  // Releases which only this config knows of.
+  std::map<int, std::vector<int>> bound_releases(bound_releases_.begin(),
+                                                 bound_releases_.end());
+  for (int key_code = 0; key_code < KEY_CNT; ++key_code) {
+    if (!chorded_keys_.test(key_code)) continue;
+    // Keys of a chord no longer active do nothing when released.
+    auto& released = bound_releases[key_code];
+    released.clear();
+    if (active_chord_ < 0) continue;
+    const auto& chord = profiles_[active_profile_].chords[active_chord_];
+    if (std::binary_search(chord.key_codes.begin(), chord.key_codes.end(),
+                           key_code)) {
+      released = ReleasedKeyCodes(chord.release_actions);
+    }
+  }
+  for (const auto& [key_code, release_actions] : modifier_mapped_releases_) {
+    bound_releases[key_code] = ReleasedKeyCodes(release_actions);
+  }
+  state.bound_releases.assign(bound_releases.begin(), bound_releases.end());
+  for (const auto& layer : active_layers_) {
+    const int index = layer.this_state - all_states_.data();
+    state.active_layers.push_back({layer.event_seq_num, layer.key_event,
+                                   state_names_[index],
+                                   layer.this_state->null_event_applicable});
+  }
+  return state;
+}
+
+void Remapper::RestoreState(const RemapperState& state) {
+  if (!active_layers_.empty() || !keys_held_.empty()) {
+    throw std::runtime_error("RestoreState() called on a running Remapper");
+  }
+  if (!SelectProfile(state.profile_name)) {
+    std::cerr << "WARNING: Profile " << state.profile_name
+              << " no longer exists." << std::endl;
+  }
+  event_seq_num_ = state.event_seq_num;
+  counters_ = state.counters;
+  debouncer_.Resync(state.input_keys_down);
+  debouncer_.RestoreChatterCounts(state.chatter);
+  for (const int key_code : state.input_keys_down) {
+    if (key_code < 0 || key_code >= KEY_CNT) continue;
+    input_keys_down_.set(key_code);
+    modifiers_held_ = WithEitherSide((modifiers_held_ & kModifierSides) |
+                                     ModifierSideBit(key_code));
+  }
+  keys_held_.insert(state.keys_held.begin(), state.keys_held.end());
+  for (const auto& [key_code, seq_num] : state.keys_held) {
+    if (key_code >= 0 && key_code < KEY_CNT) output_keys_down_.set(key_code);
+  }
+  bound_releases_.insert(state.bound_releases.begin(),
+                         state.bound_releases.end());
+
+  for (const auto& layer : state.active_layers) {
+    const auto index = MapLookup(state_name_to_index_, layer.state_name);
+    if (!index.has_value()) {
+      std::cerr << "WARNING: Layer " << layer.state_name
+                << " no longer exists, releasing keys held within it."
+                << std::endl;
+      // Same as DeactivateNLayers(), for a layer that cannot be activated.
+      std::vector<std::pair<int, int>> removed_keys;
+      for (auto it = keys_held_.begin(); it != keys_held_.end();) {
+        if (it->second > layer.event_seq_num) {
+          removed_keys.push_back({it->second, it->first});
+          it = keys_held_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      std::sort(removed_keys.rbegin(), removed_keys.rend());
+      for (const auto& [seq_num, key_code] : removed_keys) {
+        EmitKeyCode(KeyReleaseEvent(key_code));
+      }
+      return;
+    }
+    auto* new_state = &all_states_[*index];
+    if (!new_state->activate()) continue;
+    new_state->null_event_applicable = layer.null_event_applicable;
+    active_layers_.push_back(LayerActivation{layer.event_seq_num,
+                                             layer.key_event, new_state,
+                                             CompiledChildStack(*index)});
+  }
 }
 
 // PRIVATE
@@ -165,6 +1445,7 @@ int Remapper::StateNameToIndex(const std::string& state_name) {
 
   const int index = state_name_to_index_.size();
   all_states_.push_back(KeyboardState{});
+  state_names_.push_back(state_name);
   state_name_to_index_.emplace(state_name, index);
   return index;
 }
@@ -173,6 +1454,22 @@ void Remapper::EmitKeyCode(const KeyEvent& key_event) {
   // std::cout << "Emit "
   //           << (key_event.value == KeyEventType::kKeyPress ? "P" : "R")
   //           << key_event.key_code << std::endl;
+  const int key_code = key_event.key_code;
+  if (key_code >= 0 && key_code < KEY_CNT) [[likely]] {
+    const bool press = key_event.value == KeyEventType::kKeyPress;
+    if (press == output_keys_down_.test(key_code)) [[unlikely]] {
+      if (strict_output_) {
+        std::ostringstream oss;
+        oss << "Redundant output " << key_event;
+        throw std::logic_error(oss.str());
+      }
+      ++counters_.redundant_dropped;
+      return;
+    }
+    if (key_event.value != KeyEventType::kKeyRepeat) {
+      output_keys_down_.set(key_code, press);
+    }
+  }
   if (emit_key_code_ != nullptr) {
     emit_key_code_(key_event.key_code, int(key_event.value));
   }
@@ -211,37 +1508,73 @@ void Remapper::DeactivateNLayers(const int n) {
     auto& state_to_deactivate = layer_to_deactivate.this_state;
     state_to_deactivate->deactivate();
     if (state_to_deactivate->null_event_applicable) {
-      ProcessActions(state_to_deactivate->null_event_actions, std::nullopt);
+      ProcessActions(Instructions(state_to_deactivate->null_event_actions),
+                     std::nullopt);
     }
     // Get all the currently pressed keys after this was activated.
     const int threshold = layer_to_deactivate.event_seq_num;
-    std::vector<std::pair<int, int>> removed_keys;
+    keys_to_release_.clear();
     // Erase keys held after the layer was activated.
     for (auto it = keys_held_.begin(); it != keys_held_.end();) {
       if (it->second > threshold) {
-        removed_keys.push_back({it->first, it->second});
+        keys_to_release_.push_back({it->second, it->first});
         it = keys_held_.erase(it);
       } else {
         ++it;
       }
     }
     // And release them in reverse order.
-    std::sort(
-        removed_keys.begin(), removed_keys.end(),
-        [](const std::pair<int, int>& lhs, const std::pair<int, int>& rhs) {
-          if (lhs.second != rhs.second) {
-            return lhs.second < rhs.second;
-          }
-          return lhs.first < rhs.first;
-        });
-    for (auto it = removed_keys.rbegin(); it != removed_keys.rend(); ++it) {
-      EmitKeyCode({it->first, KeyEventType::kKeyRelease});
+    std::sort(keys_to_release_.rbegin(), keys_to_release_.rend());
+    for (const auto& [seq_num, key_code] : keys_to_release_) {
+      EmitKeyCode({key_code, KeyEventType::kKeyRelease});
     }
     // Done at the very end because .pop_back() invalidates .back().
     active_layers_.pop_back();
   }
 }
 
+void Remapper::ReleaseAll() {
+  for (auto& layer : active_layers_) {
+    layer.this_state->null_event_applicable = false;
+  }
+  DeactivateNLayers(active_layers_.size());
+
+  keys_to_release_.clear();
+  for (const auto& [key_code, seq_num] : keys_held_) {
+    keys_to_release_.push_back({seq_num, key_code});
+  }
+  keys_held_.clear();
+  std::sort(keys_to_release_.rbegin(), keys_to_release_.rend());
+  for (const auto& [seq_num, key_code] : keys_to_release_) {
+    EmitKeyCode(KeyReleaseEvent(key_code));
+  }
+}
+
+void Remapper::SwitchToProfile(std::size_t profile_index) {
+  if (profile_index == active_profile_) return;
+  ReleaseAll();
+  // Keys held back were never passed on.
+  pending_chord_keys_.clear();
+  active_chord_ = -1;
+  chorded_keys_.reset();
+  // ReleaseAll() released what they pressed.
+  modifier_mapped_releases_.clear();
+  bound_releases_.clear();
+  // Keys still held repeat as the kernel repeats them.
+  soft_repeat_keys_.reset();
+  repeating_key_ = -1;
+  rapid_fires_.clear();
+  // ReleaseAll() released their output, and keys still held are passed
+  // through on release.
+  for (auto& group : profiles_[active_profile_].socd_groups) {
+    group.held = group.output = 0;
+    group.press_order.clear();
+  }
+  active_profile_ = profile_index;
+  base_state_index_ = profiles_[profile_index].base_state_index;
+  UpdateProfileKeys();
+}
+
 void Remapper::ProcessKeyEvent(const KeyEvent& key_event) {
   if (key_event.value == KeyEventType::kKeyPress) {
     keys_held_[key_event.key_code] = event_seq_num_++;
@@ -251,6 +1584,9 @@ void Remapper::ProcessKeyEvent(const KeyEvent& key_event) {
     for (const auto& layer : active_layers_) {
       if (layer.key_event.key_code == key_event.key_code) return;
     }
+    // Nor if it is not held, e.g. a key of A + B + C still held after A was
+    // released, which released everything pressed within the layers.
+    if (!MapContains(keys_held_, key_event.key_code)) return;
     // Else, emit the key.
     EmitKeyCode(key_event);
   } else if (key_event.value == KeyEventType::kKeyRelease) {
@@ -268,103 +1604,477 @@ void Remapper::ProcessKeyEvent(const KeyEvent& key_event) {
   }
 }
 
-// Responsible for mapping user-input to desired outcome actions.
-const std::vector<Action> Remapper::ExpandToActions(
-    const KeyEvent& key_event) const {
-  std::vector<Action> result;
-  // Returns true if a decision is reached and no more KeyboardState needs to be
-  // examined.
-  const auto operate = [&key_event, &result](const KeyboardState& this_state) {
-    const auto it = this_state.action_map.find(key_event);
-    if (it != this_state.action_map.end()) {
-      // Return the remapped actions.
-      result = it->second;
+bool Remapper::ResolveInState(const KeyboardState& state,
+                              const KeyEvent& key_event,
+                              std::span<const Instruction>& result,
+                              Instruction& scratch) const {
+  const auto it = state.action_map.find(key_event);
+  if (it != state.action_map.end()) {
+    // Return the remapped actions.
+    result = Instructions(it->second);
+    return true;
+  }
+
+  // If it's a repeat, it must be treated similar to release.
+  // Not press, since press can do multiple things; release is simpler.
+  // So we search for release events, but modify the output to repeat.
+  if (key_event.value == KeyEventType::kKeyRepeat) {
+    KeyEvent key_event_as_release = key_event;
+    key_event_as_release.value = KeyEventType::kKeyRelease;
+    const auto it = state.action_map.find(key_event_as_release);
+    if (it != state.action_map.end()) {
+      for (const Instruction instruction : Instructions(it->second)) {
+        // Move ahead only if the mapped event is release.
+        if (GetOpCode(instruction) != OpCode::kRelease) continue;
+
+        // Change it to repeat, and emit.
+        scratch = MakeInstruction(OpCode::kRepeat, GetOperand(instruction));
+        result = {&scratch, 1};
+        // Note: It's kind of ambiguous what happens if release does multiple
+        // things. To break this ambiguity, we just repeat the first release
+        // action.
+        break;
+      }
       return true;
     }
+  }
+
+  // Not remapped but all other keys not allowed.
+  if (!state.allow_other_keys) {
+    // result = {};  // No need, result is already empty.
+    return true;
+  }
+  return false;
+}
+
+// Responsible for mapping user-input to desired outcome actions.
+std::span<const Instruction> Remapper::ExpandToActions(
+    const KeyEvent& key_event, Instruction& scratch) const {
+  const int compiled_stack = CurrentCompiledStack();
+  if (compiled_stack >= 0) [[likely]] {
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+    if (use_embedded_tables_) [[likely]] {
+      const int table = compiled_stacks_[compiled_stack].table;
+      const auto actions =
+          EmbeddedLookup(table, key_event.key_code, key_event.value);
+      if (actions.has_value()) return *actions;
+      if (!kEmbeddedAllowOtherKeys[table]) return {};
+      scratch = CompileAction(key_event);
+      return {&scratch, 1};
+    }
+#endif
+    const auto& table =
+        compiled_tables_[compiled_stacks_[compiled_stack].table];
+    const auto it = table.action_map.find(key_event);
+    if (it != table.action_map.end()) return Instructions(it->second);
+    if (!table.allow_other_keys) return {};
+    scratch = CompileAction(key_event);
+    return {&scratch, 1};
+  }
+
+  std::span<const Instruction> result;
+  // Iterate: active_layers_.reverse() + {default_state_}.
+  for (auto it = active_layers_.rbegin(); it != active_layers_.rend(); ++it) {
+    if (ResolveInState(*it->this_state, key_event, result, scratch)) {
+      return result;
+    }
+  }
+  if (ResolveInState(all_states_[base_state_index_], key_event, result,
+                     scratch)) {
+    return result;
+  }
+
+  // Nothing matched or blocked.
+  scratch = CompileAction(key_event);
+  return {&scratch, 1};
+}
+
+bool Remapper::CompileLayerStacks() {
+  ClearCompiledStacks();
+
+  // Stacks as state indices, base first.
+  std::vector<std::vector<int>> stacks;
+  std::map<std::vector<int>, int> stack_ids;
+  std::vector<std::unordered_map<int, int>> children;
+  const auto find_or_add = [&](const std::vector<int>& stack) {
+    const auto [it, inserted] = stack_ids.try_emplace(stack, stacks.size());
+    if (inserted) {
+      stacks.push_back(stack);
+      children.emplace_back();
+    }
+    return it->second;
+  };
+  for (const auto& profile : profiles_) {
+    compiled_base_stacks_.push_back(find_or_add({profile.base_state_index}));
+  }
+
+  // Repeats derived from releases, so that tables can share them.
+  std::unordered_map<Instruction, ActionList> derived_actions;
+  std::vector<int> table_of_stack;
+  // Stacks are added while iterating, as activated by the earlier ones.
+  for (std::size_t stack_id = 0; stack_id < stacks.size(); ++stack_id) {
+    if (stacks.size() > kMaxLayerStacks) {
+      std::cerr << "WARNING: More than " << kMaxLayerStacks
+                << " stacks of layers, layers will be walked instead."
+                << std::endl;
+      ClearCompiledStacks();
+      return false;
+    }
+    const std::vector<int> stack = stacks[stack_id];
 
-    // If it's a repeat, it must be treated similar to release.
-    // Not press, since press can do multiple things; release is simpler.
-    // So we search for release events, but modify the output to repeat.
-    if (key_event.value == KeyEventType::kKeyRepeat) {
-      KeyEvent key_event_as_release = key_event;
-      key_event_as_release.value = KeyEventType::kKeyRelease;
-      const auto it = this_state.action_map.find(key_event_as_release);
-      if (it != this_state.action_map.end()) {
-        std::cout << "Found " << key_event_as_release << std::endl;
-        for (auto action : it->second) {
-          if (std::holds_alternative<KeyEvent>(action)) {
-            KeyEvent new_action = std::get<KeyEvent>(action);
-
-            // Move ahead only if the mapped event is release.
-            if (new_action.value != KeyEventType::kKeyRelease) continue;
-
-            // Change it to repeat, and emit.
-            new_action.value = KeyEventType::kKeyRepeat;
-            result.push_back(new_action);
-            // Note: It's kind of ambiguous what happens if release does multiple things.
-            // To break this ambiguity, we just repeat the first release action.
-            break;
+    // States which take part in resolving, top first, down to the first one
+    // which blocks other keys.
+    std::vector<const KeyboardState*> states;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+      states.push_back(&all_states_[*it]);
+      if (!states.back()->allow_other_keys) break;
+    }
+
+    CompiledTable table;
+    table.allow_other_keys = states.back()->allow_other_keys;
+    for (const auto* state : states) {
+      for (const auto& [trigger, trigger_actions] : state->action_map) {
+        for (const auto value : {trigger.value, KeyEventType::kKeyRepeat}) {
+          const KeyEvent key_event{trigger.key_code, value};
+          if (table.action_map.contains(key_event)) continue;
+          if (value == KeyEventType::kKeyRepeat &&
+              trigger.value != KeyEventType::kKeyRelease) {
+            continue;
+          }
+          std::span<const Instruction> result;
+          Instruction scratch;
+          bool decided = false;
+          for (const auto* resolving_state : states) {
+            decided =
+                ResolveInState(*resolving_state, key_event, result, scratch);
+            if (decided) break;
+          }
+          // Same as when not in the table.
+          if (!decided || (result.empty() && !table.allow_other_keys) ||
+              (table.allow_other_keys && result.size() == 1 &&
+               result[0] == CompileAction(key_event))) {
+            continue;
+          }
+          ActionList actions;
+          if (result.data() == &scratch) {
+            auto derived = derived_actions.find(scratch);
+            if (derived == derived_actions.end()) {
+              const ActionList compiled =
+                  Compile({DecompileInstruction(scratch)});
+              derived = derived_actions.emplace(scratch, compiled).first;
+            }
+            actions = derived->second;
+          } else if (!result.empty()) {
+            actions = ActionList{uint32_t(result.data() - program_.data()),
+                                 uint32_t(result.size())};
           }
+          table.action_map.emplace(key_event, actions);
         }
-        return true;
       }
     }
 
-    // Not remapped but all other keys not allowed.
-    if (!this_state.allow_other_keys) {
-      // result = {};  // No need, result is already empty.
-      return true;
+    // Layers which the keys activate on top of this stack. In a fixed order,
+    // so that stacks are numbered the same every time.
+    std::vector<std::pair<KeyEvent, ActionList>> entries(
+        table.action_map.begin(), table.action_map.end());
+    std::sort(entries.begin(), entries.end(), [](const auto& lhs,
+                                                 const auto& rhs) {
+      return std::pair(lhs.first.key_code, lhs.first.value) <
+             std::pair(rhs.first.key_code, rhs.first.value);
+    });
+    for (const auto& [key_event, actions] : entries) {
+      std::vector<int> child = stack;
+      int parent_id = stack_id;
+      for (const Instruction instruction : Instructions(actions)) {
+        if (GetOpCode(instruction) != OpCode::kLayerPush) continue;
+        const int state_index = GetOperand(instruction);
+        // Activating an active state is denied.
+        if (state_index >= int(all_states_.size()) ||
+            std::find(child.begin(), child.end(), state_index) !=
+                child.end()) {
+          continue;
+        }
+        child.push_back(state_index);
+        const int child_id = find_or_add(child);
+        children[parent_id][state_index] = child_id;
+        parent_id = child_id;
+      }
     }
-    return false;
+
+    // Stacks which resolve the same share the table.
+    int table_id = 0;
+    while (table_id < int(compiled_tables_.size()) &&
+           (compiled_tables_[table_id].allow_other_keys !=
+                table.allow_other_keys ||
+            compiled_tables_[table_id].action_map != table.action_map)) {
+      ++table_id;
+    }
+    if (table_id == int(compiled_tables_.size())) {
+      compiled_tables_.push_back(std::move(table));
+    }
+    table_of_stack.push_back(table_id);
+  }
+
+  for (std::size_t stack_id = 0; stack_id < stacks.size(); ++stack_id) {
+    compiled_stacks_.push_back(
+        {table_of_stack[stack_id], std::move(children[stack_id])});
+  }
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+  if (!UseEmbeddedTables(true)) {
+    std::cerr << "WARNING: The config differs from the one built in, so keys "
+                 "are not looked up in generated code."
+              << std::endl;
+  }
+#endif
+  // Layers active now are found in the new stacks.
+  for (std::size_t index = 0; index < active_layers_.size(); ++index) {
+    const int state_index =
+        active_layers_[index].this_state - all_states_.data();
+    const int parent_id = index == 0 ? compiled_base_stacks_[active_profile_]
+                                     : active_layers_[index - 1].compiled_stack;
+    active_layers_[index].compiled_stack = -1;
+    if (parent_id < 0) continue;
+    const auto child_id =
+        MapLookup(compiled_stacks_[parent_id].children, state_index);
+    if (child_id.has_value()) active_layers_[index].compiled_stack = *child_id;
+  }
+  return true;
+}
+
+std::optional<LayerStackStats> Remapper::layer_stack_stats() const {
+  if (compiled_stacks_.empty()) return std::nullopt;
+  LayerStackStats stats{compiled_stacks_.size(), compiled_tables_.size(), 0};
+  for (const auto& table : compiled_tables_) {
+    stats.bytes += sizeof(table) + ApproximateBytes(table.action_map);
+  }
+  for (const auto& stack : compiled_stacks_) {
+    stats.bytes += sizeof(stack) + ApproximateBytes(stack.children);
+  }
+  return stats;
+}
+
+OptimizeStats Remapper::Optimize() {
+  ClearCompiledStacks();
+  OptimizeStats stats;
+
+  // A base state has nothing below it, so keys mapped to themselves there are
+  // the same as not mapped if other keys are allowed. Layers are left alone,
+  // as they shadow the states below them.
+  for (const auto& profile : profiles_) {
+    auto& state = all_states_[profile.base_state_index];
+    if (!state.allow_other_keys) continue;
+    for (auto it = state.action_map.begin(); it != state.action_map.end();) {
+      if (it->second.size == 1 &&
+          Instructions(it->second)[0] == CompileAction(it->first)) {
+        it = state.action_map.erase(it);
+        ++stats.passthroughs_dropped;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Rebuild the program with each distinct action list once. This also drops
+  // lists replaced by AddMapping().
+  std::vector<Instruction> program;
+  std::map<std::vector<Instruction>, ActionList> action_lists;
+  const auto intern = [&](ActionList& actions) {
+    const auto instructions = Instructions(actions);
+    const auto [it, inserted] = action_lists.try_emplace(
+        std::vector<Instruction>(instructions.begin(), instructions.end()),
+        ActionList{uint32_t(program.size()), actions.size});
+    if (inserted) {
+      program.insert(program.end(), instructions.begin(), instructions.end());
+    } else if (!actions.empty()) {
+      ++stats.action_lists_merged;
+    }
+    actions = it->second;
   };
+  for (auto& state : all_states_) {
+    for (auto& [key_event, actions] : state.action_map) intern(actions);
+    intern(state.null_event_actions);
+  }
+  for (auto& sequence : sequences_) intern(sequence.actions);
+  for (auto& profile : profiles_) {
+    for (auto& chord : profile.chords) {
+      intern(chord.press_actions);
+      intern(chord.release_actions);
+    }
+    for (auto& [key_code, mappings] : profile.modifier_mappings) {
+      for (auto& mapping : mappings) {
+        intern(mapping.press_actions);
+        intern(mapping.release_actions);
+      }
+    }
+  }
+  program.shrink_to_fit();
+  program_ = std::move(program);
+  return stats;
+}
 
-  // Iterate: active_layers_.reverse() + {default_state_}.
-  for (auto it = active_layers_.rbegin(); it != active_layers_.rend(); ++it) {
-    if (operate(*it->this_state)) return result;
+std::size_t Remapper::MemoryUsage() const {
+  std::size_t bytes = program_.capacity() * sizeof(Instruction) +
+                      sequence_matcher_.bytes() +
+                      sequences_.capacity() * sizeof(Sequence);
+  for (const auto& state : all_states_) {
+    bytes += sizeof(state) + ApproximateBytes(state.action_map);
+  }
+  for (const auto& profile : profiles_) {
+    bytes += ApproximateBytes(profile.key_repeats);
+    bytes += ApproximateBytes(profile.modifier_mappings);
+    for (const auto& [key_code, mappings] : profile.modifier_mappings) {
+      bytes += mappings.capacity() * sizeof(ModifierMapping);
+    }
   }
-  if (operate(all_states_[0])) return result;
+  if (const auto stats = layer_stack_stats()) bytes += stats->bytes;
+  bytes += debouncer_.bytes();
+  return bytes;
+}
 
-  // Nothing matched or blocked.
-  return {key_event};
+std::vector<ExportedLayerTable> Remapper::ExportLayerTables() const {
+  std::vector<ExportedLayerTable> tables;
+  for (const auto& table : compiled_tables_) {
+    ExportedLayerTable exported{table.allow_other_keys, {}};
+    for (const auto& [key_event, actions] : table.action_map) {
+      const auto instructions = Instructions(actions);
+      exported.entries.push_back(
+          {key_event, {instructions.begin(), instructions.end()}});
+    }
+    std::sort(exported.entries.begin(), exported.entries.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return std::pair(lhs.first.key_code, lhs.first.value) <
+                       std::pair(rhs.first.key_code, rhs.first.value);
+              });
+    tables.push_back(std::move(exported));
+  }
+  return tables;
 }
 
-void Remapper::ProcessActions(const std::vector<Action>& actions,
+uint64_t Remapper::LayerStacksFingerprint() const {
+  if (compiled_stacks_.empty()) return 0;
+  // FNV-1a.
+  uint64_t hash = 14695981039346656037ull;
+  const auto add = [&hash](uint64_t value) {
+    hash = (hash ^ value) * 1099511628211ull;
+  };
+  for (const int base_stack : compiled_base_stacks_) add(base_stack);
+  for (const auto& stack : compiled_stacks_) {
+    add(stack.table);
+    std::vector<std::pair<int, int>> children(stack.children.begin(),
+                                              stack.children.end());
+    std::sort(children.begin(), children.end());
+    for (const auto& [state_index, child] : children) {
+      add(state_index);
+      add(child);
+    }
+  }
+  for (const auto& table : ExportLayerTables()) {
+    add(table.allow_other_keys);
+    for (const auto& [key_event, instructions] : table.entries) {
+      add(key_event.key_code);
+      add(int(key_event.value));
+      add(instructions.size());
+      for (const Instruction instruction : instructions) add(instruction);
+    }
+  }
+  return hash;
+}
+
+bool Remapper::UseEmbeddedTables(bool use) {
+#ifdef KEYSHIFT_EMBEDDED_CONFIG
+  use_embedded_tables_ =
+      use && LayerStacksFingerprint() == kEmbeddedFingerprint;
+#else
+  use_embedded_tables_ = false;
+  (void)use;
+#endif
+  return use_embedded_tables_;
+}
+
+void Remapper::ClearCompiledStacks() {
+  use_embedded_tables_ = false;
+  compiled_tables_.clear();
+  compiled_stacks_.clear();
+  compiled_base_stacks_.clear();
+  for (auto& layer : active_layers_) layer.compiled_stack = -1;
+}
+
+int Remapper::CompiledChildStack(int state_index) const {
+  const int parent_id = CurrentCompiledStack();
+  if (parent_id < 0) return -1;
+  const auto child_id =
+      MapLookup(compiled_stacks_[parent_id].children, state_index);
+  return child_id.value_or(-1);
+}
+
+void Remapper::ProcessActions(std::span<const Instruction> actions,
                               const std::optional<KeyEvent> key_event) {
-  for (const Action& action : actions) {
-    if (std::holds_alternative<KeyEvent>(action)) {
-      ProcessKeyEvent(std::get<KeyEvent>(action));
-    } else if (std::holds_alternative<ActionWait>(action)) {
-      const auto& wait = std::get<ActionWait>(action);
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(wait.milli_seconds));
-    } else if (std::holds_alternative<ActionLayerChange>(action)) {
-      const auto& layer_change = std::get<ActionLayerChange>(action);
-      if (layer_change.layer_index < (int)all_states_.size()) {
-        auto* new_state = &all_states_[layer_change.layer_index];
-        if (new_state->activate()) {
-          active_layers_.push_back(
-              LayerActivation{event_seq_num_++, key_event.value(), new_state});
+  for (const Instruction instruction : actions) {
+    const int operand = GetOperand(instruction);
+    switch (GetOpCode(instruction)) {
+      case OpCode::kRelease:
+        ProcessKeyEvent(KeyReleaseEvent(operand));
+        break;
+      case OpCode::kPress:
+        ProcessKeyEvent(KeyPressEvent(operand));
+        break;
+      case OpCode::kRepeat:
+        ProcessKeyEvent(KeyEvent{operand, KeyEventType::kKeyRepeat});
+        break;
+      case OpCode::kWait:
+        if (flush_ != nullptr) flush_();
+        std::this_thread::sleep_for(std::chrono::milliseconds(operand));
+        break;
+      case OpCode::kLayerPush:
+        if (operand < (int)all_states_.size()) {
+          auto* new_state = &all_states_[operand];
+          if (new_state->activate()) {
+            ++counters_.layer_activations;
+            active_layers_.push_back(
+                LayerActivation{event_seq_num_++, key_event.value(), new_state,
+                                CompiledChildStack(operand)});
+          }
+        } else {
+          std::cerr << "WARNING: Invalid keyboard_state code. This is "
+                       "unexpected, please report a bug."
+                    << std::endl;
         }
-      } else {
-        std::cerr << "WARNING: Invalid keyboard_state code. This is "
-                     "unexpected, please report a bug."
-                  << std::endl;
-      }
-    } else {
-      std::cerr << "WARNING: Unknown action." << std::endl;
+        break;
+      default:
+        std::cerr << "WARNING: Unknown action." << std::endl;
     }
   }
 }
 
-// Keep track of the special combination to kill the program.
-void Remapper::ProcessCombos(const KeyEvent& key_event) {
-  if (key_event.value != KeyEventType::kKeyPress) return;
-  if (key_event.key_code == combo_kill_keycodes_[combo_kill_progress_])
-      [[unlikely]] {
-    if (++combo_kill_progress_ >= combo_kill_keycodes_.size()) {
-      throw std::runtime_error("Kill combo accepted.");
+// Keep track of the special combinations, to kill the program or to switch
+// profiles.
+bool Remapper::ProcessCombos(const KeyEvent& key_event) {
+  if (key_event.value != KeyEventType::kKeyPress) return false;
+  const auto matches = sequence_matcher_.Advance(key_event.key_code);
+  if (matches.empty()) [[likely]] {
+    return false;
+  }
+  // As typed, even if a match switches the profile.
+  const int profile_index = active_profile_;
+  bool matched = false;
+  for (const int id : matches) {
+    const auto& sequence = sequences_[id];
+    if (sequence.profile_index >= 0 &&
+        sequence.profile_index != profile_index) {
+      continue;
+    }
+    matched = true;
+    switch (sequence.kind) {
+      case SequenceKind::kKill:
+        throw std::runtime_error("Kill combo accepted.");
+      case SequenceKind::kSwitchProfile:
+        SwitchToProfile(sequence.switch_to);
+        break;
+      case SequenceKind::kActions:
+        ++counters_.remapped;
+        ProcessActions(Instructions(sequence.actions), std::nullopt);
+        break;
     }
-  } else [[likely]] {
-    combo_kill_progress_ = 0;
   }
+  return matched;
 }
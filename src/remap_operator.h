@@ -23,18 +23,25 @@
 // WIP.
 // TODO -
 // - Implement json config parsing.
-// - Need to handle repeats. 1 is press. 0 is release. And repeat is code 2.
 
+#include <bitset>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <optional>
+#include <span>
 #include <stack>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "axis_mapper.h"
+#include "debouncer.h"
 #include "keycode_lookup.h"
+#include "sequence_matcher.h"
 
 // Note: Negative, -key_code is interpreted as key realease, both as condition
 // and as an action.
@@ -107,9 +114,70 @@ struct ActionWait {
 
 using Action = std::variant<KeyEvent, ActionLayerChange, ActionWait>;
 
+// Actions as compiled into a Remapper, one 32-bit word each. The opcode is in
+// the top 8 bits, and its operand, e.g. a key code, in the lower 24.
+enum class OpCode : uint32_t {
+  // Same as KeyEventType, with the key code as operand.
+  kRelease = 0,
+  kPress = 1,
+  kRepeat = 2,
+  // Operand is the index of the state to activate.
+  kLayerPush = 3,
+  // Operand is in milliseconds.
+  kWait = 4,
+};
+
+using Instruction = uint32_t;
+
+inline constexpr int kOperandBits = 24;
+inline constexpr Instruction kOperandMask =
+    (Instruction(1) << kOperandBits) - 1;
+
+inline constexpr Instruction MakeInstruction(OpCode op_code, uint32_t operand) {
+  return (Instruction(op_code) << kOperandBits) | (operand & kOperandMask);
+}
+inline constexpr OpCode GetOpCode(Instruction instruction) {
+  return OpCode(instruction >> kOperandBits);
+}
+inline constexpr uint32_t GetOperand(Instruction instruction) {
+  return instruction & kOperandMask;
+}
+
+// Throws std::invalid_argument if an operand does not fit.
+Instruction CompileAction(const Action& action);
+Action DecompileInstruction(Instruction instruction);
+
+// A run of instructions in the program of a Remapper.
+struct ActionList {
+  uint32_t offset = 0;
+  uint32_t size = 0;
+
+  bool empty() const { return size == 0; }
+  bool operator==(const ActionList& other) const = default;
+};
+
 // KeyEvent to which action they are mapped.
-using ActionMap = std::unordered_map<KeyEvent, std::vector<Action>,
-                                     KeyEvent::Hash, KeyEvent::Equal>;
+using ActionMap =
+    std::unordered_map<KeyEvent, ActionList, KeyEvent::Hash, KeyEvent::Equal>;
+
+// How a held key repeats when repeats are done by the Remapper instead of the
+// kernel, see Remapper::SetRepeat().
+struct RepeatSettings {
+  enum class Mode {
+    // Repeats after delay, then every interval.
+    kRepeat,
+    // Does not repeat.
+    kOff,
+    // Released and pressed again every interval, as if tapped.
+    kRapidFire,
+  };
+  Mode mode = Mode::kRepeat;
+  std::chrono::milliseconds delay{0};
+  std::chrono::milliseconds interval{0};
+};
+
+// Name of the profile which exists in every Remapper. Its base state is "".
+inline const std::string kDefaultProfileName = "default";
 
 // Encapsulates the state in which the mapper is right now.
 // Layers are a kind of state.
@@ -123,7 +191,10 @@ struct KeyboardState {
   bool allow_other_keys = true;
   // If no interesting event such as keypress occurs while in this state, null
   // events are activated.
-  std::vector<Action> null_event_actions;
+  ActionList null_event_actions;
+  // For keys pressed while this is the top layer. If unset, as in the state
+  // below.
+  std::optional<RepeatSettings> repeat;
 
   // Following are internal state, maintained by the remapper.
 
@@ -157,6 +228,165 @@ struct KeyboardState {
   bool is_active_;
 };
 
+// Stacks of layers with more states than this are not compiled, see
+// Remapper::CompileLayerStacks().
+inline constexpr std::size_t kMaxLayerStacks = 1024;
+
+struct LayerStackStats {
+  std::size_t stacks = 0;
+  // Stacks which resolve keys the same share a table.
+  std::size_t tables = 0;
+  // Approximate.
+  std::size_t bytes = 0;
+};
+
+// A compiled table of layer stacks, e.g. to generate code from.
+struct ExportedLayerTable {
+  bool allow_other_keys;
+  // Sorted by key code, then value.
+  std::vector<std::pair<KeyEvent, std::vector<Instruction>>> entries;
+};
+
+struct OptimizeStats {
+  // Mappings of keys to themselves, which is what happens anyway.
+  std::size_t passthroughs_dropped = 0;
+  // Action lists stored once for several mappings.
+  std::size_t action_lists_merged = 0;
+};
+
+// How a SOCD (simultaneous opposing cardinal directions) group resolves its
+// keys when held together. At most one key of a group is held on the output.
+enum class SocdMode {
+  // The last pressed wins. On its release, the latest other one still held is
+  // pressed again.
+  kLastPriority,
+  // None while more than one is held.
+  kNeutral,
+  // The first pressed wins until it is released.
+  kFirstPriority,
+};
+
+// Keys of a group are bits of a uint64_t.
+inline constexpr std::size_t kMaxSocdKeys = 64;
+
+// Modifier keys held, as bits. Each side has its own bit, and each modifier
+// one more which is set while either side is held, so that e.g. Shift-ESC and
+// LShift-ESC are both one compare against the keys held.
+using ModifierMask = uint16_t;
+
+inline constexpr ModifierMask kModifierLeftShift = 1 << 0;
+inline constexpr ModifierMask kModifierRightShift = 1 << 1;
+inline constexpr ModifierMask kModifierLeftCtrl = 1 << 2;
+inline constexpr ModifierMask kModifierRightCtrl = 1 << 3;
+inline constexpr ModifierMask kModifierLeftAlt = 1 << 4;
+inline constexpr ModifierMask kModifierRightAlt = 1 << 5;
+inline constexpr ModifierMask kModifierLeftMeta = 1 << 6;
+inline constexpr ModifierMask kModifierRightMeta = 1 << 7;
+// Bits of all of the above.
+inline constexpr ModifierMask kModifierSides = 0xff;
+inline constexpr ModifierMask kModifierShift = 1 << 8;
+inline constexpr ModifierMask kModifierCtrl = 1 << 9;
+inline constexpr ModifierMask kModifierAlt = 1 << 10;
+inline constexpr ModifierMask kModifierMeta = 1 << 11;
+
+// Bit of a side of a modifier, e.g. kModifierLeftShift for KEY_LEFTSHIFT, or 0
+// for other keys.
+inline constexpr ModifierMask ModifierSideBit(int key_code) {
+  switch (key_code) {
+    case KEY_LEFTSHIFT:
+      return kModifierLeftShift;
+    case KEY_RIGHTSHIFT:
+      return kModifierRightShift;
+    case KEY_LEFTCTRL:
+      return kModifierLeftCtrl;
+    case KEY_RIGHTCTRL:
+      return kModifierRightCtrl;
+    case KEY_LEFTALT:
+      return kModifierLeftAlt;
+    case KEY_RIGHTALT:
+      return kModifierRightAlt;
+    case KEY_LEFTMETA:
+      return kModifierLeftMeta;
+    case KEY_RIGHTMETA:
+      return kModifierRightMeta;
+    default:
+      return 0;
+  }
+}
+
+// Sides held, with the bits for either side added.
+inline constexpr ModifierMask WithEitherSide(ModifierMask sides) {
+  ModifierMask mask = sides;
+  for (int modifier = 0; modifier < 4; ++modifier) {
+    if ((sides >> (2 * modifier)) & 3) mask |= kModifierShift << modifier;
+  }
+  return mask;
+}
+
+// E.g. "Shift", "LCtrl", to its bit. Case insensitive. Nullopt if unknown.
+std::optional<ModifierMask> ModifierNameToMask(const std::string& name);
+
+// E.g. "LCtrl-Shift", the reverse of ModifierNameToMask() for several bits.
+std::string ModifierMaskToName(ModifierMask mask);
+
+// Keys of a chord pressed within this of the first one act as the chord.
+inline constexpr int kDefaultChordWindowMs = 50;
+
+// How a chord, e.g. J & K, was used.
+struct ChordStats {
+  std::vector<int> key_codes;
+  // Times the chord was pressed.
+  uint64_t fired = 0;
+  // Times its keys were held back and then passed on as typed, and the delay
+  // that added to typing.
+  uint64_t typed_through = 0;
+  uint64_t delay_us = 0;
+  uint64_t max_delay_us = 0;
+};
+
+// Counts of key events, by how they were handled.
+struct RemapperCounters {
+  // Not remapped by any layer.
+  uint64_t passthrough = 0;
+  uint64_t remapped = 0;
+  // Neither remapped nor allowed by the active layer.
+  uint64_t blocked = 0;
+  uint64_t layer_activations = 0;
+  // Key events not emitted as the output was already in that state, e.g. a
+  // press of a key held by another mapping.
+  uint64_t redundant_dropped = 0;
+};
+
+// Snapshot of the runtime state of a Remapper, i.e. what is held and which
+// layers are active. Layers are referred to by name, so that the state can be
+// carried over to a Remapper built from a different config.
+struct RemapperState {
+  struct Layer {
+    int event_seq_num;
+    KeyEvent key_event;
+    std::string state_name;
+    bool null_event_applicable;
+  };
+
+  std::string profile_name = kDefaultProfileName;
+  int event_seq_num = 0;
+  // Pairs of key_code, event_seq_num when it was pressed.
+  std::vector<std::pair<int, int>> keys_held;
+  // Bottom of the stack first.
+  std::vector<Layer> active_layers;
+  // Keys held on the input device, sorted.
+  std::vector<int> input_keys_down;
+  // Carried over so that they do not reset on reloads.
+  RemapperCounters counters;
+  // Pairs of key code and chatter suppressed, see Debouncer.
+  std::vector<std::pair<int, uint64_t>> chatter;
+  // Keys held on the input whose release only releases the keys paired with
+  // them, rather than going through the mappings, e.g. the keys of a chord
+  // fired or of a modifier mapping pressed, which the new config may not
+  // have. Sorted by key code.
+  std::vector<std::pair<int, std::vector<int>>> bound_releases;
+};
+
 class Remapper {
  public:
   Remapper();
@@ -167,6 +397,15 @@ class Remapper {
 
   void SetCallback(std::function<void(int, int)> emit_key_code);
 
+  // Called when key events emitted so far must reach the output, i.e. before
+  // waiting within a macro. Optional.
+  void SetFlushCallback(std::function<void()> flush);
+
+  // Key events which would not change the output, i.e. a press of a key down
+  // on it, or a release or repeat of one up, are dropped before the callback
+  // and counted. If strict, they throw std::logic_error instead, for tests.
+  void SetStrictOutput(bool strict) { strict_output_ = strict; }
+
   // Default state_name is "".
   void AddMapping(const std::string& state_name, KeyEvent key_event,
                   const std::vector<Action>& actions);
@@ -180,11 +419,203 @@ class Remapper {
   // AddMapping().
   ActionLayerChange ActionActivateState(std::string state_name);
 
+  // Adds a profile, i.e. an alternative base state with its own layers. Only
+  // one profile is active at a time.
+  void AddProfile(const std::string& profile_name,
+                  const std::string& base_state_name);
+
+  // Sets keys which, typed in sequence, switch to the profile. Like the kill
+  // combo, these act on the actual keys typed regardless of mappings.
+  void SetProfileSwitchKeys(const std::string& profile_name,
+                            const std::vector<int>& key_codes);
+
+  // Adds keys which, typed in sequence while profile_name is active, perform
+  // the actions, e.g. RIGHTALT W for a word. Like profile switch keys, these
+  // act on the actual keys typed, and the last key is not passed on. Throws
+  // std::invalid_argument for an unknown profile or no keys.
+  void AddSequence(const std::string& profile_name,
+                   const std::vector<int>& key_codes,
+                   const std::vector<Action>& actions);
+
+  // Same as AddSequence(), switching to the profile switch_to instead.
+  void AddSequenceProfileSwitch(const std::string& profile_name,
+                                const std::vector<int>& key_codes,
+                                const std::string& switch_to);
+
+  // Same as AddSequence(), stopping keyshift like the kill combo instead.
+  void AddSequenceKill(const std::string& profile_name,
+                       const std::vector<int>& key_codes);
+
+  // Adds a group of keys of which only one is held at a time, e.g. A and D.
+  // Keys are resolved before mappings. Throws std::invalid_argument if a key
+  // is in another group of the profile, or for less than 2 or more than
+  // kMaxSocdKeys keys.
+  void AddSocdGroup(const std::string& profile_name,
+                    const std::vector<int>& key_codes, SocdMode mode);
+
+  // Adds keys which, pressed within the chord window of each other, act as
+  // one, e.g. J & K for ESC. The press actions are performed once all are
+  // pressed, and the release actions once any is released. Keys which may
+  // still become a chord are held back, and passed on as soon as no chord can
+  // match. Throws std::invalid_argument for less than 2 keys, keys repeated,
+  // a chord already added or actions which activate layers.
+  void AddChord(const std::string& profile_name,
+                const std::vector<int>& key_codes,
+                const std::vector<Action>& press_actions,
+                const std::vector<Action>& release_actions);
+
+  // Maps a key of the base state of a profile while the modifiers are held,
+  // e.g. ESC with kModifierShift for Shift-ESC, ahead of the mappings of the
+  // state. Unlike a layer on the modifier, the modifier itself stays a plain
+  // key. Applies only while no layer is active, the most modifiers first if
+  // several match. A release or repeat goes to the mapping which took the
+  // press. Throws std::invalid_argument for no modifiers, a mapping already
+  // added or actions which activate layers.
+  void AddModifierMapping(const std::string& profile_name, int key_code,
+                          ModifierMask modifiers,
+                          const std::vector<Action>& press_actions,
+                          const std::vector<Action>& release_actions);
+
+  // Repeats keys pressed while the state is the top layer, or in a base
+  // state, in software instead of by the kernel, whose repeats of them are
+  // dropped. As with the kernel, only the key pressed last repeats, while
+  // any number of keys can rapid fire. Throws std::invalid_argument for a
+  // delay or interval out of range.
+  void SetRepeat(const std::string& state_name, RepeatSettings settings);
+
+  // Same as SetRepeat(), for a key in any state of the profile. Takes
+  // precedence over SetRepeat().
+  void SetKeyRepeat(const std::string& profile_name, int key_code,
+                    RepeatSettings settings);
+
+  void SetChordWindow(int milli_seconds) {
+    chord_window_ = std::chrono::milliseconds(milli_seconds);
+  }
+
+  using Clock = std::chrono::steady_clock;
+
+  // Debounces a key, or all keys not set on their own if key_code is nullopt,
+  // ahead of everything else. Applies to all profiles. Zero does not debounce.
+  // Throws std::invalid_argument for a window out of range.
+  void SetDebounce(std::optional<int> key_code, int milli_seconds);
+
+  const Debouncer& debouncer() const { return debouncer_; }
+
+  // Maps an axis of a gamepad or joystick to keys, which are then processed
+  // as if typed. Applies to all profiles. The mapping is run by an
+  // AxisMapper, set up with the range of the device's axis. Throws
+  // std::invalid_argument for an axis mapped already, no keys, or
+  // percentages out of order.
+  void AddAxisMapping(const AxisMapping& mapping);
+
+  const std::vector<AxisMapping>& axis_mappings() const {
+    return axis_mappings_;
+  }
+
+  // For tests, to use instead of Clock::now().
+  void SetClock(std::function<Clock::time_point()> clock) { clock_ = clock; }
+
+  // When Tick() is next due, while keys are held back for chords, repeated
+  // in software or within their debounce window.
+  std::optional<Clock::time_point> NextDeadline() const;
+
+  // Resolves keys held back for chords once the chord window has passed,
+  // performs repeats which are due, and passes on keys which settled after
+  // chattering.
+  void Tick();
+
+  // Passes on keys held back for chords at once, e.g. before a reload.
+  void FlushChords();
+
+  // Per chord of the active profile.
+  std::vector<ChordStats> chord_stats() const;
+
+  // Switches to a profile, releasing everything held in the current one.
+  // Returns false if there is no such profile.
+  bool SelectProfile(const std::string& profile_name);
+
+  const std::string& ActiveProfileName() const;
+
+  std::vector<std::string> ProfileNames() const;
+
+  // Activates a state by name, as if a layer key was pressed, until
+  // DeactivateState() is called. Returns false if the state does not exist or
+  // is already active.
+  bool ActivateState(const std::string& state_name);
+
+  // Deactivates an active state, along with any activated after it. Returns
+  // false if it is not active.
+  bool DeactivateState(const std::string& state_name);
+
   void Process(const int key_code_int, const int value);
 
+  // Simplifies the parsed config without changing what it does. To be called
+  // once mappings are added, before CompileLayerStacks().
+  OptimizeStats Optimize();
+
+  // Approximate memory taken by mappings, including compiled layer stacks.
+  std::size_t MemoryUsage() const;
+
+  // Precomputes, for every stack of layers which keys can activate, one table
+  // which resolves key events as walking the layers would. A key event then
+  // costs a single lookup regardless of how many layers are active. Returns
+  // false, leaving layers to be walked, if there are more than
+  // kMaxLayerStacks stacks. Changing mappings afterwards undoes it.
+  bool CompileLayerStacks();
+
+  // Empty if layer stacks are not compiled.
+  std::optional<LayerStackStats> layer_stack_stats() const;
+
+  // Compiled tables by index. Empty if layer stacks are not compiled.
+  std::vector<ExportedLayerTable> ExportLayerTables() const;
+
+  // Identifies the compiled layer stacks and tables, so that code generated
+  // from them can be checked to match. 0 if not compiled.
+  uint64_t LayerStacksFingerprint() const;
+
+  // In builds with KEYSHIFT_EMBEDDED_CONFIG, keys are looked up in code
+  // generated from the compiled tables, see keyshift_embed.cpp, once
+  // CompileLayerStacks() finds the same tables. Returns whether they are used.
+  bool UseEmbeddedTables(bool use);
+
   // Prints the existing config to terminal.
   void DumpConfig(std::ostream& os = std::cout) const;
 
+  // Mappings of the base state which only turn one key into another, with
+  // neither key used anywhere else, nor in combos. The kernel can remap those
+  // instead, see kernel_keymap.h. Returns sorted {from, to} pairs. Empty if
+  // there are several profiles, as the base state then changes.
+  std::vector<std::pair<int, int>> PureRemaps() const;
+
+  // Removes the mappings of a key from the base state, e.g. once the kernel
+  // remaps it.
+  void RemoveBaseMappings(int key_code);
+
+  // Key codes which may be emitted by mappings, sorted. Keys passed through
+  // are not included.
+  std::vector<int> EmittedKeyCodes() const;
+
+  // Key codes which mappings, combos, chords and SOCD groups react to,
+  // sorted. Keys of axes are included, as they are mapped like any other.
+  std::vector<int> InputKeyCodes() const;
+
+  const RemapperCounters& counters() const { return counters_; }
+
+  // Brings the Remapper in line with the keys actually held on the input
+  // device, e.g. after the kernel dropped events. Keys no longer held are
+  // released, then keys newly held are pressed, as if typed, except that they
+  // do not complete sequences such as the kill combo.
+  void Resync(const std::vector<int>& input_keys_down);
+
+  // Returns the keys held and layers active.
+  RemapperState GetState() const;
+
+  // Adopts the state of another Remapper, e.g. one with an older config.
+  // Layers are restored by name, bottom up. At the first layer which no longer
+  // exists the restoration stops, and keys pressed since that layer was
+  // activated are released. Must be called before any Process().
+  void RestoreState(const RemapperState& state);
+
  private:
   // Finds index of keyboard_state name. If it doesn't exist, adds it.
   int StateNameToIndex(const std::string& state_name);
@@ -197,20 +628,126 @@ class Remapper {
 
   void DeactivateNLayers(const int n);
 
+  // Deactivates all layers without triggering their null events, and releases
+  // all keys held.
+  void ReleaseAll();
+
   void ProcessKeyEvent(const KeyEvent& key_event);
 
-  // Expands an user-keypress into actions to be processed.
-  const std::vector<Action> ExpandToActions(const KeyEvent& key_event) const;
+  // Process() for key events after debouncing. Presses advance the sequences
+  // only if match_sequences, i.e. not for keys found held by Resync(), which
+  // were not typed in that order.
+  void ProcessDebounced(const int key_code_int, const int value,
+                        bool match_sequences = true);
+
+  // Process() for key events after sequences.
+  void ProcessTyped(const KeyEvent& key_event);
+
+  // Process() for key events after chords.
+  void ProcessInput(const KeyEvent& key_event);
+
+  // Holds back keys which may still become a chord.
+  void ProcessChords(const KeyEvent& key_event);
+
+  // Resolves keys held back for chords once the chord window has passed.
+  void ExpireChords();
+
+  // Starts and stops repeats in software. Returns false if the key event is
+  // replaced by them, and should not be processed further.
+  bool TrackRepeats(const KeyEvent& key_event);
+
+  // Settings of a key pressed now, or nullptr if the kernel repeats it.
+  const RepeatSettings* RepeatSettingsOf(int key_code) const;
+
+  // Passes on the keys held back, as typed.
+  void PassOnPendingChordKeys();
+
+  void FireChord(int chord_index);
+
+  // Process() for key events resolved by SOCD groups, if any.
+  void ProcessResolved(const KeyEvent& key_event);
+
+  // Resolves an event of a key in a SOCD group, at socd_slots_[key_code].
+  void ProcessSocd(const KeyEvent& key_event, int slot);
+
+  // Returns true if a modifier mapping took the key event.
+  bool ProcessModifierMapping(const KeyEvent& key_event);
+
+  // Returns true if the key event is of a key in bound_releases_, which
+  // takes its release and repeats.
+  bool ProcessBoundRelease(const KeyEvent& key_event);
+
+  // Keys the actions release.
+  std::vector<int> ReleasedKeyCodes(const ActionList& actions) const;
+
+  // Updates socd_slots_, chord_keys_ and modifier_mapped_keys_ for the active
+  // profile.
+  void UpdateProfileKeys();
+
+  // Appends actions to program_.
+  ActionList Compile(const std::vector<Action>& actions);
+
+  std::span<const Instruction> Instructions(const ActionList& actions) const {
+    return {program_.data() + actions.offset, actions.size};
+  }
+
+  // Expands an user-keypress into actions to be processed. Actions not in
+  // program_, e.g. for keys passed through, are written to scratch.
+  std::span<const Instruction> ExpandToActions(const KeyEvent& key_event,
+                                               Instruction& scratch) const;
 
-  void ProcessActions(const std::vector<Action>& actions,
+  void ProcessActions(std::span<const Instruction> actions,
                       const std::optional<KeyEvent> key_event);
 
-  void ProcessCombos(const KeyEvent& key_event);
+  // Resolves a key event within one state, as part of walking the layers.
+  // Returns true if the state decides the actions, possibly none.
+  bool ResolveInState(const KeyboardState& state, const KeyEvent& key_event,
+                      std::span<const Instruction>& result,
+                      Instruction& scratch) const;
+
+  void ClearCompiledStacks();
+
+  // Index in compiled_stacks_ of the active layers, or -1 if not compiled.
+  int CurrentCompiledStack() const {
+    if (!active_layers_.empty()) return active_layers_.back().compiled_stack;
+    return compiled_base_stacks_.empty()
+               ? -1
+               : compiled_base_stacks_[active_profile_];
+  }
+
+  // Index in compiled_stacks_ once a state is activated on top of the active
+  // layers, or -1 if not compiled.
+  int CompiledChildStack(int state_index) const;
+
+  // Returns true if the key_event completed a sequence of keys, and should
+  // not be processed further.
+  bool ProcessCombos(const KeyEvent& key_event);
+
+  enum class SequenceKind { kActions, kSwitchProfile, kKill };
+
+  struct Sequence {
+    // Profile in which the sequence applies, or -1 for all of them.
+    int profile_index;
+    SequenceKind kind;
+    // For kActions.
+    ActionList actions;
+    // For kSwitchProfile.
+    std::size_t switch_to;
+  };
+
+  // Index of a profile, or throws std::invalid_argument.
+  std::size_t ProfileIndex(const std::string& profile_name) const;
+
+  void AddSequence(const std::vector<int>& key_codes,
+                   const Sequence& sequence);
+
+  // Does not parse or allocate, to be usable from Process().
+  void SwitchToProfile(std::size_t profile_index);
 
   // TODO: Optimization to keep the active state updated in a variable?
   inline KeyboardState& active_state() {
     return active_layers_.size() > 0 ? *active_layers_.back().this_state
-                                     : all_states_[0];
+                                     : all_states_[base_state_index_];
   }
 
   // These will be stored in a stack as new layers get activated.
@@ -218,6 +755,8 @@ class Remapper {
     int event_seq_num;         // When the layer was activated.
     const KeyEvent key_event;  // key_code that activated this layer.
     KeyboardState* this_state = nullptr;
+    // Index in compiled_stacks_ of the layers up to this one, or -1.
+    int compiled_stack = -1;
   };
 
   // Do not use this directly, use StateNameToIndex().
@@ -226,6 +765,122 @@ class Remapper {
   // Index can be looked up from state name with StateToNameIndex().
   std::vector<KeyboardState> all_states_;
 
+  // Actions of all states, referred to by ActionList.
+  std::vector<Instruction> program_;
+
+  // See CompileLayerStacks().
+  struct CompiledTable {
+    ActionMap action_map;
+    // Otherwise keys not in action_map are blocked.
+    bool allow_other_keys = true;
+  };
+  struct CompiledStack {
+    int table;
+    // State index activated on top, to index of the resulting stack.
+    std::unordered_map<int, int> children;
+  };
+  std::vector<CompiledTable> compiled_tables_;
+  std::vector<CompiledStack> compiled_stacks_;
+  // Index in compiled_stacks_ of the base state of each profile.
+  std::vector<int> compiled_base_stacks_;
+  // See UseEmbeddedTables().
+  bool use_embedded_tables_ = false;
+
+  // Reverse of state_name_to_index_.
+  std::vector<std::string> state_names_;
+
+  struct SocdGroup {
+    std::vector<int> key_codes;
+    SocdMode mode;
+    // Bits of key_codes held on the input, and on the output.
+    uint64_t held = 0;
+    uint64_t output = 0;
+    // Bits held on the input, earliest pressed first.
+    std::vector<uint8_t> press_order;
+  };
+
+  struct Chord {
+    // Sorted.
+    std::vector<int> key_codes;
+    ActionList press_actions;
+    ActionList release_actions;
+    ChordStats stats;
+  };
+
+  struct ModifierMapping {
+    ModifierMask modifiers;
+    ActionList press_actions;
+    ActionList release_actions;
+  };
+
+  struct Profile {
+    std::string name;
+    int base_state_index;
+    // Only to show, as sequences_ has them.
+    std::vector<int> switch_keys;
+    std::vector<SocdGroup> socd_groups;
+    std::vector<Chord> chords;
+    // By key code, the most modifiers first.
+    std::unordered_map<int, std::vector<ModifierMapping>> modifier_mappings;
+    // See SetKeyRepeat().
+    std::unordered_map<int, RepeatSettings> key_repeats;
+  };
+  // The first one is always the default profile.
+  std::vector<Profile> profiles_;
+  std::size_t active_profile_ = 0;
+  // Same as profiles_[active_profile_].base_state_index.
+  int base_state_index_ = 0;
+  // Per key code, the SOCD group of the active profile it is in and its bit,
+  // as group * kMaxSocdKeys + bit. -1 if none.
+  std::vector<int16_t> socd_slots_;
+
+  // Keys of the chords of the active profile.
+  std::bitset<KEY_CNT> chord_keys_;
+  // Presses held back while they may still become a chord, in order, and
+  // since when.
+  std::vector<int> pending_chord_keys_;
+  Clock::time_point pending_since_;
+  // Chord of the active profile to release on the first release of its keys,
+  // or -1.
+  int active_chord_ = -1;
+  // Keys of chords pressed, which do nothing more until released.
+  std::bitset<KEY_CNT> chorded_keys_;
+  std::chrono::milliseconds chord_window_{kDefaultChordWindowMs};
+  std::function<Clock::time_point()> clock_ = Clock::now;
+  // Scratch space for PassOnPendingChordKeys(). Kept to avoid allocations.
+  std::vector<int> keys_to_pass_on_;
+
+  // If any repeat settings are set, see SetRepeat().
+  bool software_repeat_ = false;
+  // Keys held whose repeats are done in software, or not at all.
+  std::bitset<KEY_CNT> soft_repeat_keys_;
+  // Key repeated in software, or -1, and when it repeats next.
+  int repeating_key_ = -1;
+  std::chrono::milliseconds repeat_interval_{0};
+  Clock::time_point next_repeat_;
+  struct RapidFire {
+    int key_code;
+    // Between each release and press.
+    std::chrono::milliseconds half_interval;
+    Clock::time_point next;
+    // Whether it is pressed on the output.
+    bool down;
+  };
+  std::vector<RapidFire> rapid_fires_;
+
+  Debouncer debouncer_;
+  std::vector<AxisMapping> axis_mappings_;
+
+  // Keys with modifier mappings in the active profile.
+  std::bitset<KEY_CNT> modifier_mapped_keys_;
+  // Modifiers held on the input, see WithEitherSide().
+  ModifierMask modifiers_held_ = 0;
+  // Keys pressed by a modifier mapping, to the actions of their release.
+  std::unordered_map<int, ActionList> modifier_mapped_releases_;
+  // Keys held on the input to the keys their release releases, as carried
+  // over by RestoreState(), see RemapperState::bound_releases.
+  std::unordered_map<int, std::vector<int>> bound_releases_;
+
   // Previous mappings. This is used as mappings get deactivated.
   // Pair of key_code, mapping_index.
   std::vector<LayerActivation> active_layers_;
@@ -234,16 +889,29 @@ class Remapper {
   // If somehow a key is pressed multiple times (e.g. repeats maybe?) then this
   // holds the last occurrence, as per the event_seq_num.
   std::unordered_map<int, int> keys_held_;
+  // Keys held on the input device, as seen by Process(). Unlike keys_held_,
+  // which are the keys held on the output.
+  std::bitset<KEY_CNT> input_keys_down_;
+  // Keys down on the output, as emitted. See SetStrictOutput().
+  std::bitset<KEY_CNT> output_keys_down_;
+  bool strict_output_ = false;
 
   // Can only increase.
   int event_seq_num_ = 0;
 
+  RemapperCounters counters_;
+
   // On Process(), key_codes are emitted via this callback.
   std::function<void(int, int)> emit_key_code_ = nullptr;
+  std::function<void()> flush_ = nullptr;
+
+  // Matches typed keys to sequences_, by id. Includes the kill combo.
+  SequenceMatcher sequence_matcher_;
+  std::vector<Sequence> sequences_;
 
-  // Progress to typing the kill combo.
-  std::vector<int> combo_kill_keycodes_;
-  std::size_t combo_kill_progress_ = 0;
+  // Scratch space to sort keys being released, pairs of event_seq_num and
+  // key_code. Kept to avoid allocations.
+  std::vector<std::pair<int, int>> keys_to_release_;
 };
 
 #endif  // __REMAP_OPERATOR_H
\ No newline at end of file
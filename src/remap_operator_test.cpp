@@ -181,3 +181,224 @@ SCENARIO("Must repeat - both mapped and passthru keys") {
     }
   }
 }
+
+SCENARIO("State is carried over to a new config") {
+  const auto make_remapper = [](bool with_layer) {
+    Remapper remapper;
+    remapper.AddMapping("", KeyPressEvent(KEY_CAPSLOCK),
+                        {remapper.ActionActivateState("caps")});
+    if (with_layer) {
+      remapper.AddMapping("caps", KeyPressEvent(KEY_1),
+                          {KeyPressEvent(KEY_F1)});
+      remapper.AddMapping("caps", KeyReleaseEvent(KEY_1),
+                          {KeyReleaseEvent(KEY_F1)});
+    }
+    return remapper;
+  };
+
+  GIVEN("A held layer key, and a key held within it") {
+    Remapper old_remapper = make_remapper(true);
+    CHECK(GetOutcomes(old_remapper, false,
+                      {{KEY_LEFTSHIFT, 1}, {KEY_CAPSLOCK, 1}, {KEY_1, 1}}) ==
+          vector<string>{"Out: P KEY_LEFTSHIFT", "Out: P KEY_F1"});
+
+    THEN("The layer continues if it still exists") {
+      Remapper new_remapper = make_remapper(true);
+      CHECK(GetOutcomes(new_remapper, false, {}).empty());
+      new_remapper.RestoreState(old_remapper.GetState());
+      CHECK(GetOutcomes(new_remapper, false,
+                        {{KEY_1, 0}, {KEY_CAPSLOCK, 0}, {KEY_LEFTSHIFT, 0}}) ==
+            vector<string>{"Out: R KEY_F1", "Out: R KEY_LEFTSHIFT"});
+    }
+
+    THEN("Keys within a removed layer are released") {
+      Remapper new_remapper;
+      std::vector<string> released;
+      new_remapper.SetCallback([&released](int keycode, int) {
+        released.push_back(KeyCodeToName(keycode));
+      });
+      new_remapper.RestoreState(old_remapper.GetState());
+      CHECK(released == vector<string>{"KEY_F1"});
+      // Keys held before the layer are unaffected.
+      CHECK(GetOutcomes(new_remapper, false,
+                        {{KEY_CAPSLOCK, 0}, {KEY_LEFTSHIFT, 0}}) ==
+            vector<string>{"Out: R KEY_LEFTSHIFT"});
+    }
+  }
+}
+
+SCENARIO("Releases of chords are carried over to a new config") {
+  Remapper old_remapper;
+  old_remapper.AddChord(kDefaultProfileName, {KEY_J, KEY_K},
+                        {KeyPressEvent(KEY_ESC)}, {KeyReleaseEvent(KEY_ESC)});
+  CHECK(GetOutcomes(old_remapper, false, {{KEY_J, 1}, {KEY_K, 1}}) ==
+        vector<string>{"Out: P KEY_ESC"});
+
+  // Without the chord, and K mapped otherwise.
+  Remapper new_remapper;
+  new_remapper.AddMapping("", KeyPressEvent(KEY_K), {KeyPressEvent(KEY_UP)});
+  new_remapper.AddMapping("", KeyReleaseEvent(KEY_K),
+                          {KeyReleaseEvent(KEY_UP)});
+  CHECK(GetOutcomes(new_remapper, false, {}).empty());
+  new_remapper.RestoreState(old_remapper.GetState());
+
+  THEN("The first key released releases the chord, and the other nothing") {
+    CHECK(GetOutcomes(new_remapper, false,
+                      {{KEY_K, 2}, {KEY_J, 0}, {KEY_K, 0}}) ==
+          vector<string>{"Out: R KEY_ESC"});
+    CHECK(GetOutcomes(new_remapper, false, {{KEY_K, 1}, {KEY_K, 0}}) ==
+          vector<string>{"Out: P KEY_UP", "Out: R KEY_UP"});
+  }
+}
+
+SCENARIO("Releases of modifier mappings are carried over to a new config") {
+  Remapper old_remapper;
+  old_remapper.AddModifierMapping(kDefaultProfileName, KEY_ESC,
+                                  kModifierShift, {KeyPressEvent(KEY_GRAVE)},
+                                  {KeyReleaseEvent(KEY_GRAVE)});
+  CHECK(GetOutcomes(old_remapper, false,
+                    {{KEY_LEFTSHIFT, 1}, {KEY_ESC, 1}}) ==
+        vector<string>{"Out: P KEY_LEFTSHIFT", "Out: P KEY_GRAVE"});
+
+  Remapper new_remapper;
+  CHECK(GetOutcomes(new_remapper, false, {}).empty());
+  new_remapper.RestoreState(old_remapper.GetState());
+
+  THEN("Releasing the key releases what the mapping pressed") {
+    CHECK(GetOutcomes(new_remapper, false,
+                      {{KEY_ESC, 2}, {KEY_ESC, 0}, {KEY_LEFTSHIFT, 0}}) ==
+          vector<string>{"Out: R KEY_GRAVE", "Out: R KEY_LEFTSHIFT"});
+    CHECK(GetOutcomes(new_remapper, false, {{KEY_ESC, 1}, {KEY_ESC, 0}}) ==
+          vector<string>{"Out: P KEY_ESC", "Out: R KEY_ESC"});
+  }
+}
+
+SCENARIO("States can be activated by name") {
+  Remapper remapper;
+  remapper.AddMapping("fn", KeyPressEvent(KEY_1), {KeyPressEvent(KEY_F1)});
+  remapper.AddMapping("fn", KeyReleaseEvent(KEY_1), {KeyReleaseEvent(KEY_F1)});
+
+  CHECK(!remapper.ActivateState("unknown"));
+  CHECK(!remapper.DeactivateState("fn"));
+
+  CHECK(remapper.ActivateState("fn"));
+  CHECK(!remapper.ActivateState("fn"));
+  CHECK(GetOutcomes(remapper, false, {{KEY_1, 1}}) ==
+        vector<string>{"Out: P KEY_F1"});
+  // Keys held within the state are released with it.
+  std::vector<string> outcomes;
+  remapper.SetCallback([&outcomes](int keycode, int value) {
+    outcomes.push_back((value == 1 ? "P " : "R ") + KeyCodeToName(keycode));
+  });
+  CHECK(remapper.DeactivateState("fn"));
+  CHECK(outcomes == vector<string>{"R KEY_F1"});
+  CHECK(GetOutcomes(remapper, false, {{KEY_1, 0}, {KEY_1, 1}}) ==
+        vector<string>{"Out: P KEY_1"});
+}
+
+SCENARIO("Switching profiles") {
+  Remapper remapper;
+  remapper.AddProfile("game", "game/");
+  remapper.AddMapping("game/", KeyPressEvent(KEY_A), {KeyPressEvent(KEY_B)});
+  remapper.AddMapping("game/", KeyReleaseEvent(KEY_A),
+                      {KeyReleaseEvent(KEY_B)});
+
+  CHECK(remapper.ProfileNames() == vector<string>{"default", "game"});
+  CHECK(!remapper.SelectProfile("unknown"));
+  CHECK(remapper.ActiveProfileName() == "default");
+  CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}, {KEY_A, 0}}) ==
+        vector<string>{"Out: P KEY_A", "Out: R KEY_A"});
+
+  // Keys held are released on switching.
+  CHECK(GetOutcomes(remapper, false, {{KEY_C, 1}}) ==
+        vector<string>{"Out: P KEY_C"});
+  std::vector<string> released;
+  remapper.SetCallback([&released](int keycode, int) {
+    released.push_back(KeyCodeToName(keycode));
+  });
+  CHECK(remapper.SelectProfile("game"));
+  CHECK(released == vector<string>{"KEY_C"});
+  CHECK(remapper.ActiveProfileName() == "game");
+  CHECK(GetOutcomes(remapper, false, {{KEY_C, 0}, {KEY_A, 1}, {KEY_A, 0}}) ==
+        vector<string>{"Out: P KEY_B", "Out: R KEY_B"});
+}
+
+SCENARIO("Resync after dropped events") {
+  Remapper remapper;
+  remapper.AddMapping("", KeyPressEvent(KEY_A), {KeyPressEvent(KEY_B)});
+  remapper.AddMapping("", KeyReleaseEvent(KEY_A), {KeyReleaseEvent(KEY_B)});
+  remapper.AddMapping("", KeyPressEvent(KEY_CAPSLOCK),
+                      {remapper.ActionActivateState("caps")});
+  remapper.AddMapping("caps", KeyPressEvent(KEY_1), {KeyPressEvent(KEY_F1)});
+
+  CHECK(GetOutcomes(remapper, false,
+                    {{KEY_A, 1}, {KEY_CAPSLOCK, 1}, {KEY_1, 1}}) ==
+        vector<string>{"Out: P KEY_B", "Out: P KEY_F1"});
+
+  std::vector<string> outcomes;
+  remapper.SetCallback([&outcomes](int keycode, int value) {
+    outcomes.push_back((value == 1 ? "P " : "R ") + KeyCodeToName(keycode));
+  });
+
+  GIVEN("Some keys were released and others pressed meanwhile") {
+    remapper.Resync({KEY_1, KEY_C});
+    THEN("Only the difference is typed") {
+      CHECK(outcomes == vector<string>{"R KEY_B", "R KEY_F1", "P KEY_C"});
+      CHECK(remapper.GetState().active_layers.empty());
+      CHECK(remapper.GetState().input_keys_down ==
+            std::vector<int>{KEY_1, KEY_C});
+    }
+  }
+
+  GIVEN("Nothing changed") {
+    remapper.Resync({KEY_A, KEY_1, KEY_CAPSLOCK});
+    THEN("Nothing is typed") { CHECK(outcomes.empty()); }
+  }
+}
+
+SCENARIO("Resync does not complete sequences") {
+  Remapper remapper;
+  remapper.AddSequence(kDefaultProfileName, {KEY_X, KEY_Y},
+                       {KeyPressEvent(KEY_Z), KeyReleaseEvent(KEY_Z)});
+  remapper.AddSequenceKill(kDefaultProfileName, {KEY_I, KEY_K, KEY_L});
+
+  CHECK(GetOutcomes(remapper, false, {{KEY_X, 1}, {KEY_X, 0}}) ==
+        vector<string>{"Out: P KEY_X", "Out: R KEY_X"});
+  std::vector<string> outcomes;
+  remapper.SetCallback([&outcomes](int keycode, int value) {
+    outcomes.push_back((value == 1 ? "P " : "R ") + KeyCodeToName(keycode));
+  });
+
+  THEN("Keys found held are pressed, and typing starts over") {
+    // Pressed by key code, i.e. Y, I, K, L.
+    CHECK_NOTHROW(remapper.Resync({KEY_I, KEY_K, KEY_L, KEY_Y}));
+    CHECK(outcomes ==
+          vector<string>{"P KEY_Y", "P KEY_I", "P KEY_K", "P KEY_L"});
+    outcomes.clear();
+    remapper.Process(KEY_Y, 0);
+    remapper.Process(KEY_Y, 1);
+    CHECK(outcomes == vector<string>{"R KEY_Y", "P KEY_Y"});
+  }
+}
+
+TEST_CASE("Actions compile to instructions", "[remapper]") {
+  const vector<Action> actions = {
+      KeyPressEvent(KEY_A), KeyReleaseEvent(KEY_B),
+      KeyEvent{KEY_MICMUTE, KeyEventType::kKeyRepeat}, ActionLayerChange{3},
+      ActionWait{1000}};
+  for (const auto& action : actions) {
+    const Action decompiled = DecompileInstruction(CompileAction(action));
+    CHECK(decompiled.index() == action.index());
+    CHECK(CompileAction(decompiled) == CompileAction(action));
+  }
+  CHECK(GetOpCode(CompileAction(KeyPressEvent(KEY_A))) == OpCode::kPress);
+  CHECK(GetOperand(CompileAction(ActionWait{1000})) == 1000);
+  CHECK_THROWS(CompileAction(ActionWait{-1}));
+
+  Remapper remapper;
+  // Appending to a mapping keeps the actions in order.
+  remapper.AddMapping("", KeyPressEvent(KEY_A), {KeyPressEvent(KEY_B)});
+  remapper.AddMapping("", KeyPressEvent(KEY_A), {KeyPressEvent(KEY_C)});
+  CHECK(GetOutcomes(remapper, false, {{KEY_A, 1}}) ==
+        vector<string>{"Out: P KEY_B", "Out: P KEY_C"});
+}
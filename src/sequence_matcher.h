@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SEQUENCE_MATCHER_H
+#define __SEQUENCE_MATCHER_H
+
+#include <cstdint>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Matches sequences of key presses, e.g. the kill combo, as an Aho-Corasick
+// automaton. Each press is one table lookup however many sequences there are,
+// and sequences which overlap, e.g. typing KKILL for KILL, are still found.
+//
+// Transitions are over symbols, i.e. the keys used by any sequence plus one
+// for all other keys, which keeps the table small.
+class SequenceMatcher {
+ public:
+  SequenceMatcher() { Build(); }
+
+  // Adds a sequence, and returns its id. Ids count up from 0.
+  int Add(const std::vector<int>& key_codes) {
+    if (key_codes.empty()) throw std::invalid_argument("Empty key sequence");
+    for (const int key_code : key_codes) {
+      if (key_code < 0) throw std::invalid_argument("Invalid key code");
+    }
+    sequences_.push_back(key_codes);
+    Build();
+    return sequences_.size() - 1;
+  }
+
+  // To be called on every key press. Returns ids of the sequences which the
+  // press completes, longest first.
+  std::span<const int> Advance(int key_code) {
+    const std::size_t symbol =
+        key_code >= 0 && std::size_t(key_code) < symbols_.size()
+            ? symbols_[key_code]
+            : 0;
+    state_ = transitions_[state_ * num_symbols_ + symbol];
+    return std::span<const int>(matches_)
+        .subspan(match_offsets_[state_],
+                 match_offsets_[state_ + 1] - match_offsets_[state_]);
+  }
+
+  // Forgets keys typed so far.
+  void Reset() { state_ = 0; }
+
+  const std::vector<std::vector<int>>& sequences() const { return sequences_; }
+
+  std::size_t bytes() const {
+    return transitions_.capacity() * sizeof(uint32_t) +
+           symbols_.capacity() * sizeof(uint16_t) +
+           (matches_.capacity() + match_offsets_.capacity()) * sizeof(int);
+  }
+
+ private:
+  void Build() {
+    symbols_.clear();
+    num_symbols_ = 1;
+    for (const auto& sequence : sequences_) {
+      for (const int key_code : sequence) {
+        if (std::size_t(key_code) >= symbols_.size()) {
+          symbols_.resize(key_code + 1, 0);
+        }
+        if (symbols_[key_code] == 0) symbols_[key_code] = num_symbols_++;
+      }
+    }
+
+    // The trie of sequences, with kNone for missing transitions.
+    constexpr uint32_t kNone = UINT32_MAX;
+    transitions_.assign(num_symbols_, kNone);
+    std::vector<std::vector<int>> matches(1);
+    for (std::size_t id = 0; id < sequences_.size(); ++id) {
+      uint32_t state = 0;
+      for (const int key_code : sequences_[id]) {
+        auto& next = transitions_[state * num_symbols_ + symbols_[key_code]];
+        if (next == kNone) {
+          next = matches.size();
+          matches.emplace_back();
+          transitions_.resize(transitions_.size() + num_symbols_, kNone);
+        }
+        // Not `next`, as the resize may have moved it.
+        state = transitions_[state * num_symbols_ + symbols_[key_code]];
+      }
+      matches[state].push_back(id);
+    }
+
+    // Breadth first, so that the longest proper suffix of each state, which
+    // is shallower, is complete when the state is reached. Missing
+    // transitions then go where that suffix goes.
+    std::vector<uint32_t> suffix(matches.size(), 0);
+    std::queue<uint32_t> queue;
+    queue.push(0);
+    while (!queue.empty()) {
+      const uint32_t state = queue.front();
+      queue.pop();
+      if (state != 0) {
+        const auto& inherited = matches[suffix[state]];
+        matches[state].insert(matches[state].end(), inherited.begin(),
+                              inherited.end());
+      }
+      for (std::size_t symbol = 0; symbol < num_symbols_; ++symbol) {
+        auto& next = transitions_[state * num_symbols_ + symbol];
+        const uint32_t fallback =
+            state == 0 ? 0
+                       : transitions_[suffix[state] * num_symbols_ + symbol];
+        if (next == kNone) {
+          next = fallback;
+        } else {
+          suffix[next] = fallback;
+          queue.push(next);
+        }
+      }
+    }
+
+    matches_.clear();
+    match_offsets_.assign(1, 0);
+    for (const auto& state_matches : matches) {
+      matches_.insert(matches_.end(), state_matches.begin(),
+                      state_matches.end());
+      match_offsets_.push_back(matches_.size());
+    }
+    state_ = 0;
+  }
+
+  std::vector<std::vector<int>> sequences_;
+  // Per key code, its symbol. 0 for keys in no sequence.
+  std::vector<uint16_t> symbols_;
+  std::size_t num_symbols_ = 1;
+  // Next state, at state * num_symbols_ + symbol.
+  std::vector<uint32_t> transitions_;
+  // Ids of sequences completed on reaching a state, at
+  // match_offsets_[state] up to match_offsets_[state + 1].
+  std::vector<int> matches_;
+  std::vector<int> match_offsets_;
+  uint32_t state_ = 0;
+};
+
+#endif  // __SEQUENCE_MATCHER_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sequence_matcher.h"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// Ids matched on each key, as one string, e.g. "-,-,0" for a match of
+// sequence 0 on the third key.
+std::string Feed(SequenceMatcher& matcher, const std::vector<int>& key_codes) {
+  std::string result;
+  for (const int key_code : key_codes) {
+    if (!result.empty()) result += ",";
+    const auto matches = matcher.Advance(key_code);
+    if (matches.empty()) result += "-";
+    for (std::size_t i = 0; i < matches.size(); ++i) {
+      if (i > 0) result += "+";
+      result += std::to_string(matches[i]);
+    }
+  }
+  return result;
+}
+
+SCENARIO("Sequences are matched") {
+  SequenceMatcher matcher;
+
+  GIVEN("No sequences") {
+    THEN("Nothing matches") { CHECK(Feed(matcher, {1, 2, 3}) == "-,-,-"); }
+  }
+
+  GIVEN("A sequence which overlaps itself") {
+    // Like KILL typed as KKILL.
+    REQUIRE(matcher.Add({1, 1, 2}) == 0);
+    THEN("A false start does not lose the match") {
+      CHECK(Feed(matcher, {1, 1, 1, 2}) == "-,-,-,0");
+    }
+    THEN("Other keys restart it") {
+      CHECK(Feed(matcher, {1, 3, 1, 2, 1, 1, 2}) == "-,-,-,-,-,-,0");
+    }
+  }
+
+  GIVEN("Sequences within others") {
+    REQUIRE(matcher.Add({1, 2, 3}) == 0);
+    REQUIRE(matcher.Add({2, 3}) == 1);
+    REQUIRE(matcher.Add({3}) == 2);
+    THEN("All are matched, longest first") {
+      CHECK(Feed(matcher, {1, 2, 3, 3}) == "-,-,0+1+2,2");
+    }
+    THEN("Matching continues after a match") {
+      matcher.Reset();
+      CHECK(Feed(matcher, {2, 3, 1, 2, 3}) == "-,1+2,-,-,0+1+2");
+    }
+  }
+
+  GIVEN("Many random sequences") {
+    std::mt19937 random(42);
+    std::vector<std::vector<int>> sequences;
+    for (int id = 0; id < 50; ++id) {
+      std::vector<int> sequence(1 + random() % 4);
+      for (int& key_code : sequence) key_code = random() % 6;
+      REQUIRE(matcher.Add(sequence) == id);
+      sequences.push_back(sequence);
+    }
+    THEN("Matches are the same as comparing every sequence") {
+      std::vector<int> typed;
+      for (int i = 0; i < 2000; ++i) {
+        typed.push_back(random() % 8);
+        const auto matches = matcher.Advance(typed.back());
+        std::vector<int> found(matches.begin(), matches.end());
+        std::sort(found.begin(), found.end());
+        std::vector<int> expected;
+        for (int id = 0; id < int(sequences.size()); ++id) {
+          const auto& sequence = sequences[id];
+          if (typed.size() >= sequence.size() &&
+              std::equal(sequence.begin(), sequence.end(),
+                         typed.end() - sequence.size())) {
+            expected.push_back(id);
+          }
+        }
+        REQUIRE(found == expected);
+      }
+    }
+  }
+
+  GIVEN("An empty sequence") {
+    CHECK_THROWS_AS(matcher.Add({}), std::invalid_argument);
+  }
+}
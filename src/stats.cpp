@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+// Attempts for a reader to get a consistent copy.
+const int kMaxReadAttempts = 1000;
+
+namespace {
+
+std::string EventTypeName(int type) {
+  switch (type) {
+    case EV_SYN: return "syn";
+    case EV_KEY: return "key";
+    case EV_REL: return "rel";
+    case EV_ABS: return "abs";
+    case EV_MSC: return "msc";
+    case EV_SW: return "sw";
+    case EV_LED: return "led";
+    case EV_SND: return "snd";
+    case EV_REP: return "rep";
+    default: return "type" + std::to_string(type);
+  }
+}
+
+int LatencyBucket(uint64_t micro_seconds) {
+  return std::min<int>(std::bit_width(micro_seconds), kLatencyBuckets - 1);
+}
+
+}  // namespace
+
+std::string StatsSegmentName(const std::string& device_path) {
+  std::string name = "/keyshift-stats-";
+  for (const char c : device_path) {
+    name += std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.'
+                ? c
+                : '_';
+  }
+  return name;
+}
+
+StatsPage::StatsPage(const std::string& device_path, bool keep_existing)
+    : segment_name_(StatsSegmentName(device_path)) {
+  const int fd = shm_open(segment_name_.c_str(), O_CREAT | O_RDWR | O_CLOEXEC,
+                          0644);
+  if (fd >= 0) {
+    struct stat st;
+    const bool compatible = fstat(fd, &st) == 0 &&
+                            st.st_size == sizeof(KeyshiftStats);
+    if (ftruncate(fd, sizeof(KeyshiftStats)) == 0) {
+      void* addr = mmap(nullptr, sizeof(KeyshiftStats), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+      if (addr != MAP_FAILED) {
+        stats_ = static_cast<KeyshiftStats*>(addr);
+        keep_existing &= compatible && stats_->version.load() ==
+                                           KeyshiftStats::kVersion;
+      }
+    }
+    close(fd);
+  }
+  if (stats_ == nullptr) {
+    perror("WARNING: Stats will not be published");
+    segment_name_.clear();
+    owned_ = std::make_unique<KeyshiftStats>();
+    stats_ = owned_.get();
+    keep_existing = false;
+  }
+  // The segment is zero filled when created, but may be stale.
+  if (!keep_existing) Reset();
+}
+
+StatsPage::StatsPage()
+    : owned_(std::make_unique<KeyshiftStats>()) {
+  stats_ = owned_.get();
+  Reset();
+}
+
+void StatsPage::Reset() {
+  BeginUpdate();
+  for (auto& counter : stats_->events_in) Set(counter, 0);
+  for (auto& counter : stats_->events_out) Set(counter, 0);
+  for (auto* counter :
+       {&stats_->key_presses, &stats_->passthrough, &stats_->remapped,
+        &stats_->blocked, &stats_->layer_activations,
+        &stats_->chatter_suppressed, &stats_->redundant_dropped,
+        &stats_->read_failures,
+        &stats_->syn_dropped, &stats_->events_discarded,
+        &stats_->write_failures, &stats_->write_blocked,
+        &stats_->output_overflows, &stats_->reloads,
+        &stats_->control_commands, &stats_->timer_wakeups}) {
+    Set(*counter, 0);
+  }
+  for (auto& counter : stats_->latency_us) Set(counter, 0);
+  for (auto& counter : stats_->timer_jitter_us) Set(counter, 0);
+  stats_->version.store(KeyshiftStats::kVersion, std::memory_order_relaxed);
+  EndUpdate();
+}
+
+StatsPage::~StatsPage() {
+  if (owned_ != nullptr) return;
+  munmap(stats_, sizeof(KeyshiftStats));
+  shm_unlink(segment_name_.c_str());
+}
+
+void StatsPage::AddLatency(uint64_t micro_seconds) {
+  Add(stats_->latency_us[LatencyBucket(micro_seconds)]);
+}
+
+void StatsPage::AddTimerJitter(uint64_t micro_seconds) {
+  Add(stats_->timer_wakeups);
+  Add(stats_->timer_jitter_us[LatencyBucket(micro_seconds)]);
+}
+
+KeyshiftStatsSnapshot ReadStatsUnlocked(const KeyshiftStats& stats) {
+  const auto load = [](const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  };
+  KeyshiftStatsSnapshot snapshot;
+  for (int i = 0; i < EV_CNT; ++i) {
+    snapshot.events_in[i] = load(stats.events_in[i]);
+    snapshot.events_out[i] = load(stats.events_out[i]);
+  }
+  snapshot.key_presses = load(stats.key_presses);
+  snapshot.passthrough = load(stats.passthrough);
+  snapshot.remapped = load(stats.remapped);
+  snapshot.blocked = load(stats.blocked);
+  snapshot.layer_activations = load(stats.layer_activations);
+  snapshot.chatter_suppressed = load(stats.chatter_suppressed);
+  snapshot.redundant_dropped = load(stats.redundant_dropped);
+  snapshot.read_failures = load(stats.read_failures);
+  snapshot.syn_dropped = load(stats.syn_dropped);
+  snapshot.events_discarded = load(stats.events_discarded);
+  snapshot.write_failures = load(stats.write_failures);
+  snapshot.write_blocked = load(stats.write_blocked);
+  snapshot.output_overflows = load(stats.output_overflows);
+  snapshot.reloads = load(stats.reloads);
+  snapshot.control_commands = load(stats.control_commands);
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    snapshot.latency_us[i] = load(stats.latency_us[i]);
+  }
+  snapshot.timer_wakeups = load(stats.timer_wakeups);
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    snapshot.timer_jitter_us[i] = load(stats.timer_jitter_us[i]);
+  }
+  return snapshot;
+}
+
+std::optional<KeyshiftStatsSnapshot> ReadStats(const KeyshiftStats& stats) {
+  for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+    const uint32_t sequence = stats.sequence.load(std::memory_order_acquire);
+    if (sequence % 2 == 1) continue;
+    if (stats.version.load(std::memory_order_relaxed) !=
+        KeyshiftStats::kVersion) {
+      return std::nullopt;
+    }
+    const auto snapshot = ReadStatsUnlocked(stats);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (stats.sequence.load(std::memory_order_relaxed) == sequence) {
+      return snapshot;
+    }
+  }
+  return std::nullopt;
+}
+
+std::string FormatStats(const KeyshiftStatsSnapshot& snapshot) {
+  std::ostringstream oss;
+  for (int i = 0; i < EV_CNT; ++i) {
+    if (snapshot.events_in[i] != 0) {
+      oss << "events_in." << EventTypeName(i) << " " << snapshot.events_in[i]
+          << "\n";
+    }
+  }
+  for (int i = 0; i < EV_CNT; ++i) {
+    if (snapshot.events_out[i] != 0) {
+      oss << "events_out." << EventTypeName(i) << " "
+          << snapshot.events_out[i] << "\n";
+    }
+  }
+  oss << "key_presses " << snapshot.key_presses << "\n";
+  if (snapshot.key_presses != 0) {
+    uint64_t events_read = 0;
+    for (const uint64_t count : snapshot.events_in) events_read += count;
+    oss << "events_in_per_key_press " << std::fixed << std::setprecision(2)
+        << double(events_read) / snapshot.key_presses << "\n";
+  }
+  oss << "passthrough " << snapshot.passthrough << "\n"
+      << "remapped " << snapshot.remapped << "\n"
+      << "blocked " << snapshot.blocked << "\n"
+      << "layer_activations " << snapshot.layer_activations << "\n"
+      << "chatter_suppressed " << snapshot.chatter_suppressed << "\n"
+      << "redundant_dropped " << snapshot.redundant_dropped << "\n"
+      << "read_failures " << snapshot.read_failures << "\n"
+      << "syn_dropped " << snapshot.syn_dropped << "\n"
+      << "events_discarded " << snapshot.events_discarded << "\n"
+      << "write_failures " << snapshot.write_failures << "\n"
+      << "write_blocked " << snapshot.write_blocked << "\n"
+      << "output_overflows " << snapshot.output_overflows << "\n"
+      << "reloads " << snapshot.reloads << "\n"
+      << "control_commands " << snapshot.control_commands << "\n";
+  const auto format_buckets = [&oss](const std::string& name,
+                                     const uint64_t* buckets) {
+    for (int i = 0; i < kLatencyBuckets; ++i) {
+      if (buckets[i] == 0) continue;
+      const std::string upper_bound = i == kLatencyBuckets - 1
+                                          ? "inf"
+                                          : std::to_string(uint64_t{1} << i);
+      oss << name << ".lt_" << upper_bound << " " << buckets[i] << "\n";
+    }
+  };
+  format_buckets("latency_us", snapshot.latency_us);
+  oss << "timer_wakeups " << snapshot.timer_wakeups << "\n";
+  format_buckets("timer_jitter_us", snapshot.timer_jitter_us);
+  return oss.str();
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Counters published in shared memory, so that monitoring tools can read them
+// without any syscall or message to the running instance.
+//
+// There is a single writer, the main loop, which updates the counters with
+// relaxed stores within a seqlock. Readers retry if the sequence changed
+// while they were reading. See keyshift_stats.cpp for a reader.
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <linux/input.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Latency bucket i counts events processed in [2^(i-1), 2^i) us, and bucket
+// 0 those under 1us. The last bucket also counts anything slower.
+const int kLatencyBuckets = 16;
+
+struct KeyshiftStats {
+  // Increment on any change of the layout.
+  static constexpr uint32_t kVersion = 7;
+
+  std::atomic<uint32_t> version;
+  // Odd while an update is in progress.
+  std::atomic<uint32_t> sequence;
+
+  // Indexed by event type, e.g. EV_KEY.
+  std::atomic<uint64_t> events_in[EV_CNT];
+  std::atomic<uint64_t> events_out[EV_CNT];
+  // To tell the events read per key press.
+  std::atomic<uint64_t> key_presses;
+
+  // Key events by how the Remapper handled them.
+  std::atomic<uint64_t> passthrough;
+  std::atomic<uint64_t> remapped;
+  std::atomic<uint64_t> blocked;
+  std::atomic<uint64_t> layer_activations;
+  // Key events dropped by debouncing as the switch chattered.
+  std::atomic<uint64_t> chatter_suppressed;
+  // Key events not written as the output was already in that state.
+  std::atomic<uint64_t> redundant_dropped;
+
+  std::atomic<uint64_t> read_failures;
+  // SYN_DROPPED read, i.e. the kernel dropped events as they were not read in
+  // time. Each is followed by a resync.
+  std::atomic<uint64_t> syn_dropped;
+  // Events discarded with the incomplete frames around a SYN_DROPPED.
+  std::atomic<uint64_t> events_discarded;
+  std::atomic<uint64_t> write_failures;
+  // Times a write to the virtual device could not complete at once.
+  std::atomic<uint64_t> write_blocked;
+  // Events dropped as too many were queued while writes were blocked.
+  std::atomic<uint64_t> output_overflows;
+  std::atomic<uint64_t> reloads;
+  std::atomic<uint64_t> control_commands;
+
+  std::atomic<uint64_t> latency_us[kLatencyBuckets];
+  // Wakeups for chords and repeats, and how late they were, in the same
+  // buckets as latency_us.
+  std::atomic<uint64_t> timer_wakeups;
+  std::atomic<uint64_t> timer_jitter_us[kLatencyBuckets];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+// Plain copy of KeyshiftStats, taken consistently.
+struct KeyshiftStatsSnapshot {
+  uint64_t events_in[EV_CNT];
+  uint64_t events_out[EV_CNT];
+  uint64_t key_presses;
+  uint64_t passthrough;
+  uint64_t remapped;
+  uint64_t blocked;
+  uint64_t layer_activations;
+  uint64_t chatter_suppressed;
+  uint64_t redundant_dropped;
+  uint64_t read_failures;
+  uint64_t syn_dropped;
+  uint64_t events_discarded;
+  uint64_t write_failures;
+  uint64_t write_blocked;
+  uint64_t output_overflows;
+  uint64_t reloads;
+  uint64_t control_commands;
+  uint64_t latency_us[kLatencyBuckets];
+  uint64_t timer_wakeups;
+  uint64_t timer_jitter_us[kLatencyBuckets];
+};
+
+// Name of the shared memory segment for a device, as in shm_open().
+std::string StatsSegmentName(const std::string& device_path);
+
+// Owns the KeyshiftStats of this instance, in /dev/shm if possible.
+class StatsPage {
+ public:
+  // If keep_existing, counters of a previous instance for the same device are
+  // continued, e.g. after an upgrade. Else they are reset.
+  StatsPage(const std::string& device_path, bool keep_existing);
+  // Counters are only kept in this process, e.g. for a dry run.
+  StatsPage();
+
+  ~StatsPage();
+
+  StatsPage(const StatsPage&) = delete;
+  StatsPage& operator=(const StatsPage&) = delete;
+
+  KeyshiftStats& stats() { return *stats_; }
+  const KeyshiftStats& stats() const { return *stats_; }
+
+  // Updates must happen between these.
+  inline void BeginUpdate() {
+    stats_->sequence.store(stats_->sequence.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  inline void EndUpdate() {
+    stats_->sequence.store(stats_->sequence.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_release);
+  }
+
+  // There is only one writer, so no read-modify-write is needed.
+  static inline void Add(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+  static inline void Set(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(value, std::memory_order_relaxed);
+  }
+
+  void AddLatency(uint64_t micro_seconds);
+  // Also counts the wakeup.
+  void AddTimerJitter(uint64_t micro_seconds);
+
+ private:
+  std::string segment_name_;
+  // Either mapped from segment_name_, or owned_ if that is not possible.
+  KeyshiftStats* stats_ = nullptr;
+  std::unique_ptr<KeyshiftStats> owned_;
+
+  // Resets all counters.
+  void Reset();
+};
+
+// Copies the stats without checking for updates in progress. Only for the
+// writer itself.
+KeyshiftStatsSnapshot ReadStatsUnlocked(const KeyshiftStats& stats);
+
+// One "name value" line per counter. Event types and latency buckets which
+// are zero are skipped.
+std::string FormatStats(const KeyshiftStatsSnapshot& snapshot);
+
+// Reads the stats consistently. Returns nullopt if the layout is of a
+// different version, or the writer did not let go in a reasonable time.
+std::optional<KeyshiftStatsSnapshot> ReadStats(const KeyshiftStats& stats);
+
+#endif  // __STATS_H
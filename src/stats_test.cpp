@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Stats are read consistently") {
+  StatsPage stats_page;
+  auto& stats = stats_page.stats();
+
+  stats_page.BeginUpdate();
+  StatsPage::Add(stats.events_in[EV_KEY], 3);
+  StatsPage::Set(stats.remapped, 2);
+  StatsPage::Add(stats.key_presses, 2);
+  stats_page.AddLatency(0);
+  stats_page.AddLatency(5);
+  stats_page.AddLatency(1'000'000'000);
+  stats_page.AddTimerJitter(40);
+  // Not readable while the update is in progress.
+  CHECK_FALSE(ReadStats(stats).has_value());
+  stats_page.EndUpdate();
+
+  const auto snapshot = ReadStats(stats);
+  REQUIRE(snapshot.has_value());
+  CHECK(snapshot->events_in[EV_KEY] == 3);
+  CHECK(snapshot->events_in[EV_MSC] == 0);
+  CHECK(snapshot->remapped == 2);
+  CHECK(snapshot->latency_us[0] == 1);
+  // 5us is in [4, 8).
+  CHECK(snapshot->latency_us[3] == 1);
+  CHECK(snapshot->latency_us[kLatencyBuckets - 1] == 1);
+  CHECK(snapshot->timer_wakeups == 1);
+  // 40us is in [32, 64).
+  CHECK(snapshot->timer_jitter_us[6] == 1);
+  const std::string formatted = FormatStats(snapshot.value());
+  CHECK(formatted.starts_with("events_in.key 3\n"));
+  CHECK(formatted.find("events_in_per_key_press 1.50\n") !=
+        std::string::npos);
+  CHECK(formatted.find("timer_jitter_us.lt_64 1\n") != std::string::npos);
+}
+
+TEST_CASE("Stats segment names") {
+  CHECK(StatsSegmentName("/dev/input/by-path/pci-0:14.0-usb-kbd") ==
+        "/keyshift-stats-_dev_input_by-path_pci-0_14.0-usb-kbd");
+}
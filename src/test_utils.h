@@ -25,8 +25,11 @@
 using std::string;
 using std::vector;
 
+// Unless strict_output is false, redundant output throws, see
+// Remapper::SetStrictOutput().
 std::vector<string> GetOutcomes(Remapper& remapper, bool keep_incoming,
-                                std::vector<std::pair<int, int>> keycodes) {
+                                std::vector<std::pair<int, int>> keycodes,
+                                bool strict_output = true) {
   std::vector<string> outcomes;
   auto process = [&outcomes, &remapper, keep_incoming](int keycode, int value) {
     if (keep_incoming) {
@@ -47,6 +50,7 @@ std::vector<string> GetOutcomes(Remapper& remapper, bool keep_incoming,
     remapper.Process(keycode, value);
   };
 
+  remapper.SetStrictOutput(strict_output);
   remapper.SetCallback([&outcomes](int keycode, int press) {
     std::ostringstream oss;
     std::string press_str;
@@ -71,6 +75,8 @@ std::vector<string> GetOutcomes(Remapper& remapper, bool keep_incoming,
   for (const auto& [keycode, value] : keycodes) {
     process(keycode, value);
   }
+  // The callback refers to outcomes, which is gone once this returns.
+  remapper.SetCallback(nullptr);
 
   return outcomes;
 }
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deadline_timer.h"
+
+#include <stdio.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// steady_clock is CLOCK_MONOTONIC on Linux, so its time points are used as
+// is.
+DeadlineTimer::DeadlineTimer() {
+  fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::runtime_error("timerfd_create failed: " +
+                             std::string(strerror(errno)));
+  }
+}
+
+DeadlineTimer::~DeadlineTimer() {
+  if (fd_ >= 0) close(fd_);
+}
+
+void DeadlineTimer::Set(std::optional<TimePoint> deadline) {
+  if (deadline == armed_) return;
+  struct itimerspec spec = {};
+  if (deadline.has_value()) {
+    const auto since_epoch = deadline->time_since_epoch();
+    const auto seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    spec.it_value.tv_sec = seconds.count();
+    spec.it_value.tv_nsec =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch -
+                                                             seconds)
+            .count();
+    // All zero would disarm it.
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+      spec.it_value.tv_nsec = 1;
+    }
+  }
+  if (timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+    perror("ERROR: timerfd_settime");
+    armed_.reset();
+    return;
+  }
+  armed_ = deadline;
+}
+
+std::optional<DeadlineTimer::TimePoint> DeadlineTimer::Consume() {
+  uint64_t expirations = 0;
+  if (read(fd_, &expirations, sizeof(expirations)) !=
+          sizeof(expirations) ||
+      expirations == 0) {
+    return std::nullopt;
+  }
+  // A one-shot timer, which is now disarmed.
+  const auto deadline = armed_;
+  armed_.reset();
+  return deadline;
+}
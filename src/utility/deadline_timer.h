@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A timerfd which expires at absolute deadlines of std::chrono::steady_clock,
+// to be used with poll(). Unlike a poll() timeout, the deadline is not rounded
+// to milliseconds, and a late wakeup does not push the next one back.
+//
+// How to use -
+//   DeadlineTimer timer;
+//   timer.Set(deadline);
+//   pollfd fds[] = {{timer.get_fd(), POLLIN, 0}};
+//   ...
+//   if (fds[0].revents & POLLIN) {
+//     if (const auto due = timer.Consume()) { /* Late by now - *due. */ }
+//   }
+#ifndef __DEADLINE_TIMER_H
+#define __DEADLINE_TIMER_H
+
+#include <chrono>
+#include <optional>
+
+class DeadlineTimer {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  DeadlineTimer();
+
+  ~DeadlineTimer();
+
+  DeadlineTimer(const DeadlineTimer&) = delete;
+  DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+
+  int get_fd() const { return fd_; }
+
+  // Arms the timer for the deadline, or disarms it for nullopt. The timer is
+  // only changed if the deadline is.
+  void Set(std::optional<TimePoint> deadline);
+
+  // Drains the expiration. Returns the deadline which expired, or nullopt if
+  // none did, e.g. as it was changed meanwhile.
+  std::optional<TimePoint> Consume();
+
+ private:
+  int fd_ = -1;
+  std::optional<TimePoint> armed_;
+};
+
+#endif  // __DEADLINE_TIMER_H
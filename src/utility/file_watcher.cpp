@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "file_watcher.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+FileWatcher::FileWatcher(const std::string& path) {
+  const std::filesystem::path fs_path =
+      std::filesystem::absolute(std::filesystem::path(path));
+  file_name_ = fs_path.filename().string();
+
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::runtime_error("inotify_init1 failed: " +
+                             std::string(strerror(errno)));
+  }
+  if (inotify_add_watch(fd_, fs_path.parent_path().c_str(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(fd_);
+    throw std::runtime_error("inotify_add_watch failed for " + path + ": " +
+                             std::string(strerror(errno)));
+  }
+}
+
+FileWatcher::~FileWatcher() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool FileWatcher::ConsumeEvents() {
+  // Enough for a few events with names.
+  alignas(struct inotify_event) char buffer[4096];
+  bool changed = false;
+  while (true) {
+    const ssize_t len = read(fd_, buffer, sizeof(buffer));
+    if (len <= 0) break;  // EAGAIN once drained.
+    for (ssize_t offset = 0; offset < len;) {
+      const auto* event =
+          reinterpret_cast<const struct inotify_event*>(buffer + offset);
+      if (event->len > 0 && file_name_ == event->name) {
+        changed = true;
+      }
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Watches a file for changes with inotify, to be used with poll().
+//
+// How to use -
+//   FileWatcher watcher("/path/to/file");
+//   pollfd fds[] = {{watcher.get_fd(), POLLIN, 0}};
+//   ...
+//   if (fds[0].revents & POLLIN && watcher.ConsumeEvents()) {
+//     // File was modified.
+//   }
+//
+// The directory is watched instead of the file, so that editors which save by
+// renaming a temporary file over the original are also detected.
+#ifndef __FILE_WATCHER_H
+#define __FILE_WATCHER_H
+
+#include <string>
+
+class FileWatcher {
+ public:
+  FileWatcher(const std::string& path);
+
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  int get_fd() const { return fd_; }
+
+  // Drains pending notifications. Returns true if any of them was for the
+  // watched file.
+  bool ConsumeEvents();
+
+ private:
+  std::string file_name_;
+  int fd_ = -1;
+};
+
+#endif  // __FILE_WATCHER_H
@@ -24,11 +24,34 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "device_capabilities.h"
+
+// Events buffered before a write, enough for a few frames.
+const int kOutputBufferReserve = 64;
+
+// Events queued while the output is blocked, beyond which forwarded events
+// are dropped.
+const std::size_t kOutputQueueLimit = 4096;
 
 class VirtualDevice {
  public:
-  VirtualDevice() {
+  // A keyboard with all keys up to KEY_MICMUTE.
+  VirtualDevice() : VirtualDevice(AllKeys()) {}
+
+  // Mirrors the capabilities, e.g. of the grabbed device along with the keys
+  // the config can emit.
+  //
+  // EV_REP is left out, as the kernel would then generate repeats on top of
+  // those forwarded. EV_FF is left out, as effects would need to be serviced.
+  explicit VirtualDevice(const DeviceCapabilities& capabilities) {
+    const auto start_time = std::chrono::steady_clock::now();
     const int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
     if (fd < 0) {
       perror("Unable to open /dev/uinput");
@@ -45,19 +68,38 @@ class VirtualDevice {
     setup.id.version = 1;
     strcpy(setup.name, "Virtual Keyboard");
 
-    // Enable the necessary event types and keys
-    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) {
-      perror("UI_SET_EVBIT failed");
-      close(fd);
-      return;
+    // Only the bits which are set, to keep the number of ioctls low.
+    int ioctl_count = 0;
+    const auto set_bit = [&](unsigned long request, int bit) {
+      ++ioctl_count;
+      if (ioctl(fd, request, bit) < 0) {
+        std::cerr << "Error setting bit " << bit << " for " << request << ": "
+                  << strerror(errno) << std::endl;
+        return false;
+      }
+      return true;
+    };
+    const std::pair<int, unsigned long> type_requests[] = {
+        {EV_KEY, UI_SET_KEYBIT}, {EV_REL, UI_SET_RELBIT},
+        {EV_ABS, UI_SET_ABSBIT}, {EV_MSC, UI_SET_MSCBIT},
+        {EV_SW, UI_SET_SWBIT},   {EV_LED, UI_SET_LEDBIT},
+        {EV_SND, UI_SET_SNDBIT}};
+    for (const auto& [type, request] : type_requests) {
+      if (!capabilities.Has(type)) continue;
+      if (!set_bit(UI_SET_EVBIT, type)) {
+        close(fd);
+        return;
+      }
+      for (int code = 0; code < DeviceCapabilities::CodeCount(type); ++code) {
+        if (capabilities.Has(type, code) && !set_bit(request, code)) {
+          close(fd);
+          return;
+        }
+      }
     }
-
-    // Enable the device to send all possible keys.
-    // So far it looks like KEY_MICMUTE is the highest with value 248.
-    for (int keycode = KEY_ESC; keycode <= 255; ++keycode) {
-      if (ioctl(fd, UI_SET_KEYBIT, keycode) < 0) {
-        std::cerr << "Error setting key bit for keycode " << keycode
-                  << std::endl;
+    for (int property = 0; property < INPUT_PROP_CNT; ++property) {
+      if (capabilities.HasProperty(property) &&
+          !set_bit(UI_SET_PROPBIT, property)) {
         close(fd);
         return;
       }
@@ -69,6 +111,20 @@ class VirtualDevice {
       return;
     }
 
+    for (int code = 0; code < ABS_CNT; ++code) {
+      if (!capabilities.Has(EV_ABS, code)) continue;
+      struct uinput_abs_setup abs_setup;
+      memset(&abs_setup, 0, sizeof(abs_setup));
+      abs_setup.code = code;
+      abs_setup.absinfo = capabilities.abs_info[code];
+      ++ioctl_count;
+      if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
+        perror("UI_ABS_SETUP failed");
+        close(fd);
+        return;
+      }
+    }
+
     if (ioctl(fd, UI_DEV_CREATE) < 0) {
       perror("UI_DEV_CREATE failed");
       close(fd);
@@ -76,6 +132,19 @@ class VirtualDevice {
     }
 
     file_descriptor_ = fd;
+    ReserveBuffers();
+    std::cout << "Virtual device created in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count()
+              << "us, with " << ioctl_count << " capability ioctls."
+              << std::endl;
+  }
+
+  // Takes over a uinput device which is already created, e.g. by a previous
+  // instance which handed it over.
+  explicit VirtualDevice(int created_fd) : file_descriptor_(created_fd) {
+    ReserveBuffers();
   }
 
   ~VirtualDevice() {
@@ -93,25 +162,186 @@ class VirtualDevice {
 
   inline int IsOpen() const { return file_descriptor_ >= 0; }
 
-  void DoKeyEvent(unsigned int code, int value) const {
-    SendEvent(EV_KEY, code, value);
-    SendEvent(EV_SYN, SYN_REPORT, 0);  // Synchronize
+  int get_fd() const { return file_descriptor_; }
+
+  // Sends a key event in a frame of its own. Returns false if the event could
+  // not be written right away.
+  bool DoKeyEvent(unsigned int code, int value) {
+    QueueEvent(EV_KEY, code, value);
+    EndFrame();
+    return Flush() == FlushResult::kWritten;
   }
 
- private:
-  void SendEvent(unsigned int type, unsigned int code, int value) const {
-    if (!IsOpen()) return;
+  // Adds an event to the current frame, which is sent on Flush(). Frames are
+  // delimited by SYN_REPORT, either queued as is or added by EndFrame().
+  //
+  // Always queued, even beyond kOutputQueueLimit, since dropping a key release
+  // would leave the key stuck. Keys are bounded by the keyboard anyway.
+  void QueueEvent(unsigned int type, unsigned int code, int value) {
+    if (type == EV_KEY) {
+      // Readers only see the state at the end of a frame, so a key pressed
+      // and released within one frame would be lost. Split the frame instead.
+      if (std::find(frame_key_codes_.begin(), frame_key_codes_.end(), code) !=
+          frame_key_codes_.end()) {
+        EndFrame();
+      }
+      frame_key_codes_.push_back(code);
+    }
     struct input_event ev;
     memset(&ev, 0, sizeof(ev));
     ev.type = type;
     ev.code = code;
     ev.value = value;
+    pending_.push_back(ev);
+    if (type == EV_SYN && code == SYN_REPORT) {
+      frame_key_codes_.clear();
+      complete_ = pending_.size();
+    }
+  }
 
-    if (write(file_descriptor_, &ev, sizeof(ev)) < 0) {
-      perror("write failed");
+  // Adds events as they are, e.g. forwarded from the input device. The events
+  // must not include EV_KEY, as those are not checked for repeats.
+  //
+  // Returns false if the events were dropped, because the output is blocked
+  // and kOutputQueueLimit is reached.
+  [[nodiscard]] bool QueueEvents(std::span<const struct input_event> events) {
+    if (events.empty()) return true;
+    if (pending_.size() + events.size() > kOutputQueueLimit) [[unlikely]] {
+      return false;
+    }
+    pending_.insert(pending_.end(), events.begin(), events.end());
+    const auto last_report =
+        std::find_if(events.rbegin(), events.rend(), [](const auto& ev) {
+          return ev.type == EV_SYN && ev.code == SYN_REPORT;
+        });
+    if (last_report != events.rend()) {
+      frame_key_codes_.clear();
+      complete_ = pending_.size() - (last_report - events.rbegin());
     }
+    return true;
+  }
+
+  // Completes the current frame, if there is one.
+  void EndFrame() {
+    if (complete_ < pending_.size()) QueueEvent(EV_SYN, SYN_REPORT, 0);
+  }
+
+  // Complete frames, which will be written on Flush().
+  std::span<const struct input_event> pending() const {
+    return std::span(pending_).first(complete_);
+  }
+
+  // True if there are complete frames which are not written yet, e.g. as the
+  // last Flush() was blocked.
+  bool HasPending() const { return complete_ > 0; }
+
+  // True if nothing is queued, not even an incomplete frame.
+  bool empty() const { return pending_.empty(); }
+
+  enum class FlushResult {
+    kWritten,
+    // Nothing or only some of the events were written. The rest are kept for
+    // the next Flush(), which should be after the device polls POLLOUT.
+    kBlocked,
+    // The events are dropped.
+    kFailed,
+  };
+
+  // Writes the complete frames with a single write(), in order. An
+  // incomplete frame at the end is kept. on_written is called for every
+  // event written.
+  template <typename OnWritten>
+  FlushResult Flush(OnWritten&& on_written) {
+    if (complete_ == 0) return FlushResult::kWritten;
+    const ssize_t bytes =
+        IsOpen() ? write(file_descriptor_, pending_.data(),
+                         complete_ * sizeof(struct input_event))
+                 : -1;
+    if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+      return FlushResult::kBlocked;
+    }
+    if (bytes < 0) {
+      if (IsOpen()) perror("write failed");
+      Erase(complete_);
+      return FlushResult::kFailed;
+    }
+    // The kernel only takes whole events.
+    const std::size_t written = bytes / sizeof(struct input_event);
+    for (std::size_t i = 0; i < written; ++i) on_written(pending_[i]);
+    Erase(written);
+    return complete_ == 0 ? FlushResult::kWritten : FlushResult::kBlocked;
+  }
+  FlushResult Flush() {
+    return Flush([](const struct input_event&) {});
+  }
+
+  // Writes events forwarded as is, e.g. a batch of pointer motion read from
+  // the input device, straight from the caller's buffer rather than copying
+  // them to the queue first. Must only be called when empty(), as frames are
+  // written in order. What is not written, and an incomplete frame at the
+  // end, is queued as with QueueEvents(), and kFailed is returned if that
+  // overflows. Otherwise the same as Flush().
+  template <typename OnWritten>
+  FlushResult WriteThrough(std::span<const struct input_event> events,
+                           OnWritten&& on_written) {
+    const auto last_report =
+        std::find_if(events.rbegin(), events.rend(), [](const auto& ev) {
+          return ev.type == EV_SYN && ev.code == SYN_REPORT;
+        });
+    const std::size_t complete = events.rend() - last_report;
+    // Events written, or dropped on a failure.
+    std::size_t done = 0;
+    FlushResult result = FlushResult::kWritten;
+    if (complete > 0) {
+      const ssize_t bytes =
+          IsOpen() ? write(file_descriptor_, events.data(),
+                           complete * sizeof(struct input_event))
+                   : -1;
+      if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+        result = FlushResult::kBlocked;
+      } else if (bytes < 0) {
+        if (IsOpen()) perror("write failed");
+        done = complete;
+        result = FlushResult::kFailed;
+      } else {
+        done = bytes / sizeof(struct input_event);
+        for (std::size_t i = 0; i < done; ++i) on_written(events[i]);
+        if (done < complete) result = FlushResult::kBlocked;
+      }
+    }
+    if (!QueueEvents(events.subspan(done))) [[unlikely]] {
+      return FlushResult::kFailed;
+    }
+    return result;
+  }
+
+ private:
+  static DeviceCapabilities AllKeys() {
+    DeviceCapabilities capabilities;
+    for (int keycode = KEY_ESC; keycode <= KEY_MICMUTE; ++keycode) {
+      capabilities.Add(EV_KEY, keycode);
+    }
+    return capabilities;
+  }
+
+  // Removes events from the front of the queue.
+  void Erase(std::size_t count) {
+    pending_.erase(pending_.begin(), pending_.begin() + count);
+    complete_ -= count;
+  }
+
+  void ReserveBuffers() {
+    pending_.reserve(kOutputBufferReserve);
+    frame_key_codes_.reserve(kOutputBufferReserve);
   }
 
   // If negative, then the file isn't opened and there was some error.
   int file_descriptor_ = -1;
+
+  // Events queued for the next write.
+  std::vector<struct input_event> pending_;
+  // Number of events in pending_ up to the end of the last complete frame.
+  std::size_t complete_ = 0;
+  // Keys in the current, incomplete frame of pending_.
+  std::vector<unsigned int> frame_key_codes_;
 };
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "virtual_device.h"
+
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+// Events as a compact string, e.g. "K30:1 S" for a press of KEY_A and a
+// SYN_REPORT.
+std::string Describe(std::span<const struct input_event> events) {
+  std::string result;
+  for (const auto& ev : events) {
+    if (!result.empty()) result += " ";
+    if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+      result += "S";
+    } else {
+      result += ev.type == EV_KEY ? "K" : "T" + std::to_string(ev.type) + ":";
+      result += std::to_string(ev.code) + ":" + std::to_string(ev.value);
+    }
+  }
+  return result;
+}
+
+struct input_event Event(int type, int code, int value) {
+  struct input_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = type;
+  ev.code = code;
+  ev.value = value;
+  return ev;
+}
+
+SCENARIO("Events are queued in frames") {
+  // Not opened, so nothing is written.
+  VirtualDevice device(-1);
+
+  GIVEN("Forwarded events with a key spliced in") {
+    const struct input_event before[] = {Event(EV_MSC, MSC_SCAN, 4)};
+    const struct input_event after[] = {Event(EV_REL, REL_X, 2),
+                                        Event(EV_SYN, SYN_REPORT, 0)};
+    REQUIRE(device.QueueEvents(before));
+    device.QueueEvent(EV_KEY, KEY_B, 1);
+    REQUIRE(device.QueueEvents(after));
+    THEN("The order and the frame are kept") {
+      CHECK(Describe(device.pending()) == "T4:4:4 K48:1 T2:0:2 S");
+    }
+  }
+
+  GIVEN("The same key twice in a frame") {
+    device.QueueEvent(EV_KEY, KEY_LEFTCTRL, 1);
+    device.QueueEvent(EV_KEY, KEY_C, 1);
+    device.QueueEvent(EV_KEY, KEY_C, 0);
+    device.QueueEvent(EV_KEY, KEY_LEFTCTRL, 0);
+    device.EndFrame();
+    THEN("The frame is split") {
+      CHECK(Describe(device.pending()) == "K29:1 K46:1 S K46:0 K29:0 S");
+    }
+  }
+
+  GIVEN("A key in consecutive frames") {
+    device.QueueEvent(EV_KEY, KEY_C, 1);
+    device.EndFrame();
+    device.EndFrame();
+    device.QueueEvent(EV_KEY, KEY_C, 0);
+    device.EndFrame();
+    THEN("Frames are not split further, nor empty") {
+      CHECK(Describe(device.pending()) == "K46:1 S K46:0 S");
+    }
+    THEN("Flush fails but drops the events") {
+      CHECK(device.Flush() == VirtualDevice::FlushResult::kFailed);
+      CHECK(device.pending().empty());
+    }
+  }
+
+  GIVEN("An incomplete frame") {
+    const struct input_event events[] = {Event(EV_REL, REL_X, 1),
+                                         Event(EV_SYN, SYN_REPORT, 0),
+                                         Event(EV_REL, REL_X, 2)};
+    REQUIRE(device.QueueEvents(events));
+    THEN("Only complete frames are pending") {
+      CHECK(Describe(device.pending()) == "T2:0:1 S");
+      device.Flush();
+      CHECK_FALSE(device.HasPending());
+      device.EndFrame();
+      CHECK(Describe(device.pending()) == "T2:0:2 S");
+    }
+  }
+
+  GIVEN("A full queue") {
+    const std::vector<struct input_event> events(kOutputQueueLimit,
+                                                 Event(EV_REL, REL_X, 1));
+    REQUIRE(device.QueueEvents(events));
+    THEN("Forwarded events are dropped, but not keys") {
+      const struct input_event more[] = {Event(EV_REL, REL_Y, 1)};
+      CHECK_FALSE(device.QueueEvents(more));
+      device.QueueEvent(EV_KEY, KEY_A, 0);
+      device.EndFrame();
+      CHECK(device.pending().size() == kOutputQueueLimit + 2);
+    }
+  }
+}
+
+SCENARIO("Forwarded events are written through") {
+  const struct input_event events[] = {
+      Event(EV_REL, REL_X, 1), Event(EV_REL, REL_Y, -1),
+      Event(EV_SYN, SYN_REPORT, 0), Event(EV_REL, REL_X, 2)};
+  int written = 0;
+  const auto count = [&written](const struct input_event&) { ++written; };
+
+  GIVEN("A device which is written") {
+    // A pipe in place of uinput.
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    VirtualDevice device(pipe_fds[1]);
+    REQUIRE(device.empty());
+    THEN("Complete frames are written as they are, the rest is queued") {
+      CHECK(device.WriteThrough(events, count) ==
+            VirtualDevice::FlushResult::kWritten);
+      CHECK(written == 3);
+      struct input_event read_back[3];
+      REQUIRE(read(pipe_fds[0], read_back, sizeof(read_back)) ==
+              sizeof(read_back));
+      CHECK(Describe(read_back) == "T2:0:1 T2:1:-1 S");
+      CHECK(!device.HasPending());
+      CHECK(!device.empty());
+      device.EndFrame();
+      CHECK(Describe(device.pending()) == "T2:0:2 S");
+    }
+    close(pipe_fds[0]);
+  }
+
+  GIVEN("A device which is not opened") {
+    VirtualDevice device(-1);
+    THEN("Complete frames are dropped, the rest is still queued") {
+      CHECK(device.WriteThrough(events, count) ==
+            VirtualDevice::FlushResult::kFailed);
+      CHECK(written == 0);
+      device.EndFrame();
+      CHECK(Describe(device.pending()) == "T2:0:2 S");
+    }
+  }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Notches of a mouse wheel as keys, e.g. to map WHEELUP in a layer like any
+// other key.
+#ifndef __WHEEL_KEYS_H
+#define __WHEEL_KEYS_H
+
+#include <linux/input.h>
+
+#include <array>
+#include <utility>
+
+// Key codes for the notches of the wheels, which no device sends. They are in
+// the unused codes past the last button, so that the Remapper and the config
+// take them as keys.
+const int kKeyWheelUp = 0x2f0;
+const int kKeyWheelDown = 0x2f1;
+const int kKeyWheelLeft = 0x2f2;
+const int kKeyWheelRight = 0x2f3;
+static_assert(BTN_TRIGGER_HAPPY40 < kKeyWheelUp && kKeyWheelRight < KEY_CNT);
+
+// Units of REL_WHEEL_HI_RES and REL_HWHEEL_HI_RES per notch.
+const int kHiResPerNotch = 120;
+
+inline bool IsWheelKey(int key_code) {
+  return key_code >= kKeyWheelUp && key_code <= kKeyWheelRight;
+}
+
+// The key for a notch of REL_WHEEL or REL_HWHEEL, by the sign of value.
+inline int WheelKey(int rel_code, int value) {
+  if (rel_code == REL_WHEEL) return value > 0 ? kKeyWheelUp : kKeyWheelDown;
+  return value > 0 ? kKeyWheelRight : kKeyWheelLeft;
+}
+
+// The REL_WHEEL or REL_HWHEEL code and value of a notch of a wheel key.
+inline std::pair<int, int> WheelNotch(int key_code) {
+  switch (key_code) {
+    case kKeyWheelUp:
+      return {REL_WHEEL, 1};
+    case kKeyWheelDown:
+      return {REL_WHEEL, -1};
+    case kKeyWheelLeft:
+      return {REL_HWHEEL, -1};
+    default:
+      return {REL_HWHEEL, 1};
+  }
+}
+
+// The high resolution code sent along with a wheel code.
+inline int HiResCode(int rel_code) {
+  return rel_code == REL_WHEEL ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES;
+}
+
+// Turns the notches of the wheels the config maps into presses and releases
+// of wheel keys. Other EV_REL codes, e.g. pointer motion, are not touched, and
+// telling them apart is a lookup.
+class WheelKeys {
+ public:
+  // Takes the wheels of the wheel keys among key_codes, e.g. those the config
+  // reacts to, instead of passing them on.
+  template <typename KeyCodes>
+  void Map(const KeyCodes& key_codes) {
+    intercepted_.fill(false);
+    for (const int key_code : key_codes) {
+      if (!IsWheelKey(key_code)) continue;
+      const int rel_code = WheelNotch(key_code).first;
+      intercepted_[rel_code] = true;
+      // Only whole notches are taken, so the finer steps are dropped.
+      intercepted_[HiResCode(rel_code)] = true;
+    }
+  }
+
+  bool empty() const {
+    return !intercepted_[REL_WHEEL] && !intercepted_[REL_HWHEEL];
+  }
+
+  // True if the EV_REL code is taken, and so must go through Process() rather
+  // than be passed on.
+  bool Maps(int rel_code) const {
+    return rel_code < REL_CNT && intercepted_[rel_code];
+  }
+
+  // emit(key_code, value) is called with a press and a release for each
+  // notch of an EV_REL event of a code Maps().
+  template <typename Emit>
+  void Process(int rel_code, int value, Emit&& emit) const {
+    if (rel_code != REL_WHEEL && rel_code != REL_HWHEEL) return;
+    const int key_code = WheelKey(rel_code, value);
+    for (int notch = 0; notch < value || notch < -value; ++notch) {
+      emit(key_code, 1);
+      emit(key_code, 0);
+    }
+  }
+
+ private:
+  std::array<bool, REL_CNT> intercepted_{};
+};
+
+#endif  // __WHEEL_KEYS_H
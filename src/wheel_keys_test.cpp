@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024 Nomen Aliud (aka Arnab Bose)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wheel_keys.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+SCENARIO("Wheel notches as keys") {
+  WheelKeys wheel_keys;
+  std::vector<std::string> keys;
+  const auto emit = [&keys](int key_code, int value) {
+    keys.push_back(std::to_string(key_code) + " " + std::to_string(value));
+  };
+
+  GIVEN("No wheel keys") {
+    wheel_keys.Map(std::vector<int>{KEY_A, BTN_SIDE});
+    THEN("Nothing is taken") {
+      CHECK(wheel_keys.empty());
+      CHECK(!wheel_keys.Maps(REL_WHEEL));
+      CHECK(!wheel_keys.Maps(REL_X));
+    }
+  }
+
+  GIVEN("A key of the vertical wheel") {
+    wheel_keys.Map(std::vector<int>{KEY_A, kKeyWheelDown});
+    THEN("Both directions of that wheel are taken, but not motion") {
+      CHECK(!wheel_keys.empty());
+      CHECK(wheel_keys.Maps(REL_WHEEL));
+      CHECK(wheel_keys.Maps(REL_WHEEL_HI_RES));
+      CHECK(!wheel_keys.Maps(REL_HWHEEL));
+      CHECK(!wheel_keys.Maps(REL_X));
+      CHECK(!wheel_keys.Maps(REL_CNT));
+    }
+    THEN("Each notch is a tap") {
+      wheel_keys.Process(REL_WHEEL, -2, emit);
+      wheel_keys.Process(REL_WHEEL, 1, emit);
+      const std::string down = std::to_string(kKeyWheelDown);
+      const std::string up = std::to_string(kKeyWheelUp);
+      CHECK(keys == std::vector<std::string>{down + " 1", down + " 0",
+                                             down + " 1", down + " 0",
+                                             up + " 1", up + " 0"});
+    }
+    THEN("The finer steps are dropped") {
+      wheel_keys.Process(REL_WHEEL_HI_RES, -120, emit);
+      CHECK(keys.empty());
+    }
+    THEN("Mapping again replaces the wheels taken") {
+      wheel_keys.Map(std::vector<int>{kKeyWheelRight});
+      CHECK(!wheel_keys.Maps(REL_WHEEL));
+      CHECK(wheel_keys.Maps(REL_HWHEEL_HI_RES));
+    }
+  }
+
+  GIVEN("Notches and keys") {
+    THEN("They convert both ways") {
+      for (const int key_code :
+           {kKeyWheelUp, kKeyWheelDown, kKeyWheelLeft, kKeyWheelRight}) {
+        CHECK(IsWheelKey(key_code));
+        const auto [rel_code, value] = WheelNotch(key_code);
+        CHECK(WheelKey(rel_code, value) == key_code);
+      }
+      CHECK(!IsWheelKey(BTN_EXTRA));
+      CHECK(HiResCode(REL_HWHEEL) == REL_HWHEEL_HI_RES);
+    }
+  }
+}